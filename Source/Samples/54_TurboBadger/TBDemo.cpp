@@ -42,6 +42,7 @@
 #include <tb_node_tree.h>
 #include <tb_tempbuffer.h>
 #include <tb_font_renderer.h>
+#include <tb_profiler.h>
 #include <image/tb_image_manager.h>
 #include <utf8/utf8.h>
 #include <tests/tb_test.h>
@@ -1004,6 +1005,42 @@ bool MainWindow::OnEvent(const TBWidgetEvent &ev)
 			msg_win->Show("GFX load performance", message);
 			return true;
 		}
+		else if (ev.target->GetID() == TBIDC("inflate performance"))
+		{
+			// Create a layout with many widgets, both from resource text and from a compiled template.
+			const int num_widgets = 2000;
+			TBStr source("TBLayout: axis: y\n");
+			for (int i = 0; i < num_widgets; i++)
+			{
+				TBStr line;
+				if (i % 2)
+					line.SetFormatted("\tTBButton: id: 'button %d', text: 'Button %d', skin: 'TBButton.flat'\n", i, i);
+				else
+					line.SetFormatted("\tTBCheckBox: id: 'check %d', value: 1\n", i);
+				source.Append(line);
+			}
+			TBWidgetTemplate widget_template;
+			widget_template.ReadData(g_widgets_reader, source, source.Length());
+
+			double t1 = TBSystem::GetTimeMS();
+			{
+				TBWidget root;
+				g_widgets_reader->LoadData(&root, source);
+			}
+			double t2 = TBSystem::GetTimeMS();
+			{
+				TBWidget root;
+				g_widgets_reader->LoadTemplate(&root, &widget_template);
+			}
+			double t3 = TBSystem::GetTimeMS();
+
+			TBStr message;
+			message.SetFormatted("Creating %d widgets took %dms from resource text, and %dms from a compiled template.",
+								num_widgets + 1, (int)(t2 - t1), (int)(t3 - t2));
+			TBMessageWindow *msg_win = new TBMessageWindow(ev.target, TBID());
+			msg_win->Show("Inflate performance", message);
+			return true;
+		}
 		else if (ev.target->GetID() == TBIDC("test context lost"))
 		{
 			g_renderer->InvokeContextLost();
@@ -1077,6 +1114,12 @@ bool MainWindow::OnEvent(const TBWidgetEvent &ev)
 #endif
 			return true;
 		}
+		else if (ev.type == EVENT_TYPE_CLICK && ev.target->GetID() == TBIDC("frame profiler"))
+		{
+			// Available in all builds, unlike the debug settings.
+			ShowProfilerWindow(GetParentRoot());
+			return true;
+		}
 	}
 	return DemoWindow::OnEvent(ev);
 }
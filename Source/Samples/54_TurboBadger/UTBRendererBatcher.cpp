@@ -31,9 +31,13 @@
 #include <Urho3D/Graphics/Graphics.h>
 #include <Urho3D/Graphics/GraphicsEvents.h>
 #include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/ShaderVariation.h>
+#include <Urho3D/Math/Matrix3x4.h>
 #include <Urho3D/Graphics/Texture2D.h>
 #include <Urho3D/Resource/ResourceCache.h>
 #include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/File.h>
 #include <Urho3D/Input/InputEvents.h>
 
 #include <TurboBadger/tb_font_renderer.h>
@@ -59,7 +63,19 @@ UTBRendererBatcher* UTBRendererBatcher::pSingleton_ = NULL;
 
 //=============================================================================
 //=============================================================================
-UTBBitmap::UTBBitmap(Context *_pContext, int _width, int _height) 
+static inline void SetUIVertex(float *_pdest, float _x, float _y, uint32 _color, float _u, float _v)
+{
+    _pdest[0]             = _x;
+    _pdest[1]             = _y;
+    _pdest[2]             = 0.0f;
+    ((unsigned&)_pdest[3]) = _color;
+    _pdest[4]             = _u;
+    _pdest[5]             = _v;
+}
+
+//=============================================================================
+//=============================================================================
+UTBBitmap::UTBBitmap(Context *_pContext, int _width, int _height, unsigned _format) 
     : context_( _pContext )
     , width_( _width ) 
     , height_( _height )
@@ -70,7 +86,7 @@ UTBBitmap::UTBBitmap(Context *_pContext, int _width, int _height)
     // set texture format
     texture_->SetMipsToSkip( QUALITY_LOW, 0 );
     texture_->SetNumLevels( 1 );
-    texture_->SetSize( width_, height_, Graphics::GetRGBAFormat() );
+    texture_->SetSize( width_, height_, _format );
 
     // set uv modes
     texture_->SetAddressMode( COORD_U, ADDRESS_WRAP );
@@ -87,11 +103,62 @@ UTBBitmap::~UTBBitmap()
     }
 }
 
+//=============================================================================
+//=============================================================================
+void UTBBitmap::SetDataRect(uint32 *_pdata, const TBRect &_rect)
+{
+    TB_PROFILER_COUNT( BYTES_UPLOADED, _rect.w * _rect.h * sizeof(uint32) );
+
+    // full rows are contiguous in the bitmap data
+    if ( _rect.x == 0 && _rect.w == width_ )
+    {
+        texture_->SetData( 0, 0, _rect.y, _rect.w, _rect.h, _pdata + _rect.y * width_ );
+        return;
+    }
+
+    // pack the rows of the rect
+    rectData_.Resize( _rect.w * _rect.h );
+
+    for ( int i = 0; i < _rect.h; ++i )
+    {
+        memcpy( &rectData_[ i * _rect.w ], _pdata + _rect.x + (_rect.y + i) * width_, _rect.w * sizeof(uint32) );
+    }
+
+    texture_->SetData( 0, _rect.x, _rect.y, _rect.w, _rect.h, &rectData_[ 0 ] );
+}
+
+//=============================================================================
+//=============================================================================
+void UTBBitmap::SetDataA8(uint8 *_pdata, const TBRect &_rect)
+{
+    TB_PROFILER_COUNT( BYTES_UPLOADED, _rect.w * _rect.h );
+
+    // full rows are contiguous in the bitmap data
+    if ( _rect.x == 0 && _rect.w == width_ )
+    {
+        texture_->SetData( 0, 0, _rect.y, _rect.w, _rect.h, _pdata + _rect.y * width_ );
+        return;
+    }
+
+    // pack the rows of the rect
+    rectDataA8_.Resize( _rect.w * _rect.h );
+
+    for ( int i = 0; i < _rect.h; ++i )
+    {
+        memcpy( &rectDataA8_[ i * _rect.w ], _pdata + _rect.x + (_rect.y + i) * width_, _rect.w );
+    }
+
+    texture_->SetData( 0, _rect.x, _rect.y, _rect.w, _rect.h, &rectDataA8_[ 0 ] );
+}
+
 //=============================================================================
 //=============================================================================
 UTBRendererBatcher::UTBRendererBatcher(Context *_pContext, int _iwidth, int _iheight) 
     : UIElement( _pContext )
     , TBRendererBatcher() 
+    , retainedMode_( true )
+    , indexedMode_( false )
+    , indexedBuffersDirty_( true )
 {
     SetPosition( 0, 0 );
     OnResizeWin( _iwidth, _iheight );
@@ -103,6 +170,10 @@ UTBRendererBatcher::~UTBRendererBatcher()
 {
     vertexData_.Clear();
     batches_.Clear();
+    batchRanges_.Clear();
+    indexedBatches_.Clear();
+    vertexBuffer_ = NULL;
+    indexBuffer_ = NULL;
     uKeytoTBkeyMap.Clear();
 
     TBWidgetsAnimationManager::Shutdown();
@@ -145,15 +216,57 @@ void UTBRendererBatcher::Init(const String &_strDataPath)
     RegisterHandlers();
 }
 
+//=============================================================================
+//=============================================================================
+void UTBRendererBatcher::SetRetainedMode(bool _bretained)
+{
+    retainedMode_ = _bretained;
+
+    // make sure the next frame is painted
+    root_.Invalidate();
+}
+
+//=============================================================================
+//=============================================================================
+void UTBRendererBatcher::SetIndexedMode(bool _bindexed)
+{
+    if ( indexedMode_ == _bindexed )
+    {
+        return;
+    }
+
+    indexedMode_ = _bindexed;
+
+    if ( indexedMode_ && vertexBuffer_ == NULL )
+    {
+        vertexBuffer_ = new VertexBuffer( GetContext() );
+        vertexBuffer_->SetShadowed( true );
+        indexBuffer_ = new IndexBuffer( GetContext() );
+        indexBuffer_->SetShadowed( true );
+    }
+
+    // vertices of the last paint are in the wrong format, repaint
+    root_.Invalidate();
+}
+
 //=============================================================================
 //=============================================================================
 void UTBRendererBatcher::LoadDefaultResources()
 {
     g_tb_lng->Load("resources/language/lng_en.tb.txt");
 
+    // Load the skin bitmaps from the baked atlas if it's up to date with the skin files.
+    // Otherwise they're loaded and packed one by one, and the atlas is baked for the next run.
+    g_tb_skin->SetAtlasFile( "demo01/skin/skin.atlas" );
+
     // Load the default skin, and override skin that contains the graphics specific to the demo.
     g_tb_skin->Load("resources/default_skin/skin.tb.txt", "demo01/skin/skin.tb.txt");
 
+    if ( !g_tb_skin->IsLoadedFromAtlas() )
+    {
+        g_tb_skin->BakeAtlas( "demo01/skin/skin.atlas" );
+    }
+
     // **README**
     // - define TB_FONT_RENDERER_FREETYPE in tb_config.h for non-demo
 #ifdef TB_FONT_RENDERER_TBBF
@@ -248,7 +361,7 @@ void UTBRendererBatcher::CreateKeyMap()
 //=============================================================================
 TBBitmap* UTBRendererBatcher::CreateBitmap(int width, int height, uint32 *data)
 {
-    UTBBitmap *pUTBBitmap = new UTBBitmap( GetContext(), width, height );
+    UTBBitmap *pUTBBitmap = new UTBBitmap( GetContext(), width, height, Graphics::GetRGBAFormat() );
 
     FlushBitmap( (TBBitmap*)pUTBBitmap );
 
@@ -257,38 +370,71 @@ TBBitmap* UTBRendererBatcher::CreateBitmap(int width, int height, uint32 *data)
     return (TBBitmap*)pUTBBitmap;
 }
 
+//=============================================================================
+//=============================================================================
+TBBitmap* UTBRendererBatcher::CreateBitmapA8(int width, int height, uint8 *data)
+{
+    UTBBitmap *pUTBBitmap = new UTBBitmap( GetContext(), width, height, Graphics::GetAlphaFormat() );
+
+    FlushBitmap( (TBBitmap*)pUTBBitmap );
+
+    pUTBBitmap->texture_->SetData( 0, 0, 0, width, height, data );
+    TB_PROFILER_COUNT( BYTES_UPLOADED, width * height );
+
+    return (TBBitmap*)pUTBBitmap;
+}
+
 //=============================================================================
 //=============================================================================
 void UTBRendererBatcher::RenderBatch(Batch *_pb)
 {
     if ( _pb )
     {
+        // the vertices are already in vertexData_, see AddQuadInternal()
+        PODVector<IntVector2> &ranges = openBatchRanges_[ _pb - m_batches ];
+
+        if ( ranges.Empty() )
+        {
+            return;
+        }
+
         UTBBitmap *pUTBBitmap = (UTBBitmap*)_pb->bitmap;
         SharedPtr<Texture2D> tdummy;
         SharedPtr<Texture2D> texture = pUTBBitmap?pUTBBitmap->texture_: tdummy;
-        IntRect scissor( _pb->clipRect.x, _pb->clipRect.y, _pb->clipRect.x + _pb->clipRect.w, _pb->clipRect.y + _pb->clipRect.h );
+        IntRect scissor( _pb->clip_rect.x, _pb->clip_rect.y, _pb->clip_rect.x + _pb->clip_rect.w, _pb->clip_rect.y + _pb->clip_rect.h );
         UIBatch batch( this, BLEND_ALPHA, scissor, texture, &vertexData_ );
 
-        unsigned begin = batch.vertexData_->Size();
-        batch.vertexData_->Resize(begin + _pb->vertex_count * UI_VERTEX_SIZE);
-        float* dest = &(batch.vertexData_->At(begin));
+        // **note** vertexStart_/vertexEnd_ of the stored batches index the vertex ranges in batchRanges_,
+        // the vertices are gathered into the UI vertex data in GetBatches()
+        batch.vertexStart_ = batchRanges_.Size();
 
-        // set start/end
-        batch.vertexStart_ = begin;
-        batch.vertexEnd_   = batch.vertexData_->Size();
-
-        for ( int i = 0; i < _pb->vertex_count; ++i )
+        for ( unsigned i = 0; i < ranges.Size(); ++i )
         {
-            dest[0+i*UI_VERTEX_SIZE]              = _pb->vertex[i].x; 
-            dest[1+i*UI_VERTEX_SIZE]              = _pb->vertex[i].y; 
-            dest[2+i*UI_VERTEX_SIZE]              = 0.0f;
-            ((unsigned&)dest[3+i*UI_VERTEX_SIZE]) = _pb->vertex[i].col;
-            dest[4+i*UI_VERTEX_SIZE]              = _pb->vertex[i].u; 
-            dest[5+i*UI_VERTEX_SIZE]              = _pb->vertex[i].v;
+            // merge in place with the last range if contiguous
+            if ( batchRanges_.Size() > batch.vertexStart_ && batchRanges_.Back().y_ == ranges[ i ].x_ )
+            {
+                batchRanges_.Back().y_ = ranges[ i ].y_;
+            }
+            else
+            {
+                batchRanges_.Push( ranges[ i ] );
+            }
         }
+        batch.vertexEnd_ = batchRanges_.Size();
+        ranges.Clear();
 
-        // store
-        UIBatch::AddOrMerge( batch, batches_ );
+        // store, merge with the last batch if it has the same state
+        if ( batches_.Size() )
+        {
+            UIBatch &last = batches_.Back();
+
+            if ( last.texture_ == batch.texture_ && last.scissor_ == batch.scissor_ && last.vertexEnd_ == batch.vertexStart_ )
+            {
+                last.vertexEnd_ = batch.vertexEnd_;
+                return;
+            }
+        }
+        batches_.Push( batch );
     }
 }
 
@@ -296,32 +442,57 @@ void UTBRendererBatcher::RenderBatch(Batch *_pb)
 //=============================================================================
 void UTBRendererBatcher::GetBatches(PODVector<UIBatch>& batches, PODVector<float>& vertexData, const IntRect& currentScissor)
 {
+    // drawn in HandleEndRendering(), on top of all UI batches
+    if ( indexedMode_ )
+    {
+        return;
+    }
+
     for ( unsigned i = 0; i < batches_.Size(); ++i )
     {
         // get batch
-        UIBatch &batch     = batches_[ i ];
-        unsigned beg       = batch.vertexStart_;
-        unsigned end       = batch.vertexEnd_;
-        batch.vertexStart_ = vertexData.Size();
-        batch.vertexEnd_   = vertexData.Size() + (end - beg);
+        UIBatch batch  = batches_[ i ];
+        unsigned size  = 0;
+
+        for ( unsigned r = batch.vertexStart_; r < batch.vertexEnd_; ++r )
+        {
+            size += batchRanges_[ r ].y_ - batchRanges_[ r ].x_;
+        }
+
+        // resize and gather the vertex ranges of the batch. Urho's GetBatches() API passes the vertex data
+        // to fill every frame, while TB only paints when something changed, so the vertices must be copied here
+        unsigned begin = vertexData.Size();
+        vertexData.Resize( begin + size );
+        float *dest = &vertexData[ begin ];
+
+        for ( unsigned r = batch.vertexStart_; r < batch.vertexEnd_; ++r )
+        {
+            const IntVector2 &range = batchRanges_[ r ];
+            memcpy( dest, &vertexData_[ range.x_ ], (range.y_ - range.x_) * sizeof(float) );
+            dest += range.y_ - range.x_;
+        }
 
-        // resize and copy
-        vertexData.Resize( batch.vertexEnd_ );
-        memcpy( &vertexData[ batch.vertexStart_ ], &vertexData_[ beg ], (end - beg) * sizeof(float) );
+        batch.vertexData_  = &vertexData;
+        batch.vertexStart_ = begin;
+        batch.vertexEnd_   = vertexData.Size();
 
         // store
         UIBatch::AddOrMerge( batch, batches );
     }
 
-    // clear buffers
-    vertexData_.Clear();
-    batches_.Clear();
+    // **note** buffers are not cleared here, they're kept until the next paint for the retained mode
 }
 
 //=============================================================================
 //=============================================================================
 void UTBRendererBatcher::BeginPaint(int render_target_w, int render_target_h)
 {
+    // clear buffers from the last paint
+    vertexData_.Clear();
+    batches_.Clear();
+    batchRanges_.Clear();
+    indexedBuffersDirty_ = true;
+
     TBRendererBatcher::BeginPaint( render_target_w, render_target_h );
 }
 
@@ -339,17 +510,9 @@ void UTBRendererBatcher::EndPaint()
 void UTBRendererBatcher::AddQuadInternal(const TBRect &dst_rect, const TBRect &src_rect, uint32 color, 
                                          TBBitmap *bitmap, TBBitmapFragment *fragment)
 {
-    if (batch.bitmap != bitmap)
-    {
-        batch.Flush(this);
-        batch.bitmap = bitmap;
-    }
-    batch.fragment = fragment;
-
-    // save clip rect
-    // **note** the clipRect member var, as declared below, was added to the Batch class in tb_renderer_batcher.h
-    // TBRect clipRect; 
-    batch.clipRect = m_clip_rect;
+    // get a batch with the same bitmap and clip rect that the quad can be added to
+    Batch *batch = GetBatch( bitmap, dst_rect, 6 );
+    batch->fragment = fragment;
 
     if ( bitmap )
     {
@@ -368,43 +531,53 @@ void UTBRendererBatcher::AddQuadInternal(const TBRect &dst_rect, const TBRect &s
         m_vv = (float)(src_rect.y + uvOffset + src_rect.h) / bitmap_h;
     }
 
+    // write the vertices directly to vertexData_ in the UI vertex format, no need to use batch->Reserve()
+    unsigned numVertices = indexedMode_ ? 4 : 6;
+    unsigned begin = vertexData_.Size();
+    vertexData_.Resize( begin + numVertices * UI_VERTEX_SIZE );
+    float *dest = &vertexData_[ begin ];
+    batch->vertex_count += numVertices;
+
     // change triangle winding order to clock-wise
-    Vertex *ver = batch.Reserve(this, 6);
-    ver[0].x = (float) dst_rect.x;
-    ver[0].y = (float) (dst_rect.y + dst_rect.h);
-    ver[0].u = m_u;
-    ver[0].v = m_vv;
-    ver[0].col = color;
-    ver[2].x = (float) (dst_rect.x + dst_rect.w);
-    ver[2].y = (float) (dst_rect.y + dst_rect.h);
-    ver[2].u = m_uu;
-    ver[2].v = m_vv;
-    ver[2].col = color;
-    ver[1].x = (float) dst_rect.x;
-    ver[1].y = (float) dst_rect.y;
-    ver[1].u = m_u;
-    ver[1].v = m_v;
-    ver[1].col = color;
-
-    ver[3].x = (float) dst_rect.x;
-    ver[3].y = (float) dst_rect.y;
-    ver[3].u = m_u;
-    ver[3].v = m_v;
-    ver[3].col = color;
-    ver[5].x = (float) (dst_rect.x + dst_rect.w);
-    ver[5].y = (float) (dst_rect.y + dst_rect.h);
-    ver[5].u = m_uu;
-    ver[5].v = m_vv;
-    ver[5].col = color;
-    ver[4].x = (float) (dst_rect.x + dst_rect.w);
-    ver[4].y = (float) dst_rect.y;
-    ver[4].u = m_uu;
-    ver[4].v = m_v;
-    ver[4].col = color;
+    float x  = (float) dst_rect.x;
+    float y  = (float) dst_rect.y;
+    float xx = (float) (dst_rect.x + dst_rect.w);
+    float yy = (float) (dst_rect.y + dst_rect.h);
+
+    if ( indexedMode_ )
+    {
+        // triangles (0, 1, 2) and (1, 3, 2), see EnsureQuadIndices()
+        SetUIVertex( dest + 0 * UI_VERTEX_SIZE, x,  yy, color, m_u,  m_vv );
+        SetUIVertex( dest + 1 * UI_VERTEX_SIZE, x,  y,  color, m_u,  m_v  );
+        SetUIVertex( dest + 2 * UI_VERTEX_SIZE, xx, yy, color, m_uu, m_vv );
+        SetUIVertex( dest + 3 * UI_VERTEX_SIZE, xx, y,  color, m_uu, m_v  );
+    }
+    else
+    {
+        SetUIVertex( dest + 0 * UI_VERTEX_SIZE, x,  yy, color, m_u,  m_vv );
+        SetUIVertex( dest + 1 * UI_VERTEX_SIZE, x,  y,  color, m_u,  m_v  );
+        SetUIVertex( dest + 2 * UI_VERTEX_SIZE, xx, yy, color, m_uu, m_vv );
+
+        SetUIVertex( dest + 3 * UI_VERTEX_SIZE, x,  y,  color, m_u,  m_v  );
+        SetUIVertex( dest + 4 * UI_VERTEX_SIZE, xx, y,  color, m_uu, m_v  );
+        SetUIVertex( dest + 5 * UI_VERTEX_SIZE, xx, yy, color, m_uu, m_vv );
+    }
+
+    // add to the vertex ranges of the batch, extend the last range if contiguous
+    PODVector<IntVector2> &ranges = openBatchRanges_[ batch - m_batches ];
+
+    if ( ranges.Size() && ranges.Back().y_ == (int)begin )
+    {
+        ranges.Back().y_ = vertexData_.Size();
+    }
+    else
+    {
+        ranges.Push( IntVector2( begin, vertexData_.Size() ) );
+    }
 
     // Update fragments batch id (See FlushBitmapFragment)
     if (fragment)
-        fragment->m_batch_id = batch.batch_id;
+        fragment->m_batch_id = batch->batch_id;
 }
 
 //=============================================================================
@@ -418,7 +591,7 @@ void UTBRendererBatcher::RegisterHandlers()
     SubscribeToEvent(E_SCREENMODE, HANDLER(UTBRendererBatcher, HandleScreenMode));
     SubscribeToEvent(E_BEGINFRAME, HANDLER(UTBRendererBatcher, HandleBeginFrame));
     SubscribeToEvent(E_POSTUPDATE, HANDLER(UTBRendererBatcher, HandlePostUpdate));
-    SubscribeToEvent(E_POSTRENDERUPDATE, HANDLER(UTBRendererBatcher, HandlePostRenderUpdate));
+    SubscribeToEvent(E_ENDRENDERING, HANDLER(UTBRendererBatcher, HandleEndRendering));
 
     // inputs
     SubscribeToEvent(E_MOUSEBUTTONDOWN, HANDLER(UTBRendererBatcher, HandleMouseButtonDown));
@@ -439,6 +612,7 @@ void UTBRendererBatcher::HandleUpdate(StringHash eventType, VariantMap& eventDat
 
     if ( t != TB_NOT_SOON && t <= TBSystem::GetTimeMS() )
     {
+        TBProfilerPhase phase( TB_PROFILER_PHASE_MESSAGES );
         TBMessageHandler::ProcessMessages();
     }
 }
@@ -456,18 +630,45 @@ void UTBRendererBatcher::HandleScreenMode(StringHash eventType, VariantMap& even
 //=============================================================================
 void UTBRendererBatcher::HandleBeginFrame(StringHash eventType, VariantMap& eventData)
 {
+    // frame phases are measured until the next E_BEGINFRAME, see TBProfiler
+    g_tb_profiler.BeginFrame();
+
+    g_tb_profiler.BeginPhase( TB_PROFILER_PHASE_ANIMATIONS );
     TBAnimationManager::Update();
+    g_tb_profiler.EndPhase( TB_PROFILER_PHASE_ANIMATIONS );
+
+    g_tb_profiler.BeginPhase( TB_PROFILER_PHASE_PROCESS_STATES );
     root_.InvokeProcessStates();
+    g_tb_profiler.EndPhase( TB_PROFILER_PHASE_PROCESS_STATES );
+
+    g_tb_profiler.BeginPhase( TB_PROFILER_PHASE_PROCESS );
     root_.InvokeProcess();
+    g_tb_profiler.EndPhase( TB_PROFILER_PHASE_PROCESS );
 }
 
 //=============================================================================
 //=============================================================================
 void UTBRendererBatcher::HandlePostUpdate(StringHash eventType, VariantMap& eventData)
 {
+    // nothing has changed since the last paint, reuse its batches
+    if ( retainedMode_ && !root_.IsInvalid() )
+    {
+        return;
+    }
+
+    // clear before painting, so anything invalidated during paint gets painted in the next frame
+    root_.ClearInvalid();
+
+    g_tb_profiler.BeginPhase( TB_PROFILER_PHASE_PAINT );
     BeginPaint( root_.GetRect().w, root_.GetRect().h );
 
     root_.InvokePaint( TBWidget::PaintProps() );
+    g_tb_profiler.EndPhase( TB_PROFILER_PHASE_PAINT );
+
+    // flush all open batches now, UI collects them in GetBatches() on E_RENDERUPDATE
+    g_tb_profiler.BeginPhase( TB_PROFILER_PHASE_END_PAINT );
+    EndPaint();
+    g_tb_profiler.EndPhase( TB_PROFILER_PHASE_END_PAINT );
 
     // If animations are running, reinvalidate immediately
     if ( TBAnimationManager::HasAnimationsRunning() )
@@ -478,9 +679,176 @@ void UTBRendererBatcher::HandlePostUpdate(StringHash eventType, VariantMap& even
 
 //=============================================================================
 //=============================================================================
-void UTBRendererBatcher::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData)
+void UTBRendererBatcher::HandleEndRendering(StringHash eventType, VariantMap& eventData)
 {
-    EndPaint();
+    // UI::Render() can only draw the non-indexed UI batches, so the indexed batches can't be
+    // drawn in hierarchy order with the other UI elements. this is after UI::Render(), just
+    // before the frame is presented, so they end up on top of all of them (see SetIndexedMode)
+    if ( !indexedMode_ || !IsVisible() )
+    {
+        return;
+    }
+
+    TBProfilerPhase phase( TB_PROFILER_PHASE_RENDER );
+    Graphics *graphics = GetSubsystem<Graphics>();
+
+    // upload only after a paint, in retained mode the buffers are reused
+    if ( indexedBuffersDirty_ )
+    {
+        UpdateIndexedBuffers();
+        indexedBuffersDirty_ = false;
+    }
+
+    if ( indexedBatches_.Empty() )
+    {
+        return;
+    }
+
+    // same states and shaders as UI::Render()
+    Vector2 invScreenSize( 1.0f / (float)graphics->GetWidth(), 1.0f / (float)graphics->GetHeight() );
+    Vector2 scale( 2.0f * invScreenSize.x_, -2.0f * invScreenSize.y_ );
+    Vector2 offset( -1.0f, 1.0f );
+
+    Matrix4 projection( Matrix4::IDENTITY );
+    projection.m00_ = scale.x_;
+    projection.m03_ = offset.x_;
+    projection.m11_ = scale.y_;
+    projection.m13_ = offset.y_;
+    projection.m22_ = 1.0f;
+    projection.m23_ = 0.0f;
+    projection.m33_ = 1.0f;
+
+    graphics->ClearParameterSources();
+    graphics->SetColorWrite( true );
+    graphics->SetCullMode( CULL_CCW );
+    graphics->SetDepthTest( CMP_ALWAYS );
+    graphics->SetDepthWrite( false );
+    graphics->SetFillMode( FILL_SOLID );
+    graphics->SetStencilTest( false );
+    graphics->ResetRenderTargets();
+    graphics->SetVertexBuffer( vertexBuffer_ );
+    graphics->SetIndexBuffer( indexBuffer_ );
+
+    ShaderVariation *noTextureVS   = graphics->GetShader( VS, "Basic", "VERTEXCOLOR" );
+    ShaderVariation *diffTextureVS = graphics->GetShader( VS, "Basic", "DIFFMAP VERTEXCOLOR" );
+    ShaderVariation *noTexturePS   = graphics->GetShader( PS, "Basic", "VERTEXCOLOR" );
+    ShaderVariation *diffTexturePS = graphics->GetShader( PS, "Basic", "DIFFMAP VERTEXCOLOR" );
+    ShaderVariation *alphaTexturePS = graphics->GetShader( PS, "Basic", "ALPHAMAP VERTEXCOLOR" );
+    unsigned alphaFormat = Graphics::GetAlphaFormat();
+
+    for ( unsigned i = 0; i < indexedBatches_.Size(); ++i )
+    {
+        const UIBatch &batch = indexedBatches_[ i ];
+
+        // vertexStart_/vertexEnd_ are in vertices here, 4 per quad
+        unsigned firstQuad = batch.vertexStart_ / 4;
+        unsigned numQuads  = (batch.vertexEnd_ - batch.vertexStart_) / 4;
+
+        if ( batch.texture_ )
+        {
+            // A8 glyph atlas, same as UI::Render() does for alpha textures
+            if ( batch.texture_->GetFormat() == alphaFormat )
+                graphics->SetShaders( diffTextureVS, alphaTexturePS );
+            else
+                graphics->SetShaders( diffTextureVS, diffTexturePS );
+        }
+        else
+        {
+            graphics->SetShaders( noTextureVS, noTexturePS );
+        }
+
+        if ( graphics->NeedParameterUpdate( SP_OBJECTTRANSFORM, this ) )
+            graphics->SetShaderParameter( VSP_MODEL, Matrix3x4::IDENTITY );
+        if ( graphics->NeedParameterUpdate( SP_CAMERA, this ) )
+            graphics->SetShaderParameter( VSP_VIEWPROJ, projection );
+        if ( graphics->NeedParameterUpdate( SP_MATERIAL, this ) )
+            graphics->SetShaderParameter( PSP_MATDIFFCOLOR, Color( 1.0f, 1.0f, 1.0f, 1.0f ) );
+
+        graphics->SetBlendMode( batch.blendMode_ );
+        graphics->SetScissorTest( true, batch.scissor_ );
+        graphics->SetTexture( 0, batch.texture_ );
+        graphics->Draw( TRIANGLE_LIST, firstQuad * 6, numQuads * 6, firstQuad * 4, numQuads * 4 );
+    }
+
+    graphics->SetScissorTest( false );
+}
+
+//=============================================================================
+//=============================================================================
+void UTBRendererBatcher::UpdateIndexedBuffers()
+{
+    indexedBatches_.Clear();
+
+    unsigned numVertices = vertexData_.Size() / UI_VERTEX_SIZE;
+
+    if ( numVertices == 0 )
+    {
+        return;
+    }
+
+    if ( vertexBuffer_->GetVertexCount() < numVertices )
+    {
+        vertexBuffer_->SetSize( numVertices, MASK_POSITION | MASK_COLOR | MASK_TEXCOORD1, true );
+    }
+
+    EnsureQuadIndices( numVertices / 4 );
+
+    // gather the vertex ranges of each batch into the vertex buffer, only done when TB has painted
+    float *dest = (float*)vertexBuffer_->Lock( 0, numVertices, true );
+
+    if ( dest == NULL )
+    {
+        return;
+    }
+
+    unsigned vertexStart = 0;
+
+    for ( unsigned i = 0; i < batches_.Size(); ++i )
+    {
+        UIBatch batch = batches_[ i ];
+        unsigned begin = vertexStart;
+
+        for ( unsigned r = batch.vertexStart_; r < batch.vertexEnd_; ++r )
+        {
+            const IntVector2 &range = batchRanges_[ r ];
+            memcpy( dest, &vertexData_[ range.x_ ], (range.y_ - range.x_) * sizeof(float) );
+            dest += range.y_ - range.x_;
+            vertexStart += (range.y_ - range.x_) / UI_VERTEX_SIZE;
+        }
+
+        batch.vertexStart_ = begin;
+        batch.vertexEnd_   = vertexStart;
+        indexedBatches_.Push( batch );
+    }
+
+    vertexBuffer_->Unlock();
+}
+
+//=============================================================================
+//=============================================================================
+void UTBRendererBatcher::EnsureQuadIndices(unsigned _unumQuads)
+{
+    if ( indexBuffer_->GetIndexCount() >= _unumQuads * 6 )
+    {
+        return;
+    }
+
+    // static quad pattern, triangles (0, 1, 2) and (1, 3, 2), see AddQuadInternal()
+    unsigned numQuads = NextPowerOfTwo( _unumQuads );
+    PODVector<unsigned> indices( numQuads * 6 );
+
+    for ( unsigned i = 0; i < numQuads; ++i )
+    {
+        indices[ i * 6 + 0 ] = i * 4 + 0;
+        indices[ i * 6 + 1 ] = i * 4 + 1;
+        indices[ i * 6 + 2 ] = i * 4 + 2;
+        indices[ i * 6 + 3 ] = i * 4 + 1;
+        indices[ i * 6 + 4 ] = i * 4 + 3;
+        indices[ i * 6 + 5 ] = i * 4 + 2;
+    }
+
+    indexBuffer_->SetSize( indices.Size(), true );
+    indexBuffer_->SetData( &indices[ 0 ] );
 }
 
 //=============================================================================
@@ -623,11 +991,12 @@ public:
         }
     }
 
-    bool OpenFile(const char* fileName)
+    bool OpenFile(const char* fileName, TBFileMode mode)
     {
-        bool bopen = pfile_->Open( fileName );
+        // written files are created or truncated, f.ex the baked skin atlas
+        bool bopen = pfile_->Open( fileName, mode == MODE_WRITE ? FILE_WRITE : FILE_READ );
 
-        if ( bopen )
+        if ( bopen && mode == MODE_READ )
         {
             ufileSize_ = pfile_->Seek( (unsigned)-1 );
             pfile_->Seek( 0 );
@@ -646,6 +1015,23 @@ public:
         return pfile_->Read( buf, elemSize * count );
     }
 
+    virtual size_t Write(const void *buf, size_t elemSize, size_t count)
+    {
+        // returns the number of elements written, like fwrite
+        if ( elemSize == 0 )
+        {
+            return 0;
+        }
+
+        return pfile_->Write( buf, elemSize * count ) / elemSize;
+    }
+
+    virtual double GetModifiedTime()
+    {
+        // used by TBSkin to check if the baked atlas is up to date without reading the files
+        return (double)pfile_->GetSubsystem<FileSystem>()->GetLastModifiedTime( pfile_->GetName() );
+    }
+
 protected:
     SharedPtr<File> pfile_;
     unsigned ufileSize_;
@@ -654,12 +1040,12 @@ protected:
 //=============================================================================
 // static
 //=============================================================================
-TBFile* TBFile::Open(const char *filename, TBFileMode )
+TBFile* TBFile::Open(const char *filename, TBFileMode mode)
 {
     UTBFile *pFile = new UTBFile( UTBRendererBatcher::Singleton().GetContext() );
     String strFilename = UTBRendererBatcher::Singleton().GetDataPath() + String( filename );
 
-    if ( !pFile->OpenFile( strFilename.CString() ) )
+    if ( !pFile->OpenFile( strFilename.CString(), mode ) )
     {
         delete pFile;
         pFile = NULL;
@@ -26,11 +26,13 @@
 #include <TurboBadger/tb_widgets.h>
 #include <TurboBadger/tb_renderer.h>
 #include <TurboBadger/renderers/tb_renderer_batcher.h>
+#include <TurboBadger/tb_profiler.h>
 
 namespace Urho3D
 {
 class Context;
 class VertexBuffer;
+class IndexBuffer;
 class Texture2D;
 }
 
@@ -44,15 +46,21 @@ using namespace tb;
 class UTBBitmap : public TBBitmap
 {
 public:
-    UTBBitmap(Context *_pContext, int _width, int _height); 
+    UTBBitmap(Context *_pContext, int _width, int _height, unsigned _format); 
     ~UTBBitmap();
 
     // =========== virtual methods required for TBBitmap subclass =========
 	virtual void SetData(uint32 *_pdata)
     {
         texture_->SetData( 0, 0, 0, width_, height_, _pdata );
+        TB_PROFILER_COUNT( BYTES_UPLOADED, width_ * height_ * sizeof(uint32) );
     }
 
+    virtual void SetDataRect(uint32 *_pdata, const TBRect &_rect);
+
+    // alpha only bitmaps, see UTBRendererBatcher::CreateBitmapA8
+    virtual void SetDataA8(uint8 *_pdata, const TBRect &_rect);
+
     virtual int Width() { return width_; }
     virtual int Height(){ return height_; }
 
@@ -60,6 +68,25 @@ public:
     SharedPtr<Texture2D>    texture_;
     int                     width_;
     int                     height_;
+    PODVector<uint32>       rectData_;
+    PODVector<uint8>        rectDataA8_;
+};
+
+//=============================================================================
+// root widget that tracks if anything in the widget tree has been invalidated
+//=============================================================================
+class UTBRootWidget : public TBWidget
+{
+public:
+    UTBRootWidget() : invalid_( true ) {}
+
+    virtual void OnInvalid() { invalid_ = true; }
+
+    bool IsInvalid() const  { return invalid_; }
+    void ClearInvalid()     { invalid_ = false; }
+
+protected:
+    bool    invalid_;
 };
 
 //=============================================================================
@@ -95,6 +122,20 @@ public:
     TBWidget& Root() { return root_; }
     const String& GetDataPath() { return strDataPath_; }
 
+    // retained mode: only repaint the widget tree when something in it has been invalidated,
+    // otherwise the batches from the last paint are reused
+    void SetRetainedMode(bool _bretained);
+    bool GetRetainedMode() const { return retainedMode_; }
+
+    // indexed mode: quads are written as 4 vertices and drawn with a shared quad index buffer
+    // in HandleEndRendering() instead of being added to the UI batches. off by default.
+    // note that this changes the draw order: E_ENDRENDERING is sent after UI::Render(), so
+    // the TB widgets are drawn on top of all other Urho3D UI elements (and the cursor),
+    // regardless of where this element is in the UI hierarchy. only enable it if nothing
+    // of the Urho3D UI needs to be drawn over the TB widgets.
+    void SetIndexedMode(bool _bindexed);
+    bool GetIndexedMode() const { return indexedMode_; }
+
     // override funcs
     virtual void BeginPaint(int render_target_w, int render_target_h);
     virtual void EndPaint();
@@ -105,11 +146,15 @@ public:
 	// ===== methods that need implementation in TBRendererBatcher subclasses =====
 	virtual TBBitmap* CreateBitmap(int width, int height, uint32 *data);
 
+    // glyphs without color are kept in an alpha texture, drawn with the ALPHAMAP shader variant
+    virtual bool SupportsBitmapA8() { return true; }
+    virtual TBBitmap* CreateBitmapA8(int width, int height, uint8 *data);
+
     virtual void RenderBatch(Batch *batch);
 
 	virtual void SetClipRect(const TBRect &rect)
     {
-        m_clip_rect = rect;
+        // nothing to do, the scissor is taken from Batch::clip_rect in RenderBatch()
     }
 
 protected:
@@ -130,7 +175,11 @@ protected:
     void HandleScreenMode(StringHash eventType, VariantMap& eventData);
     void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
     void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
-    void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
+    void HandleEndRendering(StringHash eventType, VariantMap& eventData);
+
+    // indexed mode
+    void UpdateIndexedBuffers();
+    void EnsureQuadIndices(unsigned _unumQuads);
 
     // inputs
     void HandleMouseButtonDown(StringHash eventType, VariantMap& eventData);
@@ -147,10 +196,23 @@ protected:
 protected:
     static UTBRendererBatcher   *pSingleton_;
 
-    TBWidget            root_;
+    UTBRootWidget       root_;
+    bool                retainedMode_;
     PODVector<float>    vertexData_;
     PODVector<UIBatch>  batches_;
 
+    // vertex ranges (in floats) in vertexData_ of the open TB batches, indexed by the batch position in m_batches
+    PODVector<IntVector2> openBatchRanges_[TB_RENDERER_BATCHER_MAX_BATCHES];
+    // vertex ranges of the flushed batches, batches_ vertexStart_/vertexEnd_ index this
+    PODVector<IntVector2> batchRanges_;
+
+    // indexed mode
+    bool                    indexedMode_;
+    bool                    indexedBuffersDirty_;
+    SharedPtr<VertexBuffer> vertexBuffer_;
+    SharedPtr<IndexBuffer>  indexBuffer_;
+    PODVector<UIBatch>      indexedBatches_;
+
     String              strDataPath_;
 
     HashMap<int, int>   uKeytoTBkeyMap;
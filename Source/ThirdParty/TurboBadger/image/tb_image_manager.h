@@ -94,6 +94,10 @@ public:
 	void Debug() { m_frag_manager.Debug(); }
 #endif
 
+	/** Get the fragment manager. Images have mixed sizes, so they may pack tighter
+		with TB_FRAGMENT_ALLOCATOR_MAXRECTS (See TBBitmapFragmentManager::SetAllocator). */
+	TBBitmapFragmentManager *GetFragmentManager() { return &m_frag_manager; }
+
 	// Implementing TBRendererListener
 	virtual void OnContextLost();
 	virtual void OnContextRestored();
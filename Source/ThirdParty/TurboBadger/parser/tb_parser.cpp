@@ -8,6 +8,7 @@
 #include "utf8/utf8.h"
 #include <assert.h>
 #include <ctype.h>
+#include <string.h>
 
 namespace tb {
 
@@ -162,16 +163,21 @@ bool IsEndQuote(const char *buf_start, const char *buf, const char quote_type)
 
 // == Parser ============================================================================
 
+void TBParser::Reset()
+{
+	current_indent = 0;
+	current_line_nr = 1;
+	pending_multiline = false;
+	multi_line_sub_level = 0;
+}
+
 TBParser::STATUS TBParser::Read(TBParserStream *stream, TBParserTarget *target)
 {
 	TBTempBuffer line, work;
 	if (!line.Reserve(1024) || !work.Reserve(1024))
 		return STATUS_OUT_OF_MEMORY;
 
-	current_indent = 0;
-	current_line_nr = 1;
-	pending_multiline = false;
-	multi_line_sub_level = 0;
+	Reset();
 
 	while (int read_len = stream->GetMoreData((char *)work.GetData(), work.GetCapacity()))
 	{
@@ -238,6 +244,47 @@ TBParser::STATUS TBParser::Read(TBParserStream *stream, TBParserTarget *target)
 	return STATUS_OK;
 }
 
+TBParser::STATUS TBParser::Read(char *data, int data_len, TBParserTarget *target)
+{
+	Reset();
+
+	// Skip BOM (BYTE ORDER MARK) character, often in the beginning of UTF-8 documents.
+	if (data_len >= 3 &&
+		(uint8)data[0] == 239 &&
+		(uint8)data[1] == 187 &&
+		(uint8)data[2] == 191)
+	{
+		data_len -= 3;
+		data += 3;
+	}
+
+	char *data_end = data + data_len;
+	while (data < data_end)
+	{
+		char *line_end = (char *) memchr(data, '\n', data_end - data);
+		if (!line_end)
+		{
+			// The last line has no line break, so there's no room to terminate it in place.
+			TBTempBuffer line;
+			if (!line.Append(data, data_end - data) || !line.Append("", 1))
+				return STATUS_OUT_OF_MEMORY;
+			OnLine(line.GetData(), target);
+			current_line_nr++;
+			break;
+		}
+
+		// Terminate the line where the line break is, and strip away trailing '\r' if the line has it.
+		*line_end = 0;
+		if (line_end > data && line_end[-1] == '\r')
+			line_end[-1] = 0;
+
+		OnLine(data, target);
+		current_line_nr++;
+		data = line_end + 1;
+	}
+	return STATUS_OK;
+}
+
 void TBParser::OnLine(char *line, TBParserTarget *target)
 {
 	if (is_space_or_comment(line))
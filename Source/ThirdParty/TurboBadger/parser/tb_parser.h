@@ -48,8 +48,16 @@ public:
 		STATUS_PARSE_ERROR
 	};
 	TBParser() {}
+
+	/** Read from the stream. Data is read in chunks and each line is copied before it's parsed. */
 	STATUS Read(TBParserStream *stream, TBParserTarget *target);
+
+	/** Read from a writable buffer, f.ex a file mapped with TBFile::Map. The buffer is
+		tokenized in place, so it will be modified. The strings passed to the target
+		point into the buffer, so they are valid as long as the buffer is. */
+	STATUS Read(char *data, int data_len, TBParserTarget *target);
 private:
+	void Reset();
 	int current_indent;
 	int current_line_nr;
 	TBStr multi_line_token;
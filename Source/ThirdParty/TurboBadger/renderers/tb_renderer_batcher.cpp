@@ -6,6 +6,7 @@
 #include "renderers/tb_renderer_batcher.h"
 #include "tb_bitmap_fragment.h"
 #include "tb_system.h"
+#include "tb_profiler.h"
 
 #ifdef TB_RENDERER_BATCHER
 
@@ -21,6 +22,11 @@ uint32 dbg_frame_triangle_count = 0;
 #define VER_COL(r, g, b, a) (((a)<<24) + ((b)<<16) + ((g)<<8) + r)
 #define VER_COL_OPACITY(a) (0x00ffffff + (((uint32)a) << 24))
 
+TBRendererBatcher::Batch::~Batch()
+{
+	delete [] vertex;
+}
+
 void TBRendererBatcher::Batch::Flush(TBRendererBatcher *batch_renderer)
 {
 	if (!vertex_count || is_flushing)
@@ -39,7 +45,9 @@ void TBRendererBatcher::Batch::Flush(TBRendererBatcher *batch_renderer)
 		assert(frag_bitmap == bitmap);
 	}
 
+	batch_renderer->SetClipRect(clip_rect);
 	batch_renderer->RenderBatch(this);
+	TB_PROFILER_COUNT(BATCHES, 1);
 
 #ifdef TB_RUNTIME_DEBUG_INFO
 	if (TB_DEBUG_SETTING(RENDER_BATCHES))
@@ -50,19 +58,23 @@ void TBRendererBatcher::Batch::Flush(TBRendererBatcher *batch_renderer)
 
 		// Draw the triangles again using a random color based on the batch
 		// id. This indicates which triangles belong to the same batch.
-		uint32 id = batch_id - dbg_begin_paint_batch_id;
-		uint32 hash = id * (2166136261U ^ id);
-		uint32 color = 0xAA000000 + (hash & 0x00FFFFFF);
-		for (int i = 0; i < vertex_count; i++)
-			vertex[i].col = color;
-		bitmap = nullptr;
-		batch_renderer->RenderBatch(this);
+		// Only possible if the vertices are stored in the batch (See Reserve).
+		if (vertex)
+		{
+			uint32 id = batch_id - dbg_begin_paint_batch_id;
+			uint32 hash = id * (2166136261U ^ id);
+			uint32 color = 0xAA000000 + (hash & 0x00FFFFFF);
+			for (int i = 0; i < vertex_count; i++)
+				vertex[i].col = color;
+			bitmap = nullptr;
+			batch_renderer->RenderBatch(this);
+		}
 	}
 #endif // TB_RUNTIME_DEBUG_INFO
 
 	vertex_count = 0;
-
-	batch_id++; // Will overflow eventually, but that doesn't really matter.
+	bitmap = nullptr;
+	fragment = nullptr;
 
 	is_flushing = false;
 }
@@ -70,8 +82,20 @@ void TBRendererBatcher::Batch::Flush(TBRendererBatcher *batch_renderer)
 TBRendererBatcher::Vertex *TBRendererBatcher::Batch::Reserve(TBRendererBatcher *batch_renderer, int count)
 {
 	assert(count < VERTEX_BATCH_SIZE);
-	if (vertex_count + count > VERTEX_BATCH_SIZE)
-		Flush(batch_renderer);
+	assert(HasSpace(count)); // Batches should be fetched with TBRendererBatcher::GetBatch.
+	if (vertex_count + count > vertex_capacity)
+	{
+		// Grow the vertex buffer. Most batches are small, so don't allocate
+		// the max size for all of them up front.
+		int new_capacity = MAX(vertex_capacity * 2, 6 * 64);
+		new_capacity = MIN(new_capacity, VERTEX_BATCH_SIZE);
+		Vertex *new_vertex = new Vertex[new_capacity];
+		if (vertex_count)
+			memcpy(new_vertex, vertex, sizeof(Vertex) * vertex_count);
+		delete [] vertex;
+		vertex = new_vertex;
+		vertex_capacity = new_capacity;
+	}
 	Vertex *ret = &vertex[vertex_count];
 	vertex_count += count;
 	return ret;
@@ -82,6 +106,7 @@ TBRendererBatcher::Vertex *TBRendererBatcher::Batch::Reserve(TBRendererBatcher *
 TBRendererBatcher::TBRendererBatcher()
 	: m_opacity(255), m_translation_x(0), m_translation_y(0)
 	, m_u(0), m_v(0), m_uu(0), m_vv(0)
+	, m_num_open_batches(0), m_batch_id(0)
 {
 }
 
@@ -92,12 +117,13 @@ TBRendererBatcher::~TBRendererBatcher()
 void TBRendererBatcher::BeginPaint(int render_target_w, int render_target_h)
 {
 #ifdef TB_RUNTIME_DEBUG_INFO
-	dbg_begin_paint_batch_id = batch.batch_id;
+	dbg_begin_paint_batch_id = m_batch_id;
 	dbg_frame_triangle_count = 0;
 #endif // TB_RUNTIME_DEBUG_INFO
 
 	m_screen_rect.Set(0, 0, render_target_w, render_target_h);
 	m_clip_rect = m_screen_rect;
+	m_paint_count++;
 }
 
 void TBRendererBatcher::EndPaint()
@@ -107,7 +133,7 @@ void TBRendererBatcher::EndPaint()
 #ifdef TB_RUNTIME_DEBUG_INFO
 	if (TB_DEBUG_SETTING(RENDER_BATCHES))
 		TBDebugPrint("Frame rendered using %d batches and a total of %d triangles.\n",
-						batch.batch_id - dbg_begin_paint_batch_id,
+						m_batch_id - dbg_begin_paint_batch_id,
 						dbg_frame_triangle_count);
 #endif // TB_RUNTIME_DEBUG_INFO
 }
@@ -141,8 +167,8 @@ TBRect TBRendererBatcher::SetClipRect(const TBRect &rect, bool add_to_current)
 	if (add_to_current)
 		m_clip_rect = m_clip_rect.Clip(old_clip_rect);
 
-	FlushAllInternal();
-	SetClipRect(m_clip_rect);
+	// No need to flush here. The clip rect is part of the batch, and is
+	// set by Batch::Flush before it's rendered.
 
 	old_clip_rect.x -= m_translation_x;
 	old_clip_rect.y -= m_translation_y;
@@ -218,14 +244,98 @@ void TBRendererBatcher::DrawRectFill(const TBRect &dst_rect, const TBColor &colo
 					TBRect(), VER_COL(color.r, color.g, color.b, a), nullptr, nullptr);
 }
 
-void TBRendererBatcher::AddQuadInternal(const TBRect &dst_rect, const TBRect &src_rect, uint32 color, TBBitmap *bitmap, TBBitmapFragment *fragment)
+/** Return the rect with positive width and height (the dst_rect of a quad may be flipped). */
+static TBRect GetNormalizedRect(const TBRect &rect)
 {
-	if (batch.bitmap != bitmap)
+	TBRect tmp = rect;
+	if (tmp.w < 0)
 	{
-		batch.Flush(this);
-		batch.bitmap = bitmap;
+		tmp.x += tmp.w;
+		tmp.w = -tmp.w;
 	}
-	batch.fragment = fragment;
+	if (tmp.h < 0)
+	{
+		tmp.y += tmp.h;
+		tmp.h = -tmp.h;
+	}
+	return tmp;
+}
+
+TBRendererBatcher::Batch *TBRendererBatcher::GetBatch(TBBitmap *bitmap, const TBRect &dst_rect, int vertex_count)
+{
+	// Called once for each quad, also by backends overriding AddQuadInternal.
+	TB_PROFILER_COUNT(QUADS, 1);
+
+	TBRect rect = GetNormalizedRect(dst_rect).Clip(m_clip_rect);
+
+	// Search for a batch with the same bitmap and clip rect, starting with the most
+	// recent one. We can't move the quad to a batch before any batch it overlaps,
+	// since that would change the order it's painted in.
+	for (int i = m_num_open_batches - 1; i >= 0; i--)
+	{
+		Batch *batch = m_open_batches[i];
+		if (batch->bitmap == bitmap && batch->clip_rect.Equals(m_clip_rect))
+		{
+			if (!batch->HasSpace(vertex_count))
+			{
+				FlushUntilInternal(batch);
+				break;
+			}
+			batch->bounds = batch->bounds.Union(rect);
+			return batch;
+		}
+		if (batch->bounds.Intersects(rect))
+			break;
+	}
+
+	// Open a new batch. If all are in use, flush the oldest one.
+	if (m_num_open_batches == TB_RENDERER_BATCHER_MAX_BATCHES)
+		FlushUntilInternal(m_open_batches[0]);
+	assert(m_num_open_batches < TB_RENDERER_BATCHER_MAX_BATCHES);
+
+	Batch *batch = nullptr;
+	for (int i = 0; i < TB_RENDERER_BATCHER_MAX_BATCHES; i++)
+		if (!m_batches[i].vertex_count)
+		{
+			batch = &m_batches[i];
+			break;
+		}
+	assert(batch);
+	batch->bitmap = bitmap;
+	batch->fragment = nullptr;
+	batch->clip_rect = m_clip_rect;
+	batch->bounds = rect;
+	batch->batch_id = m_batch_id++; // Will overflow eventually, but that doesn't really matter.
+	m_open_batches[m_num_open_batches++] = batch;
+	return batch;
+}
+
+void TBRendererBatcher::FlushUntilInternal(Batch *batch)
+{
+	int count = 0;
+	while (count < m_num_open_batches && m_open_batches[count] != batch)
+		count++;
+	if (count == m_num_open_batches)
+		return;
+	count++;
+
+	// Prevent re-entrancy. Flushing may validate a fragment bitmap, which
+	// calls FlushBitmap on it. The batches will be rendered in order anyway.
+	for (int i = 0; i < count; i++)
+		if (m_open_batches[i]->is_flushing)
+			return;
+
+	for (int i = 0; i < count; i++)
+		m_open_batches[i]->Flush(this);
+
+	m_num_open_batches -= count;
+	memmove(m_open_batches, m_open_batches + count, sizeof(Batch *) * m_num_open_batches);
+}
+
+void TBRendererBatcher::AddQuadInternal(const TBRect &dst_rect, const TBRect &src_rect, uint32 color, TBBitmap *bitmap, TBBitmapFragment *fragment)
+{
+	Batch *batch = GetBatch(bitmap, dst_rect, 6);
+	batch->fragment = fragment;
 	if (bitmap)
 	{
 		int bitmap_w = bitmap->Width();
@@ -235,7 +345,7 @@ void TBRendererBatcher::AddQuadInternal(const TBRect &dst_rect, const TBRect &sr
 		m_uu = (float)(src_rect.x + src_rect.w) / bitmap_w;
 		m_vv = (float)(src_rect.y + src_rect.h) / bitmap_h;
 	}
-	Vertex *ver = batch.Reserve(this, 6);
+	Vertex *ver = batch->Reserve(this, 6);
 	ver[0].x = (float) dst_rect.x;
 	ver[0].y = (float) (dst_rect.y + dst_rect.h);
 	ver[0].u = m_u;
@@ -270,30 +380,38 @@ void TBRendererBatcher::AddQuadInternal(const TBRect &dst_rect, const TBRect &sr
 
 	// Update fragments batch id (See FlushBitmapFragment)
 	if (fragment)
-		fragment->m_batch_id = batch.batch_id;
+		fragment->m_batch_id = batch->batch_id;
 }
 
 void TBRendererBatcher::FlushAllInternal()
 {
-	batch.Flush(this);
+	if (m_num_open_batches)
+		FlushUntilInternal(m_open_batches[m_num_open_batches - 1]);
 }
 
 void TBRendererBatcher::FlushBitmap(TBBitmap *bitmap)
 {
-	// Flush the batch if it's using this bitmap (that is about to change or be deleted)
-	if (batch.vertex_count && bitmap == batch.bitmap)
-		batch.Flush(this);
+	// Flush the batches using this bitmap (that is about to change or be deleted)
+	// and all batches opened before them.
+	for (int i = m_num_open_batches - 1; i >= 0; i--)
+		if (m_open_batches[i]->bitmap == bitmap)
+		{
+			FlushUntilInternal(m_open_batches[i]);
+			break;
+		}
 }
 
 void TBRendererBatcher::FlushBitmapFragment(TBBitmapFragment *bitmap_fragment)
 {
 	// Flush the batch if it is using this fragment (that is about to change or be deleted)
-	// We know if it is in use in the current batch if its batch_id matches the current
-	// batch_id in our (one and only) batch.
-	// If we switch to a more advance batching system with multiple batches, we need to
-	// solve this a bit differently.
-	if (batch.vertex_count && bitmap_fragment->m_batch_id == batch.batch_id)
-		batch.Flush(this);
+	// We know if it is in use in a batch if its batch_id matches the batch_id of any
+	// open batch. The fragment is only in the batch with the latest id it was added to.
+	for (int i = m_num_open_batches - 1; i >= 0; i--)
+		if (m_open_batches[i]->batch_id == bitmap_fragment->m_batch_id)
+		{
+			FlushUntilInternal(m_open_batches[i]);
+			break;
+		}
 }
 
 }; // namespace tb
@@ -14,6 +14,11 @@ namespace tb {
 
 #define VERTEX_BATCH_SIZE 6 * 2048
 
+/** The max number of batches that may be open at the same time. A quad may be added
+	to any open batch with the same bitmap and clip rect, as long as no batch opened
+	after it overlaps the quad. If all batches are open, the oldest is flushed. */
+#define TB_RENDERER_BATCHER_MAX_BATCHES 16
+
 /** TBRendererBatcher is a helper class that implements batching of draw operations for a TBRenderer.
 	If you do not want to do your own batching you can subclass this class instead of TBRenderer.
 	If overriding any function in this class, make sure to call the base class too. */
@@ -34,12 +39,22 @@ public:
 	class Batch
 	{
 	public:
-		Batch() : vertex_count(0), bitmap(nullptr), fragment(nullptr), batch_id(0), is_flushing(false) {}
+		Batch() : vertex(nullptr), vertex_count(0), vertex_capacity(0), bitmap(nullptr), fragment(nullptr), batch_id(0), is_flushing(false) {}
+		~Batch();
 		void Flush(TBRendererBatcher *batch_renderer);
+
+		/** Reserve count vertices in this batch and return a pointer to the first one.
+			Subclasses that write vertices in their own format directly to their own
+			buffers (overriding AddQuadInternal) don't have to use this, but should
+			increase vertex_count instead. The vertex array is then never allocated. */
 		Vertex *Reserve(TBRendererBatcher *batch_renderer, int count);
 
-		Vertex vertex[VERTEX_BATCH_SIZE];
+		/** Return true if count more vertices fit in this batch. */
+		bool HasSpace(int count) const { return vertex_count + count <= VERTEX_BATCH_SIZE; }
+
+		Vertex *vertex;
 		int vertex_count;
+		int vertex_capacity;
 
 		TBBitmap *bitmap;
 		TBBitmapFragment *fragment;
@@ -47,7 +62,8 @@ public:
 		uint32 batch_id;
 		bool is_flushing;
 
-        TBRect clipRect;
+		TBRect clip_rect;	///< The clip rect (in screen coordinates) of all quads in this batch.
+		TBRect bounds;		///< The union of all (clipped) quads in this batch.
 	};
 
 	TBRendererBatcher();
@@ -80,6 +96,8 @@ public:
 	// == Methods that need implementation in subclasses ================================
 	virtual TBBitmap *CreateBitmap(int width, int height, uint32 *data) = 0;
 	virtual void RenderBatch(Batch *batch) = 0;
+	/** Set the clip rect (in screen coordinates) for the following RenderBatch calls.
+		Called when a batch is flushed, with the clip rect of that batch. */
 	virtual void SetClipRect(const TBRect &rect) = 0;
 protected:
 	uint8 m_opacity;
@@ -89,7 +107,20 @@ protected:
 	int m_translation_y;
 
 	float m_u, m_v, m_uu, m_vv; ///< Some temp variables
-	Batch batch; ///< The one and only batch. this should be improved.
+
+	Batch m_batches[TB_RENDERER_BATCHER_MAX_BATCHES];
+	Batch *m_open_batches[TB_RENDERER_BATCHER_MAX_BATCHES]; ///< Batches with vertices, oldest first.
+	int m_num_open_batches;
+	uint32 m_batch_id; ///< The id that the next opened batch will get.
+
+	/** Get a batch that the quad dst_rect (in screen coordinates) using bitmap can be added
+		to with the current clip rect, without changing the paint order of overlapping quads.
+		It is guaranteed to have space for vertex_count more vertices.
+		The quad is not added, but the batch bounds are updated to include it. */
+	Batch *GetBatch(TBBitmap *bitmap, const TBRect &dst_rect, int vertex_count);
+
+	/** Flush all open batches up to and including the given batch, in the order they were opened. */
+	void FlushUntilInternal(Batch *batch);
 
 	virtual void AddQuadInternal(const TBRect &dst_rect, const TBRect &src_rect, uint32 color, TBBitmap *bitmap, TBBitmapFragment *fragment);
 	virtual void FlushAllInternal();
@@ -30,6 +30,7 @@ static void Ortho2D(GLfloat left, GLfloat right, GLfloat bottom, GLfloat top)
 
 GLuint g_current_texture = (GLuint)-1;
 TBRendererBatcher::Batch *g_current_batch = 0;
+TBRendererBatcher::Vertex *g_current_vertex = 0;
 
 void BindBitmap(TBBitmap *bitmap)
 {
@@ -58,7 +59,7 @@ TBBitmapGL::~TBBitmapGL()
 	glDeleteTextures(1, &m_texture);
 }
 
-bool TBBitmapGL::Init(int width, int height, uint32 *data)
+void TBBitmapGL::InitTexture(int width, int height)
 {
 	assert(width == TBGetNearestPowerOfTwo(width));
 	assert(height == TBGetNearestPowerOfTwo(height));
@@ -70,9 +71,21 @@ bool TBBitmapGL::Init(int width, int height, uint32 *data)
 	BindBitmap(this);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+}
 
+bool TBBitmapGL::Init(int width, int height, uint32 *data)
+{
+	InitTexture(width, height);
 	SetData(data);
+	return true;
+}
 
+bool TBBitmapGL::InitA8(int width, int height, uint8 *data)
+{
+	InitTexture(width, height);
+	// With GL_MODULATE, a GL_ALPHA texture keeps the vertex color and multiplies the alpha.
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, m_w, m_h, 0, GL_ALPHA, GL_UNSIGNED_BYTE, data);
+	TB_IF_DEBUG_SETTING(RENDER_BATCHES, dbg_bitmap_validations++);
 	return true;
 }
 
@@ -84,6 +97,35 @@ void TBBitmapGL::SetData(uint32 *data)
 	TB_IF_DEBUG_SETTING(RENDER_BATCHES, dbg_bitmap_validations++);
 }
 
+void TBBitmapGL::SetDataRect(uint32 *data, const TBRect &rect)
+{
+#ifdef TB_RENDERER_GLES_1
+	// GL ES 1 can't upload a part of the data with a different row length.
+	SetData(data);
+#else
+	m_renderer->FlushBitmap(this);
+	BindBitmap(this);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, m_w);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, GL_RGBA, GL_UNSIGNED_BYTE, data + rect.x + rect.y * m_w);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	TB_IF_DEBUG_SETTING(RENDER_BATCHES, dbg_bitmap_validations++);
+#endif
+}
+
+void TBBitmapGL::SetDataA8(uint8 *data, const TBRect &rect)
+{
+	m_renderer->FlushBitmap(this);
+	BindBitmap(this);
+#ifdef TB_RENDERER_GLES_1
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, m_w, m_h, 0, GL_ALPHA, GL_UNSIGNED_BYTE, data);
+#else
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, m_w);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, GL_ALPHA, GL_UNSIGNED_BYTE, data + rect.x + rect.y * m_w);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+#endif
+	TB_IF_DEBUG_SETTING(RENDER_BATCHES, dbg_bitmap_validations++);
+}
+
 // == TBRendererGL ================================================================================
 
 TBRendererGL::TBRendererGL()
@@ -100,6 +142,7 @@ void TBRendererGL::BeginPaint(int render_target_w, int render_target_h)
 
 	g_current_texture = (GLuint)-1;
 	g_current_batch = nullptr;
+	g_current_vertex = nullptr;
 
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
@@ -140,16 +183,28 @@ TBBitmap *TBRendererGL::CreateBitmap(int width, int height, uint32 *data)
 	return bitmap;
 }
 
+TBBitmap *TBRendererGL::CreateBitmapA8(int width, int height, uint8 *data)
+{
+	TBBitmapGL *bitmap = new TBBitmapGL(this);
+	if (!bitmap || !bitmap->InitA8(width, height, data))
+	{
+		delete bitmap;
+		return nullptr;
+	}
+	return bitmap;
+}
+
 void TBRendererGL::RenderBatch(Batch *batch)
 {
 	// Bind texture and array pointers
 	BindBitmap(batch->bitmap);
-	if (g_current_batch != batch)
+	if (g_current_batch != batch || g_current_vertex != batch->vertex)
 	{
 		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(Vertex), (void *) &batch->vertex[0].r);
 		glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), (void *) &batch->vertex[0].u);
 		glVertexPointer(2, GL_FLOAT, sizeof(Vertex), (void *) &batch->vertex[0].x);
 		g_current_batch = batch;
+		g_current_vertex = batch->vertex;
 	}
 
 	// Flush
@@ -158,7 +213,7 @@ void TBRendererGL::RenderBatch(Batch *batch)
 
 void TBRendererGL::SetClipRect(const TBRect &rect)
 {
-	glScissor(m_clip_rect.x, m_screen_rect.h - (m_clip_rect.y + m_clip_rect.h), m_clip_rect.w, m_clip_rect.h);
+	glScissor(rect.x, m_screen_rect.h - (rect.y + rect.h), rect.w, rect.h);
 }
 
 }; // namespace tb
@@ -32,9 +32,14 @@ public:
 	TBBitmapGL(TBRendererGL *renderer);
 	~TBBitmapGL();
 	bool Init(int width, int height, uint32 *data);
+	bool InitA8(int width, int height, uint8 *data);
 	virtual int Width() { return m_w; }
 	virtual int Height() { return m_h; }
 	virtual void SetData(uint32 *data);
+	virtual void SetDataRect(uint32 *data, const TBRect &rect);
+	virtual void SetDataA8(uint8 *data, const TBRect &rect);
+private:
+	void InitTexture(int width, int height);
 public:
 	TBRendererGL *m_renderer;
 	int m_w, m_h;
@@ -52,6 +57,8 @@ public:
 	virtual void EndPaint();
 
 	virtual TBBitmap *CreateBitmap(int width, int height, uint32 *data);
+	virtual bool SupportsBitmapA8() { return true; }
+	virtual TBBitmap *CreateBitmapA8(int width, int height, uint8 *data);
 
 	// == TBRendererBatcher ===============================================================
 
@@ -6,6 +6,7 @@
 #include "tb_bitmap_fragment.h"
 #include "tb_renderer.h"
 #include "tb_system.h"
+#include "tb_tempbuffer.h"
 
 namespace tb {
 
@@ -157,11 +158,142 @@ void TBSpaceAllocator::FreeSpace(Space *space)
 #endif // TB_RUNTIME_DEBUG_INFO
 }
 
+// == TBMaxRectsAllocator ===================================================================================
+
+TBMaxRectsAllocator::TBMaxRectsAllocator(int width, int height)
+	: m_width(width)
+	, m_height(height)
+	, m_used_area(0)
+{
+	m_free_rects.Set(TBRect(0, 0, width, height));
+}
+
+TBRect TBMaxRectsAllocator::AllocRect(int needed_w, int needed_h)
+{
+	assert(needed_w > 0 && needed_h > 0);
+
+	// Find the free rect that leaves the shortest side over ("best short side fit").
+	// This keeps the remaining free rects as large as possible.
+	int best_index = -1;
+	int best_short_side = 0;
+	int best_long_side = 0;
+	for (int i = 0; i < m_free_rects.GetNumRects(); i++)
+	{
+		const TBRect &fr = m_free_rects.GetRect(i);
+		if (needed_w > fr.w || needed_h > fr.h)
+			continue;
+		int leftover_w = fr.w - needed_w;
+		int leftover_h = fr.h - needed_h;
+		int short_side = MIN(leftover_w, leftover_h);
+		int long_side = MAX(leftover_w, leftover_h);
+		if (best_index == -1 || short_side < best_short_side ||
+			(short_side == best_short_side && long_side < best_long_side))
+		{
+			best_index = i;
+			best_short_side = short_side;
+			best_long_side = long_side;
+			if (!long_side)
+				break; // It can't be better than a perfect match!
+		}
+	}
+	if (best_index == -1)
+		return TBRect();
+
+	const TBRect &fr = m_free_rects.GetRect(best_index);
+	TBRect rect(fr.x, fr.y, needed_w, needed_h);
+	SplitFreeRects(rect);
+	m_used_area += needed_w * needed_h;
+	return rect;
+}
+
+void TBMaxRectsAllocator::AllocRectAt(const TBRect &rect)
+{
+	assert(!rect.IsEmpty() && rect.x >= 0 && rect.y >= 0 && rect.x + rect.w <= m_width && rect.y + rect.h <= m_height);
+	SplitFreeRects(rect);
+	m_used_area += rect.w * rect.h;
+}
+
+void TBMaxRectsAllocator::FreeRect(const TBRect &rect)
+{
+	m_used_area -= rect.w * rect.h;
+	assert(m_used_area >= 0);
+
+	// Start over from one free rect when everything is free, so
+	// fragmentation from earlier allocations doesn't remain.
+	if (m_used_area == 0)
+	{
+		m_free_rects.Set(TBRect(0, 0, m_width, m_height));
+		return;
+	}
+	// When coalesced with other free rects, the result is added last.
+	m_free_rects.AddRect(rect, true);
+	RemoveContainedFreeRects(m_free_rects.GetNumRects() - 1);
+}
+
+void TBMaxRectsAllocator::SplitFreeRects(const TBRect &used_rect)
+{
+	// Replace all free rects that intersect used_rect with the (up to 4)
+	// largest rects left of them around used_rect.
+	m_split_rects.RemoveAll(false);
+	for (int i = 0; i < m_free_rects.GetNumRects(); i++)
+	{
+		TBRect fr = m_free_rects.GetRect(i);
+		if (!fr.Intersects(used_rect))
+			continue;
+		m_free_rects.RemoveRectFast(i--);
+
+		if (used_rect.x > fr.x)
+			m_split_rects.AddRect(TBRect(fr.x, fr.y, used_rect.x - fr.x, fr.h), false);
+		if (used_rect.x + used_rect.w < fr.x + fr.w)
+			m_split_rects.AddRect(TBRect(used_rect.x + used_rect.w, fr.y, fr.x + fr.w - (used_rect.x + used_rect.w), fr.h), false);
+		if (used_rect.y > fr.y)
+			m_split_rects.AddRect(TBRect(fr.x, fr.y, fr.w, used_rect.y - fr.y), false);
+		if (used_rect.y + used_rect.h < fr.y + fr.h)
+			m_split_rects.AddRect(TBRect(fr.x, used_rect.y + used_rect.h, fr.w, fr.y + fr.h - (used_rect.y + used_rect.h)), false);
+	}
+	int first_new = m_free_rects.GetNumRects();
+	for (int i = 0; i < m_split_rects.GetNumRects(); i++)
+		m_free_rects.AddRect(m_split_rects.GetRect(i), false);
+	RemoveContainedFreeRects(first_new);
+}
+
+/** Return true if rect a contains all of rect b. */
+static bool RectContains(const TBRect &a, const TBRect &b)
+{
+	return b.x >= a.x && b.y >= a.y && b.x + b.w <= a.x + a.w && b.y + b.h <= a.y + a.h;
+}
+
+void TBMaxRectsAllocator::RemoveContainedFreeRects(int first_new)
+{
+	// The free rects before first_new were already checked against each other,
+	// so only the new ones need to be checked against all others.
+	for (int i = first_new; i < m_free_rects.GetNumRects(); i++)
+		for (int j = 0; j < m_free_rects.GetNumRects(); j++)
+		{
+			if (i == j)
+				continue;
+			if (RectContains(m_free_rects.GetRect(j), m_free_rects.GetRect(i)))
+			{
+				m_free_rects.RemoveRect(i--);
+				break;
+			}
+			if (RectContains(m_free_rects.GetRect(i), m_free_rects.GetRect(j)))
+			{
+				m_free_rects.RemoveRect(j);
+				if (j < i)
+					i--;
+				j--;
+			}
+		}
+}
+
 // == TBBitmapFragmentMap ===================================================================================
 
 TBBitmapFragmentMap::TBBitmapFragmentMap()
-	: m_bitmap_w(0)
+	: m_max_rects(nullptr)
+	, m_bitmap_w(0)
 	, m_bitmap_h(0)
+	, m_format(TB_BITMAP_FORMAT_RGBA32)
 	, m_bitmap_data(nullptr)
 	, m_bitmap(nullptr)
 	, m_need_update(false)
@@ -169,14 +301,26 @@ TBBitmapFragmentMap::TBBitmapFragmentMap()
 {
 }
 
-bool TBBitmapFragmentMap::Init(int bitmap_w, int bitmap_h)
+/** Return the number of bytes per pixel for the given format. */
+static int GetBytesPerPixel(TB_BITMAP_FORMAT format)
+{
+	return format == TB_BITMAP_FORMAT_A8 ? 1 : 4;
+}
+
+bool TBBitmapFragmentMap::Init(int bitmap_w, int bitmap_h, TB_BITMAP_FORMAT format, TB_FRAGMENT_ALLOCATOR allocator)
 {
-	m_bitmap_data = new uint32[bitmap_w * bitmap_h];
+	if (allocator == TB_FRAGMENT_ALLOCATOR_MAXRECTS && !(m_max_rects = new TBMaxRectsAllocator(bitmap_w, bitmap_h)))
+		return false;
+
+	// Allocated as uint32 so the data is aligned for TB_BITMAP_FORMAT_RGBA32.
+	const int bpp = GetBytesPerPixel(format);
+	m_bitmap_data = (uint8 *) new uint32[(bitmap_w * bitmap_h * bpp + 3) / 4];
 	m_bitmap_w = bitmap_w;
 	m_bitmap_h = bitmap_h;
+	m_format = format;
 #ifdef TB_RUNTIME_DEBUG_INFO
 	if (m_bitmap_data)
-		memset(m_bitmap_data, 0x88, bitmap_w * bitmap_h * sizeof(uint32));
+		memset(m_bitmap_data, 0x88, bitmap_w * bitmap_h * bpp);
 #endif
 	return m_bitmap_data ? true : false;
 }
@@ -184,10 +328,11 @@ bool TBBitmapFragmentMap::Init(int bitmap_w, int bitmap_h)
 TBBitmapFragmentMap::~TBBitmapFragmentMap()
 {
 	delete m_bitmap;
-	delete [] m_bitmap_data;
+	delete m_max_rects;
+	delete [] (uint32 *) m_bitmap_data;
 }
 
-TBBitmapFragment *TBBitmapFragmentMap::CreateNewFragment(int frag_w, int frag_h, int data_stride, uint32 *frag_data, bool add_border)
+TBBitmapFragment *TBBitmapFragmentMap::CreateNewFragment(int frag_w, int frag_h, int data_stride, void *frag_data, bool add_border)
 {
 	// Finding available space works like this:
 	// The map size is sliced up horizontally in rows (initially just one row covering
@@ -221,6 +366,22 @@ TBBitmapFragment *TBBitmapFragmentMap::CreateNewFragment(int frag_w, int frag_h,
 	//needed_w = (needed_w + granularity - 1) / granularity * granularity;
 	//needed_h = (needed_h + granularity - 1) / granularity * granularity;
 
+	if (m_max_rects)
+	{
+		TBRect rect = m_max_rects->AllocRect(needed_w, needed_h);
+		if (rect.IsEmpty())
+			return nullptr;
+		if (TBBitmapFragment *frag = new TBBitmapFragment)
+		{
+			frag->m_row = nullptr;
+			frag->m_space = nullptr;
+			InitFragment(frag, rect, border, frag_w, frag_h, data_stride, frag_data);
+			return frag;
+		}
+		m_max_rects->FreeRect(rect);
+		return nullptr;
+	}
+
 	if (!m_rows.GetNumItems())
 	{
 		// Create a row covering the entire bitmap.
@@ -265,15 +426,10 @@ TBBitmapFragment *TBBitmapFragmentMap::CreateNewFragment(int frag_w, int frag_h,
 	{
 		if (TBBitmapFragment *frag = new TBBitmapFragment)
 		{
-			frag->m_map = this;
 			frag->m_row = best_row;
 			frag->m_space = space;
-			frag->m_rect.Set(space->x + border, best_row->y + border, frag_w, frag_h);
-			frag->m_row_height = best_row->height;
-			frag->m_batch_id = 0xffffffff;
-			CopyData(frag, data_stride, frag_data, border);
-			m_need_update = true;
-			m_allocated_pixels += frag->m_space->width * frag->m_row->height;
+			InitFragment(frag, TBRect(space->x, best_row->y, space->width, best_row->height),
+						border, frag_w, frag_h, data_stride, frag_data);
 			return frag;
 		}
 		else
@@ -282,6 +438,19 @@ TBBitmapFragment *TBBitmapFragmentMap::CreateNewFragment(int frag_w, int frag_h,
 	return nullptr;
 }
 
+void TBBitmapFragmentMap::InitFragment(TBBitmapFragment *frag, const TBRect &alloc_rect, int border,
+										int frag_w, int frag_h, int data_stride, void *frag_data)
+{
+	frag->m_map = this;
+	frag->m_alloc_rect = alloc_rect;
+	frag->m_rect.Set(alloc_rect.x + border, alloc_rect.y + border, frag_w, frag_h);
+	frag->m_row_height = alloc_rect.h;
+	frag->m_batch_id = 0xffffffff;
+	CopyData(frag, data_stride, frag_data, border);
+	m_need_update = true;
+	m_allocated_pixels += alloc_rect.w * alloc_rect.h;
+}
+
 void TBBitmapFragmentMap::FreeFragmentSpace(TBBitmapFragment *frag)
 {
 	if (!frag)
@@ -291,20 +460,27 @@ void TBBitmapFragmentMap::FreeFragmentSpace(TBBitmapFragment *frag)
 #ifdef TB_RUNTIME_DEBUG_INFO
 	// Debug code to clear the area in debug builds so it's easier to
 	// see & debug the allocation & deallocation of fragments in maps.
-	if (uint32 *data32 = new uint32[frag->m_space->width * frag->m_row->height])
+	if (uint32 *data32 = new uint32[frag->m_alloc_rect.w * frag->m_alloc_rect.h])
 	{
 		static int c = 0;
-		memset(data32, (c++) * 32, sizeof(uint32) * frag->m_space->width * frag->m_row->height);
-		CopyData(frag, frag->m_space->width, data32, false);
+		memset(data32, (c++) * 32, sizeof(uint32) * frag->m_alloc_rect.w * frag->m_alloc_rect.h);
+		CopyData(frag, frag->m_alloc_rect.w, data32, false);
 		m_need_update = true;
 		delete [] data32;
 	}
 #endif // TB_RUNTIME_DEBUG_INFO
 
-	m_allocated_pixels -= frag->m_space->width * frag->m_row->height;
+	m_allocated_pixels -= frag->m_alloc_rect.w * frag->m_alloc_rect.h;
+	frag->m_row_height = 0;
+
+	if (m_max_rects)
+	{
+		m_max_rects->FreeRect(frag->m_alloc_rect);
+		return;
+	}
+
 	frag->m_row->FreeSpace(frag->m_space);
 	frag->m_space = nullptr;
-	frag->m_row_height = 0;
 
 	// If the row is now empty, merge empty rows so larger fragments
 	// have a chance of allocating the space.
@@ -326,43 +502,61 @@ void TBBitmapFragmentMap::FreeFragmentSpace(TBBitmapFragment *frag)
 	}
 }
 
-void TBBitmapFragmentMap::CopyData(TBBitmapFragment *frag, int data_stride, uint32 *frag_data, int border)
+/** Copy the pixels of a fragment (of type T) into the map data, and clamp the edges
+	of it into the border around it. border_mask is applied to border pixels to make
+	them transparent. */
+template<class T>
+static void CopyFragmentPixels(T *bitmap_data, int bitmap_w, const TBRect &frag_rect,
+								int data_stride, const T *frag_data, int border, T border_mask)
 {
 	// Copy the bitmap data
-	uint32 *dst = m_bitmap_data + frag->m_rect.x + frag->m_rect.y * m_bitmap_w;
-	uint32 *src = frag_data;
-	for (int i = 0; i < frag->m_rect.h; i++)
+	T *dst = bitmap_data + frag_rect.x + frag_rect.y * bitmap_w;
+	const T *src = frag_data;
+	for (int i = 0; i < frag_rect.h; i++)
 	{
-		memcpy(dst, src, frag->m_rect.w * sizeof(uint32));
-		dst += m_bitmap_w;
+		memcpy(dst, src, frag_rect.w * sizeof(T));
+		dst += bitmap_w;
 		src += data_stride;
 	}
 	// Copy the bitmap data to the border around the fragment
 	if (border)
 	{
-		TBRect rect = frag->m_rect.Expand(border, border);
+		TBRect rect = frag_rect.Expand(border, border);
 		// Copy vertical edges
-		dst = m_bitmap_data + rect.x + (rect.y + 1) * m_bitmap_w;
+		dst = bitmap_data + rect.x + (rect.y + 1) * bitmap_w;
 		src = frag_data;
-		for (int i = 0; i < frag->m_rect.h; i++)
+		for (int i = 0; i < frag_rect.h; i++)
 		{
-			dst[0] = src[0] & 0x00ffffff;
-			dst[rect.w - 1] = src[frag->m_rect.w - 1] & 0x00ffffff;
-			dst += m_bitmap_w;
+			dst[0] = src[0] & border_mask;
+			dst[rect.w - 1] = src[frag_rect.w - 1] & border_mask;
+			dst += bitmap_w;
 			src += data_stride;
 		}
 		// Copy horizontal edges
-		dst = m_bitmap_data + rect.x + 1 + rect.y * m_bitmap_w;
+		dst = bitmap_data + rect.x + 1 + rect.y * bitmap_w;
 		src = frag_data;
-		for (int i = 0; i < frag->m_rect.w; i++)
-			dst[i] = src[i] & 0x00ffffff;
-		dst = m_bitmap_data + rect.x + 1 + (rect.y + rect.h - 1) * m_bitmap_w;
-		src = frag_data + (frag->m_rect.h - 1) * data_stride;
-		for (int i = 0; i < frag->m_rect.w; i++)
-			dst[i] = src[i] & 0x00ffffff;
+		for (int i = 0; i < frag_rect.w; i++)
+			dst[i] = src[i] & border_mask;
+		dst = bitmap_data + rect.x + 1 + (rect.y + rect.h - 1) * bitmap_w;
+		src = frag_data + (frag_rect.h - 1) * data_stride;
+		for (int i = 0; i < frag_rect.w; i++)
+			dst[i] = src[i] & border_mask;
 	}
 }
 
+void TBBitmapFragmentMap::CopyData(TBBitmapFragment *frag, int data_stride, void *frag_data, int border)
+{
+	// Remember which part of the bitmap needs to be updated
+	m_dirty_rect = m_dirty_rect.Union(frag->m_rect.Expand(border, border));
+
+	if (m_format == TB_BITMAP_FORMAT_A8)
+		CopyFragmentPixels<uint8>(m_bitmap_data, m_bitmap_w, frag->m_rect, data_stride,
+								(const uint8 *) frag_data, border, 0);
+	else
+		CopyFragmentPixels<uint32>((uint32 *) m_bitmap_data, m_bitmap_w, frag->m_rect, data_stride,
+								(const uint32 *) frag_data, border, 0x00ffffff);
+}
+
 TBBitmap *TBBitmapFragmentMap::GetBitmap(TB_VALIDATE_TYPE validate_type)
 {
 	if (m_bitmap && validate_type == TB_VALIDATE_FIRST_TIME)
@@ -375,11 +569,26 @@ bool TBBitmapFragmentMap::ValidateBitmap()
 {
 	if (m_need_update)
 	{
-		if (m_bitmap)
-			m_bitmap->SetData(m_bitmap_data);
+		if (m_format == TB_BITMAP_FORMAT_A8)
+		{
+			if (!m_bitmap)
+				m_bitmap = g_renderer->CreateBitmapA8(m_bitmap_w, m_bitmap_h, m_bitmap_data);
+			else if (!m_dirty_rect.IsEmpty())
+				m_bitmap->SetDataA8(m_bitmap_data, m_dirty_rect);
+		}
+		else if (m_bitmap)
+		{
+			// Only update the part that has changed, unless it's the entire bitmap.
+			uint32 *data32 = (uint32 *) m_bitmap_data;
+			if (m_dirty_rect.w == m_bitmap_w && m_dirty_rect.h == m_bitmap_h)
+				m_bitmap->SetData(data32);
+			else if (!m_dirty_rect.IsEmpty())
+				m_bitmap->SetDataRect(data32, m_dirty_rect);
+		}
 		else
-			m_bitmap = g_renderer->CreateBitmap(m_bitmap_w, m_bitmap_h, m_bitmap_data);
+			m_bitmap = g_renderer->CreateBitmap(m_bitmap_w, m_bitmap_h, (uint32 *) m_bitmap_data);
 		m_need_update = false;
+		m_dirty_rect.Reset();
 	}
 	return m_bitmap ? true : false;
 }
@@ -398,6 +607,8 @@ TBBitmapFragmentManager::TBBitmapFragmentManager()
 	, m_add_border(false)
 	, m_default_map_w(512)
 	, m_default_map_h(512)
+	, m_format(TB_BITMAP_FORMAT_RGBA32)
+	, m_allocator(TB_FRAGMENT_ALLOCATOR_ROWS)
 {
 }
 
@@ -415,6 +626,9 @@ TBBitmapFragment *TBBitmapFragmentManager::GetFragmentFromFile(const char *filen
 	if (frag)
 		return frag;
 
+	// Loaded images are always RGBA32
+	assert(m_format == TB_BITMAP_FORMAT_RGBA32);
+
 	// Load the file
 	TBImageLoader *img = TBImageLoader::CreateFromFile(filename);
 	if (!img)
@@ -428,6 +642,22 @@ TBBitmapFragment *TBBitmapFragmentManager::GetFragmentFromFile(const char *filen
 TBBitmapFragment *TBBitmapFragmentManager::CreateNewFragment(const TBID &id, bool dedicated_map,
 															 int data_w, int data_h, int data_stride,
 															 uint32 *data)
+{
+	assert(m_format == TB_BITMAP_FORMAT_RGBA32);
+	return CreateNewFragmentInternal(id, dedicated_map, data_w, data_h, data_stride, data);
+}
+
+TBBitmapFragment *TBBitmapFragmentManager::CreateNewFragment(const TBID &id, bool dedicated_map,
+															 int data_w, int data_h, int data_stride,
+															 uint8 *data)
+{
+	assert(m_format == TB_BITMAP_FORMAT_A8);
+	return CreateNewFragmentInternal(id, dedicated_map, data_w, data_h, data_stride, data);
+}
+
+TBBitmapFragment *TBBitmapFragmentManager::CreateNewFragmentInternal(const TBID &id, bool dedicated_map,
+																	 int data_w, int data_h, int data_stride,
+																	 void *data)
 {
 	assert(!GetFragment(id));
 
@@ -456,7 +686,7 @@ TBBitmapFragment *TBBitmapFragmentManager::CreateNewFragment(const TBID &id, boo
 			po2h = TBGetNearestPowerOfTwo(data_h);
 		}
 		TBBitmapFragmentMap *fm = new TBBitmapFragmentMap();
-		if (fm && fm->Init(po2w, po2h))
+		if (fm && fm->Init(po2w, po2h, m_format, m_allocator))
 		{
 			m_fragment_maps.Add(fm);
 			frag = fm->CreateNewFragment(data_w, data_h, data_stride, data, m_add_border);
@@ -490,6 +720,166 @@ void TBBitmapFragmentManager::FreeFragment(TBBitmapFragment *frag)
 	}
 }
 
+// Atlas file layout (native byte order, since it's baked for the platform it's used on):
+// TBAtlasHeader, then for each map a TBAtlasMap followed by its pixels,
+// then a TBAtlasFragment for each fragment.
+#define TB_ATLAS_MAGIC		0x54415442 // "TBAT"
+#define TB_ATLAS_VERSION	1
+
+struct TBAtlasHeader
+{
+	uint32 magic;
+	uint32 version;
+	uint32 hash;
+	int32 num_maps;
+	int32 num_fragments;
+};
+
+struct TBAtlasMap
+{
+	int32 w, h;
+	int32 format;
+};
+
+struct TBAtlasFragment
+{
+	uint32 id;
+	int32 map_index;
+	int32 x, y, w, h;					///< m_rect
+	int32 alloc_x, alloc_y, alloc_w, alloc_h;	///< m_alloc_rect
+};
+
+bool TBBitmapFragmentManager::SaveAtlas(const char *filename, uint32 hash)
+{
+	TBTempBuffer buf;
+	TBAtlasHeader header = { TB_ATLAS_MAGIC, TB_ATLAS_VERSION, hash, m_fragment_maps.GetNumItems(), 0 };
+	TBHashTableIteratorOf<TBBitmapFragment> count_it(&m_fragments);
+	while (count_it.GetNextContent())
+		header.num_fragments++;
+	if (!buf.Append((const char *) &header, sizeof(header)))
+		return false;
+
+	for (int i = 0; i < m_fragment_maps.GetNumItems(); i++)
+	{
+		TBBitmapFragmentMap *fm = m_fragment_maps[i];
+		TBAtlasMap map = { fm->m_bitmap_w, fm->m_bitmap_h, fm->m_format };
+		if (!buf.Append((const char *) &map, sizeof(map)) ||
+			!buf.Append((const char *) fm->m_bitmap_data, fm->m_bitmap_w * fm->m_bitmap_h * GetBytesPerPixel(fm->m_format)))
+			return false;
+	}
+
+	TBHashTableIteratorOf<TBBitmapFragment> it(&m_fragments);
+	while (TBBitmapFragment *frag = it.GetNextContent())
+	{
+		TBAtlasFragment f = { frag->m_id, m_fragment_maps.Find(frag->m_map),
+							frag->m_rect.x, frag->m_rect.y, frag->m_rect.w, frag->m_rect.h,
+							frag->m_alloc_rect.x, frag->m_alloc_rect.y, frag->m_alloc_rect.w, frag->m_alloc_rect.h };
+		if (!buf.Append((const char *) &f, sizeof(f)))
+			return false;
+	}
+
+	TBFile *file = TBFile::Open(filename, TBFile::MODE_WRITE);
+	if (!file)
+		return false;
+	bool success = file->Write(buf.GetData(), 1, buf.GetAppendPos()) == (size_t) buf.GetAppendPos();
+	delete file;
+	return success;
+}
+
+bool TBBitmapFragmentManager::LoadAtlas(const char *filename, uint32 hash)
+{
+	assert(!m_fragment_maps.GetNumItems());
+
+	// Read the whole file at once.
+	TBTempBuffer buf;
+	TBFile *file = TBFile::Open(filename, TBFile::MODE_READ);
+	if (!file)
+		return false;
+	long size = file->Size();
+	bool read_ok = size >= (long) sizeof(TBAtlasHeader) && buf.Reserve(size) &&
+					file->Read(buf.GetData(), 1, size) == (size_t) size;
+	delete file;
+	if (!read_ok)
+		return false;
+
+	const char *src = buf.GetData();
+	const char *src_end = src + size;
+	const TBAtlasHeader *header = (const TBAtlasHeader *) src;
+	if (header->magic != TB_ATLAS_MAGIC || header->version != TB_ATLAS_VERSION || header->hash != hash)
+		return false;
+	src += sizeof(TBAtlasHeader);
+
+	for (int i = 0; i < header->num_maps; i++)
+	{
+		if (src_end - src < (int) sizeof(TBAtlasMap))
+			break;
+		const TBAtlasMap *map = (const TBAtlasMap *) src;
+		src += sizeof(TBAtlasMap);
+		TB_BITMAP_FORMAT format = map->format == TB_BITMAP_FORMAT_A8 ? TB_BITMAP_FORMAT_A8 : TB_BITMAP_FORMAT_RGBA32;
+		int data_size = map->w * map->h * GetBytesPerPixel(format);
+		if (map->w <= 0 || map->h <= 0 || src_end - src < data_size || !m_fragment_maps.GrowIfNeeded())
+			break;
+		TBBitmapFragmentMap *fm = new TBBitmapFragmentMap();
+		if (!fm || !fm->Init(map->w, map->h, format, TB_FRAGMENT_ALLOCATOR_MAXRECTS))
+		{
+			delete fm;
+			break;
+		}
+		memcpy(fm->m_bitmap_data, src, data_size);
+		src += data_size;
+		fm->m_dirty_rect.Set(0, 0, map->w, map->h);
+		fm->m_need_update = true;
+		m_fragment_maps.Add(fm);
+	}
+	if (m_fragment_maps.GetNumItems() != header->num_maps)
+	{
+		Clear();
+		return false;
+	}
+
+	int num_fragments = 0;
+	for (; num_fragments < header->num_fragments; num_fragments++)
+	{
+		if (src_end - src < (int) sizeof(TBAtlasFragment))
+			break;
+		const TBAtlasFragment *f = (const TBAtlasFragment *) src;
+		src += sizeof(TBAtlasFragment);
+		if (f->map_index < 0 || f->map_index >= m_fragment_maps.GetNumItems() || GetFragment(f->id))
+			break;
+		TBBitmapFragmentMap *fm = m_fragment_maps[f->map_index];
+		TBRect alloc_rect(f->alloc_x, f->alloc_y, f->alloc_w, f->alloc_h);
+		TBRect rect(f->x, f->y, f->w, f->h);
+		if (alloc_rect.IsEmpty() || alloc_rect.x < 0 || alloc_rect.y < 0 ||
+			alloc_rect.x + alloc_rect.w > fm->m_bitmap_w || alloc_rect.y + alloc_rect.h > fm->m_bitmap_h ||
+			!rect.Equals(rect.Clip(alloc_rect)))
+			break;
+		TBBitmapFragment *frag = new TBBitmapFragment;
+		if (!frag)
+			break;
+		frag->m_map = fm;
+		frag->m_rect = rect;
+		frag->m_alloc_rect = alloc_rect;
+		frag->m_row = nullptr;
+		frag->m_space = nullptr;
+		frag->m_row_height = alloc_rect.h;
+		frag->m_batch_id = 0xffffffff;
+		frag->m_id = f->id;
+		if (!m_fragments.Add(frag->m_id, frag))
+		{
+			delete frag;
+			break;
+		}
+		fm->m_max_rects->AllocRectAt(alloc_rect);
+		fm->m_allocated_pixels += alloc_rect.w * alloc_rect.h;
+	}
+	if (num_fragments != header->num_fragments)
+	{
+		Clear();
+		return false;
+	}
+	return true;
+}
+
 TBBitmapFragment *TBBitmapFragmentManager::GetFragment(const TBID &id) const
 {
 	return m_fragments.Get(id);
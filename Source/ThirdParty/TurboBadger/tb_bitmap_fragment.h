@@ -87,6 +87,48 @@ public:
 	int y, height;
 };
 
+/** Allocator of rectangles out of a given area (used in TBBitmapFragmentMap with
+	TB_FRAGMENT_ALLOCATOR_MAXRECTS). It keeps a list of the largest free rectangles,
+	which may overlap each other ("MaxRects"). Fragments of different height can
+	be placed next to each other without wasting the rest of a row. */
+class TBMaxRectsAllocator
+{
+public:
+	TBMaxRectsAllocator(int width, int height);
+
+	/** Return true if no allocations are currently live using this allocator. */
+	bool IsAllAvailable() const { return m_used_area == 0; }
+
+	/** Allocate space of the given size. Returns the allocated rectangle, or an
+		empty rectangle if there is no free rectangle large enough. */
+	TBRect AllocRect(int needed_w, int needed_h);
+
+	/** Allocate the given rectangle, which must be free. This is used to restore
+		allocations (See TBBitmapFragmentManager::LoadAtlas). */
+	void AllocRectAt(const TBRect &rect);
+
+	/** Free the given rectangle (as returned by AllocRect) so it is available for new allocations. */
+	void FreeRect(const TBRect &rect);
+private:
+	void SplitFreeRects(const TBRect &used_rect);
+	void RemoveContainedFreeRects(int first_new);
+	int m_width, m_height;
+	int m_used_area;
+	TBRegion m_free_rects; ///< Free rectangles. Unlike other uses of TBRegion, they may overlap.
+	TBRegion m_split_rects; ///< Temporary storage for SplitFreeRects.
+};
+
+/** Specify which allocator a TBBitmapFragmentMap uses to find space for new fragments. */
+enum TB_FRAGMENT_ALLOCATOR {
+
+	/** Slice the map in rows, each as high as the first fragment put in it (TBFragmentSpaceAllocator).
+		Works best when most fragments have the same height. */
+	TB_FRAGMENT_ALLOCATOR_ROWS,
+
+	/** Allocate from free rectangles (TBMaxRectsAllocator). Packs fragments of mixed size tighter. */
+	TB_FRAGMENT_ALLOCATOR_MAXRECTS
+};
+
 /** Specify when the bitmap should be validated when calling TBBitmapFragmentMap::GetBitmap. */
 enum TB_VALIDATE_TYPE {
 
@@ -98,6 +140,16 @@ enum TB_VALIDATE_TYPE {
 	TB_VALIDATE_FIRST_TIME
 };
 
+/** The pixel format of the data in a TBBitmapFragmentMap. */
+enum TB_BITMAP_FORMAT {
+
+	/** 32bit color with alpha (see TBImageLoader::Data). */
+	TB_BITMAP_FORMAT_RGBA32,
+
+	/** 8bit alpha only. The color is white. Created with TBRenderer::CreateBitmapA8. */
+	TB_BITMAP_FORMAT_A8
+};
+
 /** TBBitmapFragmentMap is used to pack multiple bitmaps into a single TBBitmap.
 	When initialized (in a size suitable for a TBBitmap) is also creates a software buffer
 	that will make up the TBBitmap when all fragments have been added. */
@@ -109,11 +161,16 @@ public:
 
 	/** Initialize the map with the given size. The size should be a power of two since
 		it will be used to create a TBBitmap (texture memory). */
-	bool Init(int bitmap_w, int bitmap_h);
+	bool Init(int bitmap_w, int bitmap_h, TB_BITMAP_FORMAT format = TB_BITMAP_FORMAT_RGBA32,
+				TB_FRAGMENT_ALLOCATOR allocator = TB_FRAGMENT_ALLOCATOR_ROWS);
 
-	/** Create a new fragment with the given size and data in this map.
+	/** Return the pixel format of this map. */
+	TB_BITMAP_FORMAT GetFormat() const { return m_format; }
+
+	/** Create a new fragment with the given size and data in this map. The data must be
+		in the format of this map (uint32 for TB_BITMAP_FORMAT_RGBA32, uint8 for TB_BITMAP_FORMAT_A8).
 		Returns nullptr if there is not enough room in this map or on any other fail. */
-	TBBitmapFragment *CreateNewFragment(int frag_w, int frag_h, int data_stride, uint32 *frag_data, bool add_border);
+	TBBitmapFragment *CreateNewFragment(int frag_w, int frag_h, int data_stride, void *frag_data, bool add_border);
 
 	/** Free up the space used by the given fragment, so that other fragments can take its place. */
 	void FreeFragmentSpace(TBBitmapFragment *frag);
@@ -125,12 +182,17 @@ private:
 	friend class TBBitmapFragmentManager;
 	bool ValidateBitmap();
 	void DeleteBitmap();
-	void CopyData(TBBitmapFragment *frag, int data_stride, uint32 *frag_data, int border);
+	void InitFragment(TBBitmapFragment *frag, const TBRect &alloc_rect, int border,
+						int frag_w, int frag_h, int data_stride, void *frag_data);
+	void CopyData(TBBitmapFragment *frag, int data_stride, void *frag_data, int border);
 	TBListAutoDeleteOf<TBFragmentSpaceAllocator> m_rows;
+	TBMaxRectsAllocator *m_max_rects; ///< Used instead of m_rows with TB_FRAGMENT_ALLOCATOR_MAXRECTS.
 	int m_bitmap_w, m_bitmap_h;
-	uint32 *m_bitmap_data;
+	TB_BITMAP_FORMAT m_format;
+	uint8 *m_bitmap_data; ///< Pixels in m_format.
 	TBBitmap *m_bitmap;
 	bool m_need_update;
+	TBRect m_dirty_rect; ///< The part of m_bitmap_data that has changed since the bitmap was updated.
 	int m_allocated_pixels;
 };
 
@@ -156,7 +218,8 @@ public:
 public:
 	TBBitmapFragmentMap *m_map;
 	TBRect m_rect;
-	TBFragmentSpaceAllocator *m_row;
+	TBRect m_alloc_rect; ///< The space allocated in the map (m_rect including any border).
+	TBFragmentSpaceAllocator *m_row; ///< nullptr if the map use TB_FRAGMENT_ALLOCATOR_MAXRECTS.
 	TBFragmentSpaceAllocator::Space *m_space;
 	TBID m_id;
 	int m_row_height;
@@ -202,6 +265,26 @@ public:
 										int data_w, int data_h, int data_stride,
 										uint32 *data);
 
+	/** Create a new fragment from the given 8bit alpha data.
+		The format must have been set to TB_BITMAP_FORMAT_A8 (See SetFormat). */
+	TBBitmapFragment *CreateNewFragment(const TBID &id, bool dedicated_map,
+										int data_w, int data_h, int data_stride,
+										uint8 *data);
+
+	/** Save all fragment maps and fragments to an atlas file. LoadAtlas can load it
+		much faster than creating all fragments again from their source.
+		hash should identify the sources of all fragments, so LoadAtlas can tell
+		if the atlas is outdated. */
+	bool SaveAtlas(const char *filename, uint32 hash);
+
+	/** Load the fragment maps and fragments from an atlas file saved with SaveAtlas,
+		if it was saved with the same hash. This manager should be empty.
+		The fragments get the same ids as when saved, so f.ex GetFragmentFromFile
+		will return them without loading any file. The maps use
+		TB_FRAGMENT_ALLOCATOR_MAXRECTS, so fragments can still be added and freed.
+		Returns false if the file can't be read, is outdated or is invalid. */
+	bool LoadAtlas(const char *filename, uint32 hash);
+
 	/** Delete the given fragment and free the space it used in its map,
 		so that other fragments can take its place. */
 	void FreeFragment(TBBitmapFragment *frag);
@@ -231,6 +314,16 @@ public:
 	/** Set the default size of new fragment maps. These must be power of two. */
 	void SetDefaultMapSize(int w, int h);
 
+	/** Set the pixel format of new fragment maps (default is TB_BITMAP_FORMAT_RGBA32).
+		This should be set before any fragment is created. */
+	void SetFormat(TB_BITMAP_FORMAT format) { m_format = format; }
+	TB_BITMAP_FORMAT GetFormat() const { return m_format; }
+
+	/** Set the allocator used by new fragment maps (default is TB_FRAGMENT_ALLOCATOR_ROWS).
+		This should be set before any fragment is created. */
+	void SetAllocator(TB_FRAGMENT_ALLOCATOR allocator) { m_allocator = allocator; }
+	TB_FRAGMENT_ALLOCATOR GetAllocator() const { return m_allocator; }
+
 	/** Get the amount (in percent) of space that is currently occupied by all maps
 		in this fragment manager. */
 	int GetUseRatio() const;
@@ -239,12 +332,17 @@ public:
 	void Debug();
 #endif
 private:
+	TBBitmapFragment *CreateNewFragmentInternal(const TBID &id, bool dedicated_map,
+												int data_w, int data_h, int data_stride,
+												void *data);
 	TBListOf<TBBitmapFragmentMap> m_fragment_maps;
 	TBHashTableOf<TBBitmapFragment> m_fragments;
 	int m_num_maps_limit;
 	bool m_add_border;
 	int m_default_map_w;
 	int m_default_map_h;
+	TB_BITMAP_FORMAT m_format;
+	TB_FRAGMENT_ALLOCATOR m_allocator;
 };
 
 }; // namespace tb
@@ -23,6 +23,11 @@
 #define TB_UNIT_TESTING
 #endif
 
+/** Enable to also compile the benchmarks with the unit tests. They compare with
+	the old implementations and take a while, so they are not run by default.
+	The results are printed when running the tests with TB_TEST_VERBOSE. */
+//#define TB_UNIT_TESTING_BENCHMARKS
+
 /** Enable if the focus state should automatically be set on edit fields even
 	when using the pointer. It is normally set only while moving focus by keyboard. */
 //#define TB_ALWAYS_SHOW_EDIT_FOCUS
@@ -68,11 +73,20 @@
 /** The height of the font glyph cache. Must be a power of two. */
 #define TB_GLYPH_CACHE_HEIGHT 512
 
+/** The max number of strings whose glyphs are kept in the glyph run cache
+	(See TBFontGlyphRun). 0 disables the glyph run cache. */
+#define TB_GLYPH_RUN_CACHE_SIZE 1024
+
 // == Optional features ===========================================================
 
 /** Enable support for TBImage, TBImageManager, TBImageWidget. */
 #define TB_IMAGE
 
+/** Enable to decode skin bitmaps on multiple threads (using std::thread) when loading
+	a skin with TBSkin::LoadAsync. Without it, LoadAsync still loads the bitmaps
+	asynchronously, but decodes them one at a time on the main thread. */
+#define TB_SKIN_ASYNC_THREADS
+
 // == Additional configuration of platform implementations ========================
 
 /** Define for posix implementation of TBFile. */
@@ -9,6 +9,7 @@
 #include "tb_editfield.h"
 #include "tb_font_renderer.h"
 #include "tb_tempbuffer.h"
+#include "tb_profiler.h"
 #include <stdio.h>
 
 namespace tb {
@@ -36,6 +37,7 @@ public:
 		g_widgets_reader->LoadData(this,
 			"TBLayout: axis: y, distribution: available, position: left\n"
 			"	TBLayout: id: 'container', axis: y, size: available\n"
+			"	TBButton: id: 'profiler', text: 'Frame profiler...'\n"
 			"	TBTextField: text: 'Event output:'\n"
 			"	TBEditField: id: 'output', gravity: all, multiline: 1, wrap: 0\n"
 			"		lp: pref-height: 100dp");
@@ -48,6 +50,7 @@ public:
 		AddCheckbox(TBDebugInfo::RENDER_FONT_BITMAP_FRAGMENTS, "Render font bitmap fragments");
 
 		output = GetWidgetByIDAndType<TBEditField>(TBIDC("output"));
+		output->GetStyleEdit()->SetLogMaxLines(100);
 
 		TBRect bounds(0, 0, root->GetRect().w, root->GetRect().h);
 		SetRect(GetResizeToFitContentRect().CenterIn(bounds).MoveIn(bounds).Clip(bounds));
@@ -85,6 +88,11 @@ public:
 			GetParentRoot()->Invalidate();
 			return true;
 		}
+		else if (ev.type == EVENT_TYPE_CLICK && ev.target->GetID() == TBIDC("profiler"))
+		{
+			ShowProfilerWindow(GetParentRoot());
+			return true;
+		}
 		return TBWindow::OnEvent(ev);
 	}
 
@@ -159,21 +167,8 @@ public:
 		}
 		buf.AppendString("\n");
 
-		// Append the line to the output textfield
-		TBStyleEdit *se = output->GetStyleEdit();
-		se->selection.SelectNothing();
-		se->AppendText(buf.GetData(), TB_ALL_TO_TERMINATION, true);
-		se->ScrollIfNeeded(false, true);
-
-		// Remove lines from the top if we exceed the height limit.
-		const int height_limit = 2000;
-		int current_height = se->GetContentHeight();
-		if (current_height > height_limit)
-		{
-			se->caret.Place(TBPoint(0, current_height - height_limit));
-			se->selection.SelectToCaret(se->blocks.GetFirst(), 0);
-			se->Delete();
-		}
+		// Append the line to the output textfield. Old lines are removed from the top.
+		output->GetStyleEdit()->AppendLogText(buf.GetData(), buf.GetAppendPos());
 		return false;
 	}
 
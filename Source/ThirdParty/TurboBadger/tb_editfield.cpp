@@ -18,6 +18,7 @@ namespace tb {
 
 const int CARET_BLINK_TIME = 500;
 const int SELECTION_SCROLL_DELAY = 1000/30;
+const int REFORMAT_DELAY = 1000/60;
 
 /** Get the delta that should be scrolled if dragging the pointer outside the range min-max */
 int GetSelectionScrollSpeed(int pointerpos, int min, int max)
@@ -425,6 +426,17 @@ void TBEditField::OnMessageReceived(TBMessage *msg)
 		// Post another blink message so we blink again.
 		PostMessageDelayed(TBIDC("blink"), nullptr, CARET_BLINK_TIME);
 	}
+	else if (msg->message == TBIDC("reformat"))
+	{
+		// Layout some more of the blocks left after a reformat. This will post
+		// another reformat message if there's still more to do.
+		m_style_edit.ReformatPending(TBStyleEdit::REFORMAT_TIME_BUDGET);
+	}
+	else if (msg->message == TBIDC("flushlog"))
+	{
+		// Add all log text appended since the message was posted.
+		m_style_edit.FlushLog();
+	}
 	else if (msg->message == TBIDC("selscroll") && captured_widget == this)
 	{
 		// Get scroll speed from where mouse is relative to the padding rect.
@@ -526,6 +538,20 @@ void TBEditField::CaretBlinkStop()
 		DeleteMessage(msg);
 }
 
+void TBEditField::ReformatPendingStart()
+{
+	// Post the delayed reformat message if we don't already have one
+	if (!GetMessageByID(TBIDC("reformat")))
+		PostMessageDelayed(TBIDC("reformat"), nullptr, REFORMAT_DELAY);
+}
+
+void TBEditField::FlushLogStart()
+{
+	// Post a message so everything appended until it's received is added at once
+	if (!GetMessageByID(TBIDC("flushlog")))
+		PostMessage(TBIDC("flushlog"), nullptr);
+}
+
 // == TBEditFieldScrollRoot =======================================================================
 
 void TBEditFieldScrollRoot::OnPaintChildren(const PaintProps &paint_props)
@@ -200,6 +200,8 @@ private:
 	virtual void UpdateScrollbars();
 	virtual void CaretBlinkStart();
 	virtual void CaretBlinkStop();
+	virtual void ReformatPendingStart();
+	virtual void FlushLogStart();
 };
 
 }; // namespace tb
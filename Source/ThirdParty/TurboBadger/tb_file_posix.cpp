@@ -8,14 +8,21 @@
 #ifdef TB_FILE_POSIX
 
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace tb {
 
 class TBPosixFile : public TBFile
 {
 public:
-	TBPosixFile(FILE *f) : file(f) {}
-	virtual ~TBPosixFile() { fclose(file); }
+	TBPosixFile(FILE *f, bool can_map) : file(f), can_map(can_map), mapping(nullptr), mapping_size(0) {}
+	virtual ~TBPosixFile()
+	{
+		if (mapping)
+			munmap(mapping, mapping_size);
+		fclose(file);
+	}
 
 	virtual long Size()
 	{
@@ -29,8 +36,37 @@ public:
 	{
 		return fread(buf, elemSize, count, file);
 	}
+	virtual size_t Write(const void *buf, size_t elemSize, size_t count)
+	{
+		return fwrite(buf, elemSize, count, file);
+	}
+	virtual char *Map()
+	{
+		if (mapping || !can_map)
+			return mapping;
+		long size = Size();
+		if (size <= 0)
+			return nullptr;
+		// Copy on write, so the caller may modify the data without changing the file.
+		void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+		if (data == MAP_FAILED)
+			return nullptr;
+		mapping = (char *) data;
+		mapping_size = size;
+		return mapping;
+	}
+	virtual double GetModifiedTime()
+	{
+		struct stat st;
+		if (fstat(fileno(file), &st) != 0)
+			return 0;
+		return (double) st.st_mtime;
+	}
 private:
 	FILE *file;
+	bool can_map;
+	char *mapping;
+	size_t mapping_size;
 };
 
 // static
@@ -42,12 +78,15 @@ TBFile *TBFile::Open(const char *filename, TBFileMode mode)
 	case MODE_READ:
 		f = fopen(filename, "rb");
 		break;
+	case MODE_WRITE:
+		f = fopen(filename, "wb");
+		break;
 	default:
 		break;
 	}
 	if (!f)
 		return nullptr;
-	TBPosixFile *tbf = new TBPosixFile(f);
+	TBPosixFile *tbf = new TBPosixFile(f, mode == MODE_READ);
 	if (!tbf)
 		fclose(f);
 	return tbf;
@@ -6,6 +6,7 @@
 #include "tb_font_renderer.h"
 #include "tb_renderer.h"
 #include "tb_system.h"
+#include "tb_profiler.h"
 #include <math.h>
 
 namespace tb {
@@ -128,19 +129,54 @@ TBFontGlyph::TBFontGlyph(const TBID &hash_id, UCS4 cp)
 	: hash_id(hash_id)
 	, cp(cp)
 	, frag(nullptr)
+	, last_used(0)
 	, has_rgb(false)
 {
 }
 
+// == TBFontGlyphRun ==============================================================================
+
+TBFontGlyphRun::TBFontGlyphRun(uint32 key, uint32 font_face_id, const char *str, int str_len, int num_quads)
+	: key(key)
+	, font_face_id(font_face_id)
+	, str(new char[str_len])
+	, str_len(str_len)
+	, quads(new Quad[num_quads])
+	, num_quads(0)
+	, frag_generation(0)
+{
+	memcpy(this->str, str, str_len);
+}
+
+TBFontGlyphRun::~TBFontGlyphRun()
+{
+	delete [] str;
+	delete [] quads;
+}
+
+bool TBFontGlyphRun::Equals(uint32 font_face_id, const char *str, int str_len) const
+{
+	return this->font_face_id == font_face_id && this->str_len == str_len &&
+		memcmp(this->str, str, str_len) == 0;
+}
+
 // == TBFontGlyphCache ============================================================================
 
 TBFontGlyphCache::TBFontGlyphCache()
+	: m_num_glyph_runs(0)
+	, m_frag_generation(0)
 {
 	// Only use one map for the font face. The glyph cache will start forgetting
 	// glyphs that haven't been used for a while if the map gets full.
 	m_frag_manager.SetNumMapsLimit(1);
 	m_frag_manager.SetDefaultMapSize(TB_GLYPH_CACHE_WIDTH, TB_GLYPH_CACHE_HEIGHT);
 
+	// Glyphs without color of their own go into a separate 8bit alpha map, if the
+	// renderer supports it. It's only created when the first such glyph is added.
+	m_frag_manager_a8.SetNumMapsLimit(1);
+	m_frag_manager_a8.SetDefaultMapSize(TB_GLYPH_CACHE_WIDTH, TB_GLYPH_CACHE_HEIGHT);
+	m_frag_manager_a8.SetFormat(TB_BITMAP_FORMAT_A8);
+
 	g_renderer->AddListener(this);
 }
 
@@ -153,30 +189,114 @@ TBFontGlyph *TBFontGlyphCache::GetGlyph(const TBID &hash_id, UCS4 cp)
 {
 	if (TBFontGlyph *glyph = m_glyphs.Get(hash_id))
 	{
-		// Move the glyph to the end of m_all_rendered_glyphs so we maintain LRU (oldest first)
-		if (m_all_rendered_glyphs.ContainsLink(glyph))
-		{
-			m_all_rendered_glyphs.Remove(glyph);
-			m_all_rendered_glyphs.AddLast(glyph);
-		}
+		// Stamp the glyph so we know which ones are least recently used when we need space.
+		StampGlyph(glyph, g_renderer->GetPaintCount());
 		return glyph;
 	}
 	return nullptr;
 }
 
+void TBFontGlyphCache::StampGlyph(TBFontGlyph *glyph, uint32 paint_count)
+{
+	if (glyph->last_used == paint_count)
+		return;
+	glyph->last_used = paint_count;
+	// Keep m_all_rendered_glyphs ordered by last_used. This is only done the first time
+	// the glyph is used in each paint.
+	if (glyph->frag)
+	{
+		m_all_rendered_glyphs.Remove(glyph);
+		m_all_rendered_glyphs.AddLast(glyph);
+	}
+}
+
+TBFontGlyphRun *TBFontGlyphCache::GetGlyphRun(uint32 key, uint32 font_face_id, const char *str, int str_len)
+{
+	TBFontGlyphRun *run = m_glyph_runs.Get(key);
+	if (!run || !run->Equals(font_face_id, str, str_len))
+		return nullptr;
+	if (run->frag_generation != m_frag_generation)
+	{
+		// Some glyph fragment it used may be gone.
+		DeleteGlyphRun(run);
+		return nullptr;
+	}
+	// Move the run to the end of m_all_glyph_runs so we maintain LRU (oldest first)
+	m_all_glyph_runs.Remove(run);
+	m_all_glyph_runs.AddLast(run);
+	return run;
+}
+
+bool TBFontGlyphCache::CacheGlyphRun(TBFontGlyphRun *run)
+{
+	// Replace any run with the same key, and drop the least recently used if we're full.
+	if (TBFontGlyphRun *old_run = m_glyph_runs.Get(run->key))
+		DeleteGlyphRun(old_run);
+	while (m_num_glyph_runs >= TB_GLYPH_RUN_CACHE_SIZE && m_all_glyph_runs.GetFirst())
+		DeleteGlyphRun(m_all_glyph_runs.GetFirst());
+
+	run->frag_generation = m_frag_generation;
+	if (!m_glyph_runs.Add(run->key, run))
+	{
+		delete run;
+		return false;
+	}
+	m_all_glyph_runs.AddLast(run);
+	m_num_glyph_runs++;
+	return true;
+}
+
+void TBFontGlyphCache::DeleteGlyphRun(TBFontGlyphRun *run)
+{
+	m_all_glyph_runs.Remove(run);
+	m_num_glyph_runs--;
+	m_glyph_runs.Delete(run->key);
+}
+
 TBFontGlyph *TBFontGlyphCache::CreateAndCacheGlyph(const TBID &hash_id, UCS4 cp)
 {
 	assert(!GetGlyph(hash_id, cp));
 	TBFontGlyph *glyph = new TBFontGlyph(hash_id, cp);
 	if (glyph && m_glyphs.Add(glyph->hash_id, glyph))
+	{
+		glyph->last_used = g_renderer->GetPaintCount();
 		return glyph;
+	}
 	delete glyph;
 	return nullptr;
 }
 
+bool TBFontGlyphCache::UseBitmapA8() const
+{
+#ifdef TB_PREMULTIPLIED_ALPHA
+	// The color of A8 bitmaps is always white, which can't be premultiplied.
+	return false;
+#else
+	return g_renderer->SupportsBitmapA8();
+#endif
+}
+
+TBBitmapFragmentManager *TBFontGlyphCache::GetFragmentManager(TB_BITMAP_FORMAT format)
+{
+	return format == TB_BITMAP_FORMAT_A8 ? &m_frag_manager_a8 : &m_frag_manager;
+}
+
 TBBitmapFragment *TBFontGlyphCache::CreateFragment(TBFontGlyph *glyph, int w, int h, int stride, uint32 *data)
+{
+	return CreateFragmentInternal(glyph, w, h, stride, data, nullptr);
+}
+
+TBBitmapFragment *TBFontGlyphCache::CreateFragmentA8(TBFontGlyph *glyph, int w, int h, int stride, uint8 *data)
+{
+	assert(UseBitmapA8());
+	return CreateFragmentInternal(glyph, w, h, stride, nullptr, data);
+}
+
+TBBitmapFragment *TBFontGlyphCache::CreateFragmentInternal(TBFontGlyph *glyph, int w, int h, int stride, uint32 *data32, uint8 *data8)
 {
 	assert(GetGlyph(glyph->hash_id, glyph->cp));
+	// Only glyphs in the same map as the new one can free up space for it.
+	const TB_BITMAP_FORMAT format = data8 ? TB_BITMAP_FORMAT_A8 : TB_BITMAP_FORMAT_RGBA32;
 	// Don't bother if the requested glyph is too large.
 	if (w > TB_GLYPH_CACHE_WIDTH || h > TB_GLYPH_CACHE_HEIGHT)
 		return nullptr;
@@ -186,26 +306,24 @@ TBBitmapFragment *TBFontGlyphCache::CreateFragment(TBFontGlyph *glyph, int w, in
 	do
 	{
 		// Attempt creating a fragment for the rendered glyph data
-		if (TBBitmapFragment *frag = m_frag_manager.CreateNewFragment(glyph->hash_id, false, w, h, stride, data))
+		TBBitmapFragment *frag = data8 ?
+			m_frag_manager_a8.CreateNewFragment(glyph->hash_id, false, w, h, stride, data8) :
+			m_frag_manager.CreateNewFragment(glyph->hash_id, false, w, h, stride, data32);
+		if (frag)
 		{
 			glyph->frag = frag;
 			m_all_rendered_glyphs.AddLast(glyph);
 			return frag;
 		}
-		// Drop the oldest glyph that's large enough to free up the space we need.
+		// Drop the least recently used glyph that's large enough to free up the space we need,
+		// unless it's used in the current frame.
 		if (try_drop_largest)
 		{
-			const int check_limit = 20;
-			int check_count = 0;
-			for (TBFontGlyph *oldest = m_all_rendered_glyphs.GetFirst(); oldest && check_count < check_limit; oldest = oldest->GetNext())
+			TBFontGlyph *oldest = GetLeastRecentlyUsedGlyph(format, w, h);
+			if (oldest && oldest->last_used != g_renderer->GetPaintCount())
 			{
-				if (oldest->frag->Width() >= w && oldest->frag->GetAllocatedHeight() >= h)
-				{
-					DropGlyphFragment(oldest);
-					dropped_large_enough_glyph = true;
-					break;
-				}
-				check_count++;
+				DropGlyphFragment(oldest);
+				dropped_large_enough_glyph = true;
 			}
 			try_drop_largest = false;
 		}
@@ -213,7 +331,7 @@ TBBitmapFragment *TBFontGlyphCache::CreateFragment(TBFontGlyph *glyph, int w, in
 		// spin around the loop, fail and drop again a few times before we succeed.
 		if (!dropped_large_enough_glyph)
 		{
-			if (TBFontGlyph *oldest = m_all_rendered_glyphs.GetFirst())
+			if (TBFontGlyph *oldest = GetLeastRecentlyUsedGlyph(format, 0, 0))
 				DropGlyphFragment(oldest);
 			else
 				break;
@@ -222,24 +340,49 @@ TBBitmapFragment *TBFontGlyphCache::CreateFragment(TBFontGlyph *glyph, int w, in
 	return nullptr;
 }
 
+TBFontGlyph *TBFontGlyphCache::GetLeastRecentlyUsedGlyph(TB_BITMAP_FORMAT format, int min_w, int min_h)
+{
+	// The glyphs are ordered by last_used (See StampGlyph), so the first match is the least
+	// recently used. Only the oldest few are checked for a large enough glyph, since the
+	// caller drops the oldest glyphs of any size if there is none.
+	const bool check_size = min_w > 0 || min_h > 0;
+	const int check_limit = 20;
+	int check_count = 0;
+	for (TBFontGlyph *glyph = m_all_rendered_glyphs.GetFirst(); glyph; glyph = glyph->GetNext())
+	{
+		if (check_size && check_count++ == check_limit)
+			break;
+		if (glyph->frag->m_map->GetFormat() == format &&
+			glyph->frag->Width() >= min_w && glyph->frag->GetAllocatedHeight() >= min_h)
+			return glyph;
+	}
+	return nullptr;
+}
+
 void TBFontGlyphCache::DropGlyphFragment(TBFontGlyph *glyph)
 {
 	assert(glyph->frag);
-	m_frag_manager.FreeFragment(glyph->frag);
+	GetFragmentManager(glyph->frag->m_map->GetFormat())->FreeFragment(glyph->frag);
 	glyph->frag = nullptr;
 	m_all_rendered_glyphs.Remove(glyph);
+	// Glyph runs may use the fragment.
+	m_frag_generation++;
 }
 
 #ifdef TB_RUNTIME_DEBUG_INFO
 void TBFontGlyphCache::Debug()
 {
 	m_frag_manager.Debug();
+	g_renderer->Translate(0, TB_GLYPH_CACHE_HEIGHT + 5);
+	m_frag_manager_a8.Debug();
+	g_renderer->Translate(0, -(TB_GLYPH_CACHE_HEIGHT + 5));
 }
 #endif // TB_RUNTIME_DEBUG_INFO
 
 void TBFontGlyphCache::OnContextLost()
 {
 	m_frag_manager.DeleteBitmaps();
+	m_frag_manager_a8.DeleteBitmaps();
 }
 
 void TBFontGlyphCache::OnContextRestored()
@@ -262,6 +405,9 @@ TBFontFace::TBFontFace(TBFontGlyphCache *glyph_cache, TBFontRenderer *renderer,
 		m_metrics.descent = size / 4;
 		m_metrics.height = size;
 	}
+	// 0xFFFF is an invalid character that is never measured.
+	for (int i = 0; i < 256; i++)
+		m_advance_cp[i] = 0xFFFF;
 }
 
 TBFontFace::~TBFontFace()
@@ -320,6 +466,17 @@ void TBFontFace::RenderGlyph(TBFontGlyph *glyph)
 		TBFontGlyphData *effect_glyph_data = m_effect.Render(&glyph->metrics, &glyph_data);
 		TBFontGlyphData *result_glyph_data = effect_glyph_data ? effect_glyph_data : &glyph_data;
 
+		// Glyphs without color can be used as is, if the renderer supports 8bit alpha bitmaps.
+		if (!result_glyph_data->data32 && result_glyph_data->data8 && !result_glyph_data->rgb &&
+			m_glyph_cache->UseBitmapA8())
+		{
+			glyph->has_rgb = false;
+			m_glyph_cache->CreateFragmentA8(glyph, result_glyph_data->w, result_glyph_data->h,
+											result_glyph_data->stride, result_glyph_data->data8);
+			delete effect_glyph_data;
+			return;
+		}
+
 		// The glyph data may be in uint8 format, which we have to convert since we always
 		// create fragments (and TBBitmap) in 32bit format.
 		uint32 *glyph_dsta_src = result_glyph_data->data32;
@@ -376,6 +533,63 @@ TBFontGlyph *TBFontFace::GetGlyph(UCS4 cp, bool render_if_needed)
 	return glyph;
 }
 
+TBFontGlyphRun *TBFontFace::GetGlyphRun(const char *str, int len)
+{
+	if (!m_font_renderer || !TB_GLYPH_RUN_CACHE_SIZE)
+		return nullptr;
+
+	// Hash the string (to the null termination or len). Long strings are not cached.
+	const int max_str_len = 256;
+	uint32 key = 2166136261U ^ m_font_desc.GetFontFaceID();
+	int str_len = 0;
+	while (str[str_len] && str_len < len)
+	{
+		if (str_len == max_str_len)
+			return nullptr;
+		key = (key ^ (uint8) str[str_len++]) * 16777619U;
+	}
+
+	const uint32 font_face_id = m_font_desc.GetFontFaceID();
+	if (TBFontGlyphRun *run = m_glyph_cache->GetGlyphRun(key, font_face_id, str, str_len))
+	{
+		// Stamp the glyphs, since we skip the glyph lookup.
+		const uint32 now = g_renderer->GetPaintCount();
+		for (int i = 0; i < run->num_quads; i++)
+			m_glyph_cache->StampGlyph(run->quads[i].glyph, now);
+		return run;
+	}
+
+	// Create a new run. There can't be more glyphs than bytes.
+	TBFontGlyphRun *run = new TBFontGlyphRun(key, font_face_id, str, str_len, str_len);
+	const uint32 frag_generation = m_glyph_cache->GetFragGeneration();
+	int x = 0;
+	int i = 0;
+	while (i < str_len)
+	{
+		UCS4 cp = utf8::decode_next(str, &i, str_len);
+		if (cp == 0xFFFF)
+			continue;
+		if (TBFontGlyph *glyph = GetGlyph(cp, true))
+		{
+			if (glyph->frag)
+			{
+				run->quads[run->num_quads].x = x;
+				run->quads[run->num_quads].glyph = glyph;
+				run->num_quads++;
+			}
+			x += glyph->metrics.advance;
+		}
+	}
+
+	// If rendering the glyphs dropped any glyph fragment, it may be one in this run.
+	if (frag_generation != m_glyph_cache->GetFragGeneration())
+	{
+		delete run;
+		return nullptr;
+	}
+	return m_glyph_cache->CacheGlyphRun(run) ? run : nullptr;
+}
+
 void TBFontFace::DrawString(int x, int y, const TBColor &color, const char *str, int len)
 {
 	if (m_bgFont)
@@ -384,6 +598,24 @@ void TBFontFace::DrawString(int x, int y, const TBColor &color, const char *str,
 	if (m_font_renderer)
 		g_renderer->BeginBatchHint(TBRenderer::BATCH_HINT_DRAW_BITMAP_FRAGMENT);
 
+	// Draw the glyphs of the cached run if there is one.
+	if (TBFontGlyphRun *run = GetGlyphRun(str, len))
+	{
+		TB_PROFILER_COUNT(GLYPHS, run->num_quads);
+		for (int i = 0; i < run->num_quads; i++)
+		{
+			const TBFontGlyph *glyph = run->quads[i].glyph;
+			TBRect dst_rect(x + run->quads[i].x + glyph->metrics.x, y + glyph->metrics.y + GetAscent(), glyph->frag->Width(), glyph->frag->Height());
+			TBRect src_rect(0, 0, glyph->frag->Width(), glyph->frag->Height());
+			if (glyph->has_rgb)
+				g_renderer->DrawBitmap(dst_rect, src_rect, glyph->frag);
+			else
+				g_renderer->DrawBitmapColored(dst_rect, src_rect, color, glyph->frag);
+		}
+		g_renderer->EndBatchHint();
+		return;
+	}
+
 	int i = 0;
 	while (str[i] && i < len)
 	{
@@ -394,6 +626,7 @@ void TBFontFace::DrawString(int x, int y, const TBColor &color, const char *str,
 		{
 			if (glyph->frag)
 			{
+				TB_PROFILER_COUNT(GLYPHS, 1);
 				TBRect dst_rect(x + glyph->metrics.x, y + glyph->metrics.y + GetAscent(), glyph->frag->Width(), glyph->frag->Height());
 				TBRect src_rect(0, 0, glyph->frag->Width(), glyph->frag->Height());
 				if (glyph->has_rgb)
@@ -414,19 +647,39 @@ void TBFontFace::DrawString(int x, int y, const TBColor &color, const char *str,
 		g_renderer->EndBatchHint();
 }
 
+int TBFontFace::GetAdvanceAndCache(UCS4 cp, int index)
+{
+	if (!m_font_renderer) // This is the test font. Use same glyph width as height.
+	{
+		m_advance_cp[index] = cp;
+		m_advance[index] = m_metrics.height / 3 + 1;
+		return m_advance[index];
+	}
+	TBFontGlyph *glyph = GetGlyph(cp, false);
+	if (!glyph)
+		return 0;
+	// The glyph may be dropped from the glyph cache later, but its metrics never change.
+	m_advance_cp[index] = cp;
+	m_advance[index] = glyph->metrics.advance;
+	return m_advance[index];
+}
+
 int TBFontFace::GetStringWidth(const char *str, int len)
 {
 	int width = 0;
 	int i = 0;
 	while (str[i] && i < len)
 	{
-		UCS4 cp = utf8::decode_next(str, &i, len);
-		if (cp == 0xFFFF)
-			continue;
-		if (!m_font_renderer) // This is the test font. Use same glyph width as height.
-			width += m_metrics.height / 3 + 1;
-		else if (TBFontGlyph *glyph = GetGlyph(cp, false))
-			width += glyph->metrics.advance;
+		UCS4 cp = (unsigned char) str[i];
+		if (cp < 0x80)
+			i++; // ASCII needs no decoding
+		else
+		{
+			cp = utf8::decode_next(str, &i, len);
+			if (cp == 0xFFFF)
+				continue;
+		}
+		width += GetAdvance(cp);
 	}
 	return width;
 }
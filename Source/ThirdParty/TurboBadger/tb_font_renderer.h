@@ -79,9 +79,40 @@ public:
 	UCS4 cp;
 	TBGlyphMetrics metrics;		///< The glyph metrics.
 	TBBitmapFragment *frag;		///< The bitmap fragment, or nullptr if missing.
+	uint32 last_used;			///< The TBRenderer::GetPaintCount when it was last used.
 	bool has_rgb;				///< if true, drawing should ignore text color.
 };
 
+/** TBFontGlyphRun holds the glyphs of a string drawn by TBFontFace::DrawString, positioned
+	and ready to draw. When the same string is drawn again with the same font, the run is
+	drawn without decoding the string and looking up each glyph again.
+	A run is only valid as long as no glyph fragment has been dropped from the glyph cache
+	since it was created. */
+class TBFontGlyphRun : public TBLinkOf<TBFontGlyphRun>
+{
+public:
+	/** A glyph in the run, with its x position relative to the start of the string. */
+	struct Quad
+	{
+		int x;
+		TBFontGlyph *glyph;
+	};
+
+	TBFontGlyphRun(uint32 key, uint32 font_face_id, const char *str, int str_len, int num_quads);
+	~TBFontGlyphRun();
+
+	/** Return true if this run is for the given string and font face. */
+	bool Equals(uint32 font_face_id, const char *str, int str_len) const;
+
+	uint32 key;
+	uint32 font_face_id;
+	char *str;
+	int str_len;
+	Quad *quads;
+	int num_quads;
+	uint32 frag_generation;	///< The TBFontGlyphCache fragment generation it was created in.
+};
+
 /** TBFontGlyphCache caches glyphs for font faces.
 	Rendered glyphs use bitmap fragments from its fragment manager. */
 class TBFontGlyphCache : private TBRendererListener
@@ -96,10 +127,35 @@ public:
 	/** Create the glyph and put it in the cache. Returns the glyph, or nullptr on fail. */
 	TBFontGlyph *CreateAndCacheGlyph(const TBID &hash_id, UCS4 cp);
 
+	/** Stamp the glyph as used in the current paint (See TBRenderer::GetPaintCount). */
+	void StampGlyph(TBFontGlyph *glyph, uint32 paint_count);
+
+	/** Get the glyph run with the given key if it's still valid and is for the given
+		string and font face, or nullptr if it's not in the cache. */
+	TBFontGlyphRun *GetGlyphRun(uint32 key, uint32 font_face_id, const char *str, int str_len);
+
+	/** Put the glyph run in the cache, which takes ownership of it. This may drop the least
+		recently used runs. Returns false (and deletes the run) on fail. */
+	bool CacheGlyphRun(TBFontGlyphRun *run);
+
+	/** Return the fragment generation. It changes every time a glyph fragment is dropped,
+		which invalidates all glyph runs created before. */
+	uint32 GetFragGeneration() const { return m_frag_generation; }
+
 	/** Create a bitmap fragment for the given glyph and render data. This may drop other
 		rendered glyphs from the fragment map. Returns the fragment, or nullptr on fail. */
 	TBBitmapFragment *CreateFragment(TBFontGlyph *glyph, int w, int h, int stride, uint32 *data);
 
+	/** Create a bitmap fragment for the given glyph and 8bit alpha render data. Like CreateFragment,
+		but the fragment is put in a TB_BITMAP_FORMAT_A8 map. Should only be used if UseBitmapA8
+		returns true. */
+	TBBitmapFragment *CreateFragmentA8(TBFontGlyph *glyph, int w, int h, int stride, uint8 *data);
+
+	/** Return true if glyphs without color (See TBFontGlyph::has_rgb) should be put in a
+		TB_BITMAP_FORMAT_A8 map using CreateFragmentA8, instead of being converted to 32bit.
+		This is the case if the renderer supports it (See TBRenderer::SupportsBitmapA8). */
+	bool UseBitmapA8() const;
+
 #ifdef TB_RUNTIME_DEBUG_INFO
 	/** Render the glyph bitmaps on screen, to analyze fragment positioning. */
 	void Debug();
@@ -109,10 +165,19 @@ public:
 	virtual void OnContextLost();
 	virtual void OnContextRestored();
 private:
+	TBBitmapFragment *CreateFragmentInternal(TBFontGlyph *glyph, int w, int h, int stride, uint32 *data32, uint8 *data8);
+	TBBitmapFragmentManager *GetFragmentManager(TB_BITMAP_FORMAT format);
+	TBFontGlyph *GetLeastRecentlyUsedGlyph(TB_BITMAP_FORMAT format, int min_w, int min_h);
 	void DropGlyphFragment(TBFontGlyph *glyph);
+	void DeleteGlyphRun(TBFontGlyphRun *run);
 	TBBitmapFragmentManager m_frag_manager;
+	TBBitmapFragmentManager m_frag_manager_a8;
 	TBHashTableAutoDeleteOf<TBFontGlyph> m_glyphs;
-	TBLinkListOf<TBFontGlyph> m_all_rendered_glyphs;
+	TBLinkListOf<TBFontGlyph> m_all_rendered_glyphs;	///< All glyphs with a fragment, least recently used first.
+	TBHashTableAutoDeleteOf<TBFontGlyphRun> m_glyph_runs;
+	TBLinkListOf<TBFontGlyphRun> m_all_glyph_runs;		///< All glyph runs, least recently used first.
+	int m_num_glyph_runs;
+	uint32 m_frag_generation;
 };
 
 /** TBFontEffect applies an effect on each glyph that is rendered in a TBFontFace. */
@@ -183,7 +248,14 @@ public:
 	void SetBackgroundFont(TBFontFace *font, const TBColor &col, int xofs, int yofs);
 private:
 	TBID GetHashId(UCS4 cp) const;
+	int GetAdvance(UCS4 cp)
+	{
+		int index = cp < 0x80 ? cp : 0x80 + (cp & 0x7F);
+		return m_advance_cp[index] == cp ? m_advance[index] : GetAdvanceAndCache(cp, index);
+	}
+	int GetAdvanceAndCache(UCS4 cp, int index);
 	TBFontGlyph *GetGlyph(UCS4 cp, bool render_if_needed);
+	TBFontGlyphRun *GetGlyphRun(const char *str, int len);
 	TBFontGlyph *CreateAndCacheGlyph(UCS4 cp);
 	void RenderGlyph(TBFontGlyph *glyph);
 	TBFontGlyphCache *m_glyph_cache;
@@ -193,6 +265,11 @@ private:
 	TBFontEffect m_effect;
 	TBTempBuffer m_temp_buffer;
 
+	// The advance of characters, so GetStringWidth doesn't have to look up glyphs. ASCII has
+	// one entry each. Other characters share the second half, indexed by their low bits.
+	UCS4 m_advance_cp[256];
+	int16 m_advance[256];
+
 	TBFontFace *m_bgFont;
 	int m_bgX;
 	int m_bgY;
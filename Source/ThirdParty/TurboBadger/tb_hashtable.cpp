@@ -9,16 +9,19 @@
 
 namespace tb {
 
-//FIX: reduce memory (block allocation of ITEM)
 //FIX: should shrink when deleting single items (but not when adding items!)
-//FIX: should grow when about 70% full instead of 100%
+
+/** The max percentage of buckets that may be used before growing. Linear probing gets
+	slow if there is not enough empty buckets. */
+#define TB_HASH_TABLE_MAX_LOAD 70
 
 // == TBHashTable =======================================================================
 
 TBHashTable::TBHashTable()
-	: m_buckets(0)
+	: m_buckets(nullptr)
 	, m_num_buckets(0)
 	, m_num_items(0)
+	, m_hash_shift(32)
 {
 }
 
@@ -32,121 +35,127 @@ void TBHashTable::RemoveAll(bool delete_content)
 #ifdef TB_RUNTIME_DEBUG_INFO
 	//Debug();
 #endif
-	for (uint32 i = 0; i < m_num_buckets; i++)
+	if (delete_content)
 	{
-		ITEM *item = m_buckets[i];
-		while (item)
-		{
-			ITEM *item_next = item->next;
-			if (delete_content)
-				DeleteContent(item->content);
-			delete item;
-			item = item_next;
-		}
+		for (uint32 i = 0; i < m_num_buckets; i++)
+			if (m_buckets[i].content)
+				DeleteContent(m_buckets[i].content);
 	}
 	delete [] m_buckets;
 	m_buckets = nullptr;
 	m_num_buckets = m_num_items = 0;
+	m_hash_shift = 32;
 }
 
 bool TBHashTable::Rehash(uint32 new_num_buckets)
 {
-	if (new_num_buckets == m_num_buckets)
-		return true;
-	if (ITEM **new_buckets = new ITEM*[new_num_buckets])
+	// Round up to a power of two, that is large enough for all items.
+	uint32 num_buckets = 16, hash_shift = 28;
+	while (num_buckets < new_num_buckets || m_num_items * 100 >= num_buckets * TB_HASH_TABLE_MAX_LOAD)
 	{
-		memset(new_buckets, 0, sizeof(ITEM*) * new_num_buckets);
-		// Rehash all items into the new buckets
-		for (uint32 i = 0; i < m_num_buckets; i++)
-		{
-			ITEM *item = m_buckets[i];
-			while (item)
-			{
-				ITEM *item_next = item->next;
-				// Add it to new_buckets
-				uint32 bucket = item->key & (new_num_buckets - 1);
-				item->next = new_buckets[bucket];
-				new_buckets[bucket] = item;
-				item = item_next;
-			}
-		}
-		// Delete old buckets and update
-		delete [] m_buckets;
-		m_buckets = new_buckets;
-		m_num_buckets = new_num_buckets;
+		num_buckets *= 2;
+		hash_shift--;
+	}
+	if (num_buckets == m_num_buckets)
 		return true;
+	ITEM *new_buckets = new ITEM[num_buckets];
+	if (!new_buckets)
+		return false;
+	memset(new_buckets, 0, sizeof(ITEM) * num_buckets);
+
+	ITEM *old_buckets = m_buckets;
+	uint32 old_num_buckets = m_num_buckets;
+	m_buckets = new_buckets;
+	m_num_buckets = num_buckets;
+	m_hash_shift = hash_shift;
+
+	// Rehash all items into the new buckets
+	for (uint32 i = 0; i < old_num_buckets; i++)
+	{
+		if (!old_buckets[i].content)
+			continue;
+		uint32 bucket = GetHomeBucket(old_buckets[i].key);
+		while (m_buckets[bucket].content)
+			bucket = (bucket + 1) & (m_num_buckets - 1);
+		m_buckets[bucket] = old_buckets[i];
 	}
-	return false;
+	delete [] old_buckets;
+	return true;
 }
 
 bool TBHashTable::NeedRehash() const
 {
-	// Grow if more items than buckets
-	return !m_num_buckets || m_num_items >= m_num_buckets;
+	// Grow if adding one more item would exceed the max load
+	return (m_num_items + 1) * 100 > m_num_buckets * TB_HASH_TABLE_MAX_LOAD;
 }
 
 uint32 TBHashTable::GetSuitableBucketsCount() const
 {
-	// As long as we use FNV for TBID (in TBGetHash), power of two hash sizes are the best.
-	if (!m_num_items)
-		return 16;
-	return m_num_items * 2;
+	// Twice the number of buckets needed, so we don't rehash again soon.
+	// Rehash makes sure it's a power of two.
+	return (m_num_items + 1) * 200 / TB_HASH_TABLE_MAX_LOAD;
 }
 
 void *TBHashTable::Get(uint32 key) const
 {
 	if (!m_num_buckets)
 		return nullptr;
-	uint32 bucket = key & (m_num_buckets - 1);
-	ITEM *item = m_buckets[bucket];
-	while (item)
+	// Step from the home bucket until we find the key or an empty bucket.
+	uint32 bucket = GetHomeBucket(key);
+	while (m_buckets[bucket].content)
 	{
-		if (item->key == key)
-			return item->content;
-		item = item->next;
+		if (m_buckets[bucket].key == key)
+			return m_buckets[bucket].content;
+		bucket = (bucket + 1) & (m_num_buckets - 1);
 	}
 	return nullptr;
 }
 
 bool TBHashTable::Add(uint32 key, void *content)
 {
+	assert(content);
 	if (NeedRehash() && !Rehash(GetSuitableBucketsCount()))
 		return false;
 	assert(!Get(key));
-	if (ITEM *item = new ITEM)
-	{
-		uint32 bucket = key & (m_num_buckets - 1);
-		item->key = key;
-		item->content = content;
-		item->next = m_buckets[bucket];
-		m_buckets[bucket] = item;
-		m_num_items++;
-		return true;
-	}
-	return false;
+	uint32 bucket = GetHomeBucket(key);
+	while (m_buckets[bucket].content)
+		bucket = (bucket + 1) & (m_num_buckets - 1);
+	m_buckets[bucket].key = key;
+	m_buckets[bucket].content = content;
+	m_num_items++;
+	return true;
 }
 
 void *TBHashTable::Remove(uint32 key)
 {
 	if (!m_num_buckets)
 		return nullptr;
-	uint32 bucket = key & (m_num_buckets - 1);
-	ITEM *item = m_buckets[bucket];
-	ITEM *prev_item = nullptr;
-	while (item)
+	const uint32 mask = m_num_buckets - 1;
+	uint32 bucket = GetHomeBucket(key);
+	while (m_buckets[bucket].content)
 	{
-		if (item->key == key)
+		if (m_buckets[bucket].key == key)
 		{
-			if (prev_item)
-				prev_item->next = item->next;
-			else
-				m_buckets[bucket] = item->next;
-			void *content = item->content;
-			delete item;
+			void *content = m_buckets[bucket].content;
+
+			// Move back the items after it that can't be found if there's an empty
+			// bucket here. That is items that are not between their home bucket and
+			// the empty bucket.
+			uint32 empty = bucket;
+			for (uint32 i = (bucket + 1) & mask; m_buckets[i].content; i = (i + 1) & mask)
+			{
+				uint32 home = GetHomeBucket(m_buckets[i].key);
+				if (((i - home) & mask) >= ((i - empty) & mask))
+				{
+					m_buckets[empty] = m_buckets[i];
+					empty = i;
+				}
+			}
+			m_buckets[empty].content = nullptr;
+			m_num_items--;
 			return content;
 		}
-		prev_item = item;
-		item = item->next;
+		bucket = (bucket + 1) & mask;
 	}
 	assert(!"This hash table didn't contain the given key!");
 	return nullptr;
@@ -161,23 +170,22 @@ void TBHashTable::Delete(uint32 key)
 
 void TBHashTable::Debug()
 {
+	// Print the number of steps from the home bucket for each item.
 	TBTempBuffer line;
 	line.AppendString("Hash table: ");
-	int total_count = 0;
+	uint32 max_distance = 0, total_distance = 0;
 	for (uint32 i = 0; i < m_num_buckets; i++)
 	{
-		int count = 0;
-		ITEM *item = m_buckets[i];
-		while (item)
-		{
-			count++;
-			item = item->next;
-		}
-		TBStr tmp; tmp.SetFormatted("%d ", count);
+		if (!m_buckets[i].content)
+			continue;
+		uint32 distance = (i - GetHomeBucket(m_buckets[i].key)) & (m_num_buckets - 1);
+		max_distance = MAX(max_distance, distance);
+		total_distance += distance;
+		TBStr tmp; tmp.SetFormatted("%d ", distance);
 		line.AppendString(tmp);
-		total_count += count;
 	}
-	TBStr tmp; tmp.SetFormatted(" (total: %d of %d buckets)\n", total_count, m_num_buckets);
+	TBStr tmp; tmp.SetFormatted(" (total: %d of %d buckets, max distance %d, average %.2f)\n", m_num_items, m_num_buckets,
+								max_distance, m_num_items ? (float) total_distance / m_num_items : 0.f);
 	line.AppendString(tmp);
 	TBDebugOut(line.GetData());
 }
@@ -189,31 +197,17 @@ void TBHashTable::Debug()
 TBHashTableIterator::TBHashTableIterator(TBHashTable *hash_table)
 	: m_hash_table(hash_table)
 	, m_current_bucket(0)
-	, m_current_item(nullptr)
 {
 }
 
 void *TBHashTableIterator::GetNextContent()
 {
-	if (m_current_bucket == m_hash_table->m_num_buckets)
-		return nullptr;
-	if (m_current_item && m_current_item->next)
-		m_current_item = m_current_item->next;
-	else
+	while (m_current_bucket < m_hash_table->m_num_buckets)
 	{
-		if (m_current_item)
-			m_current_bucket++;
-		if (m_current_bucket == m_hash_table->m_num_buckets)
-			return nullptr;
-		while (m_current_bucket < m_hash_table->m_num_buckets)
-		{
-			m_current_item = m_hash_table->m_buckets[m_current_bucket];
-			if (m_current_item)
-				break;
-			m_current_bucket++;
-		}
+		if (void *content = m_hash_table->m_buckets[m_current_bucket++].content)
+			return content;
 	}
-	return m_current_item ? m_current_item->content : nullptr;
+	return nullptr;
 }
 
 }; // namespace tb
@@ -11,7 +11,11 @@
 
 namespace tb {
 
-/** TBHashTable is a minimal hash table, for hashing anything using a uint32 key. */
+/** TBHashTable is a minimal hash table, for hashing anything using a uint32 key.
+
+	It uses open addressing with linear probing. The key and content are stored
+	directly in the bucket array, so there is no allocation per item and looking up
+	a key doesn't need to follow any pointers. The content must not be nullptr. */
 
 class TBHashTable
 {
@@ -40,7 +44,8 @@ public:
 	/** Delete the content with the given key. */
 	void Delete(uint32 key);
 
-	/** Rehash the table so use the given number of buckets.
+	/** Rehash the table so use the given number of buckets. It's rounded up to a power
+		of two, large enough for the current number of items.
 		Returns false if out of memory. */
 	bool Rehash(uint32 num_buckets);
 
@@ -63,17 +68,20 @@ protected:
 private:
 	friend class TBHashTableIterator;
 	void RemoveAll(bool delete_content);
+	/** Get the bucket where a key should be stored if it's not occupied by another key.
+		The key is scrambled, since keys may differ only in the high bits. */
+	uint32 GetHomeBucket(uint32 key) const { return (key * 2654435769U) >> m_hash_shift; }
 	struct ITEM {
 		uint32 key;
-		ITEM *next;
-		void *content;
-	} **m_buckets;
+		void *content; ///< nullptr if the bucket is empty.
+	} *m_buckets;
 	uint32 m_num_buckets;
 	uint32 m_num_items;
+	uint32 m_hash_shift;	///< 32 - log2(m_num_buckets)
 };
 
-/** TBHashTableIterator is a iterator for stepping through all content stored in a TBHashTable. */
-//FIX: make it safe in case the current item is removed from the hashtable
+/** TBHashTableIterator is a iterator for stepping through all content stored in a TBHashTable.
+	Items must not be added or removed while iterating. */
 class TBHashTableIterator
 {
 public:
@@ -82,7 +90,6 @@ public:
 private:
 	TBHashTable *m_hash_table;
 	uint32 m_current_bucket;
-	TBHashTable::ITEM *m_current_item;
 };
 
 /** TBHashTableIteratorOf is a TBHashTableIterator which auto cast to the class type. */
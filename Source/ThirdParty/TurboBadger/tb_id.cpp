@@ -40,6 +40,11 @@ void TBID::Set(const TBID &newid)
 	{
 		if (TBID *other_id = all_id_hash.Get(id))
 		{
+			// Either id may have been set from a uint32 and have no string.
+			if (debug_string.IsEmpty())
+				debug_string.Set(other_id->debug_string);
+			else if (other_id->debug_string.IsEmpty())
+				other_id->debug_string.Set(debug_string);
 			// If this happens, 2 different strings result in the same hash.
 			// It might be a good idea to change one of them, but it might not matter.
 			assert(other_id->debug_string.Equals(debug_string));
@@ -61,6 +66,10 @@ void TBID::Set(const char *string)
 	{
 		if (TBID *other_id = all_id_hash.Get(id))
 		{
+			// An id that was first set from a uint32 (f.ex loaded from a
+			// baked atlas) has no string yet, so there's nothing to compare.
+			if (other_id->debug_string.IsEmpty())
+				other_id->debug_string.Set(debug_string);
 			assert(other_id->debug_string.Equals(debug_string));
 		}
 		else
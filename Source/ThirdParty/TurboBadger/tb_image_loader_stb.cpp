@@ -31,6 +31,10 @@ namespace tb {
 
 #pragma GCC diagnostic pop
 
+// stb image initializes its zlib tables lazily on first use. Do it up front instead,
+// so skin bitmaps can be decoded on multiple threads (see TB_SKIN_ASYNC_THREADS).
+static struct STBI_InitZDefaults { STBI_InitZDefaults() { stbi__init_zdefaults(); } } stbi_init_zdefaults;
+
 class STBI_Loader : public TBImageLoader
 {
 public:
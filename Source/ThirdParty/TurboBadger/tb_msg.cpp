@@ -5,12 +5,121 @@
 
 #include "tb_msg.h"
 #include "tb_system.h"
+#include "tb_list.h"
 #include <stddef.h>
 
 namespace tb {
 
-/** List of all delayed messages */
-TBLinkListOf<TBMessageLink> g_all_delayed_messages;
+// == TBMessageHeap =====================================================================
+
+/** TBMessageHeap is a binary min heap of delayed messages, ordered by fire time.
+	Messages with the same fire time are ordered by the order they were posted.
+	Each message knows its own index in the heap, so adding or removing any
+	message is O(log n) and getting the first message is O(1). */
+class TBMessageHeap
+{
+public:
+	TBMessageHeap() : m_next_sequence(0) {}
+
+	bool Add(TBMessage *msg);
+	void Remove(TBMessage *msg);
+
+	/** Get the message that should fire first, or nullptr. */
+	TBMessage *GetFirst() const { return m_heap.GetNumItems() ? m_heap.Get(0) : nullptr; }
+
+	bool Contains(TBMessage *msg) const { return msg->heap_index >= 0; }
+
+	/** Get the sequence number the next added message will get. */
+	uint32 GetNextSequence() const { return m_next_sequence; }
+
+	/** Return true if msg was added before the message that got sequence. */
+	static bool IsAddedBefore(TBMessage *msg, uint32 sequence) { return (int32)(msg->sequence - sequence) < 0; }
+private:
+	static bool IsEarlier(TBMessage *a, TBMessage *b);
+	void Place(TBMessage *msg, int index);
+	void SiftUp(int index);
+	void SiftDown(int index);
+	TBListOf<TBMessage> m_heap;
+	uint32 m_next_sequence;
+};
+
+bool TBMessageHeap::IsEarlier(TBMessage *a, TBMessage *b)
+{
+	if (a->fire_time_ms != b->fire_time_ms)
+		return a->fire_time_ms < b->fire_time_ms;
+	// Compare the difference, so it works when the sequence wraps around.
+	return IsAddedBefore(a, b->sequence);
+}
+
+void TBMessageHeap::Place(TBMessage *msg, int index)
+{
+	m_heap.Set(msg, index);
+	msg->heap_index = index;
+}
+
+void TBMessageHeap::SiftUp(int index)
+{
+	TBMessage *msg = m_heap.Get(index);
+	while (index > 0)
+	{
+		int parent = (index - 1) / 2;
+		TBMessage *parent_msg = m_heap.Get(parent);
+		if (!IsEarlier(msg, parent_msg))
+			break;
+		Place(parent_msg, index);
+		index = parent;
+	}
+	Place(msg, index);
+}
+
+void TBMessageHeap::SiftDown(int index)
+{
+	int num = m_heap.GetNumItems();
+	TBMessage *msg = m_heap.Get(index);
+	while (true)
+	{
+		int child = index * 2 + 1;
+		if (child >= num)
+			break;
+		if (child + 1 < num && IsEarlier(m_heap.Get(child + 1), m_heap.Get(child)))
+			child++;
+		TBMessage *child_msg = m_heap.Get(child);
+		if (!IsEarlier(child_msg, msg))
+			break;
+		Place(child_msg, index);
+		index = child;
+	}
+	Place(msg, index);
+}
+
+bool TBMessageHeap::Add(TBMessage *msg)
+{
+	assert(!Contains(msg));
+	if (!m_heap.Add(msg))
+		return false;
+	msg->sequence = m_next_sequence++;
+	SiftUp(m_heap.GetNumItems() - 1);
+	return true;
+}
+
+void TBMessageHeap::Remove(TBMessage *msg)
+{
+	assert(Contains(msg) && m_heap.Get(msg->heap_index) == msg);
+	int index = msg->heap_index;
+	msg->heap_index = -1;
+
+	// Move the last message into the hole, and restore the heap from there.
+	TBMessage *last = m_heap.Remove(m_heap.GetNumItems() - 1);
+	if (last != msg)
+	{
+		Place(last, index);
+		SiftUp(index);
+		SiftDown(last->heap_index);
+	}
+}
+
+/** Heap of all delayed messages */
+TBMessageHeap g_all_delayed_messages;
 
 /** List of all nondelayed messages. */
 TBLinkListOf<TBMessageLink> g_all_normal_messages;
@@ -18,7 +127,7 @@ TBLinkListOf<TBMessageLink> g_all_normal_messages;
 // == TBMessage =========================================================================
 
 TBMessage::TBMessage(TBID message, TBMessageData *data, double fire_time_ms, TBMessageHandler *mh)
-	: message(message), data(data), fire_time_ms(fire_time_ms), mh(mh)
+	: message(message), data(data), fire_time_ms(fire_time_ms), mh(mh), heap_index(-1), sequence(0)
 {
 }
 
@@ -47,32 +156,13 @@ bool TBMessageHandler::PostMessageOnTime(TBID message, TBMessageData *data, doub
 {
 	if (TBMessage *msg = new TBMessage(message, data, fire_time, this))
 	{
-		// Find the message that is already in the list that should fire later, so we can
-		// insert msg just before that. (Always keep the list ordered after fire time)
-
-		// NOTE: If another message is added during OnMessageReceived, it might or might not be fired
-		// in the right order compared to other delayed messages, depending on if it's inserted before or
-		// after the message being processed!
-
-		TBMessage *later_msg = nullptr;
-		TBMessageLink *link = g_all_delayed_messages.GetFirst();
-		while (link)
+		// Add it to the global heap, which keeps it ordered after fire time.
+		if (!g_all_delayed_messages.Add(msg))
 		{
-			TBMessage *msg_in_list = static_cast<TBMessage*>(link);
-			if (msg_in_list->fire_time_ms > msg->fire_time_ms)
-			{
-				later_msg = msg_in_list;
-				break;
-			}
-			link = link->GetNext();
+			delete msg;
+			return false;
 		}
 
-		// Add it to the global list in the right order.
-		if (later_msg)
-			g_all_delayed_messages.AddBefore(msg, later_msg);
-		else
-			g_all_delayed_messages.AddLast(msg);
-
 		// Add it to the list in messagehandler.
 		m_messages.AddLast(msg);
 
@@ -115,7 +205,7 @@ void TBMessageHandler::DeleteMessage(TBMessage *msg)
 	assert(msg->mh == this); // This is not the message handler owning the message!
 
 	// Remove from global list (g_all_delayed_messages or g_all_normal_messages)
-	if (g_all_delayed_messages.ContainsLink(msg))
+	if (g_all_delayed_messages.Contains(msg))
 		g_all_delayed_messages.Remove(msg);
 	else if (g_all_normal_messages.ContainsLink(msg))
 		g_all_normal_messages.Remove(msg);
@@ -138,27 +228,31 @@ void TBMessageHandler::DeleteAllMessages()
 //static
 void TBMessageHandler::ProcessMessages()
 {
-	// Handle delayed messages
-	TBLinkListOf<TBMessageLink>::Iterator iter = g_all_delayed_messages.IterateForward();
-	while (TBMessage *msg = static_cast<TBMessage*>(iter.GetAndStep()))
+	// Handle delayed messages that were due and posted when we started. Messages
+	// posted during OnMessageReceived wait for the next call, even if they're
+	// already due. Otherwise a handler that reposts with no delay would never
+	// let us return.
+	const double now_ms = TBSystem::GetTimeMS();
+	const uint32 end_sequence = g_all_delayed_messages.GetNextSequence();
+	while (TBMessage *msg = g_all_delayed_messages.GetFirst())
 	{
-		if (TBSystem::GetTimeMS() >= msg->fire_time_ms)
-		{
-			// Remove from global list
-			g_all_delayed_messages.Remove(msg);
-			// Remove from local list
-			msg->mh->m_messages.Remove(msg);
+		if (now_ms < msg->fire_time_ms)
+			break; // The first message fires first, so all remaining messages should fire later
+		if (!TBMessageHeap::IsAddedBefore(msg, end_sequence))
+			break; // Posted during this call. Any older due messages after it fire next call.
 
-			msg->mh->OnMessageReceived(msg);
+		// Remove from global list
+		g_all_delayed_messages.Remove(msg);
+		// Remove from local list
+		msg->mh->m_messages.Remove(msg);
 
-			delete msg;
-		}
-		else
-			break; // Since the list is sorted, all remaining messages should fire later
+		msg->mh->OnMessageReceived(msg);
+
+		delete msg;
 	}
 
 	// Handle normal messages
-	iter = g_all_normal_messages.IterateForward();
+	TBLinkListOf<TBMessageLink>::Iterator iter = g_all_normal_messages.IterateForward();
 	while (TBMessage *msg = static_cast<TBMessage*>(iter.GetAndStep()))
 	{
 		// Remove from global list
@@ -178,11 +272,8 @@ double TBMessageHandler::GetNextMessageFireTime()
 	if (g_all_normal_messages.GetFirst())
 		return 0;
 
-	if (g_all_delayed_messages.GetFirst())
-	{
-		TBMessage *first_delayed_msg = static_cast<TBMessage*>(g_all_delayed_messages.GetFirst());
+	if (TBMessage *first_delayed_msg = g_all_delayed_messages.GetFirst())
 		return first_delayed_msg->fire_time_ms;
-	}
 
 	return TB_NOT_SOON;
 }
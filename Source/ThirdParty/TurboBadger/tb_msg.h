@@ -37,7 +37,7 @@ public:
 
 /** TBMessageLink should never be created or subclassed anywhere except in TBMessage.
 	It's only purpose is to add a extra typed link for TBMessage, since it needs to be
-	added in multiple lists. */
+	added in multiple lists. Delayed messages are kept in a heap instead. */
 class TBMessageLink : public TBLinkOf<TBMessageLink> { };
 
 /** TBMessage is a message created and owned by TBMessageHandler.
@@ -59,8 +59,11 @@ public:
 
 private:
 	friend class TBMessageHandler;
+	friend class TBMessageHeap;
 	double fire_time_ms;
 	TBMessageHandler *mh;
+	int heap_index;		///< Index in the delayed message heap, or -1 if not delayed.
+	uint32 sequence;	///< Post order, to fire delayed messages with the same time in order.
 };
 
 /** TBMessageHandler handles a list of pending messages posted to itself.
@@ -14,6 +14,88 @@
 
 namespace tb {
 
+// == TBNodeArena ========================================================================
+
+/** Size of each arena block. Allocations that don't fit get their own block. */
+#define TB_NODE_ARENA_BLOCK_SIZE (16 * 1024)
+
+TBNodeArena::~TBNodeArena()
+{
+	while (BLOCK *block = m_blocks)
+	{
+		m_blocks = block->next;
+		free(block);
+	}
+}
+
+void *TBNodeArena::Alloc(int size)
+{
+	size = (size + 7) & ~7;
+	if (m_end - m_pos < size)
+	{
+		int block_size = MAX(size + (int) sizeof(BLOCK), TB_NODE_ARENA_BLOCK_SIZE);
+		BLOCK *block = (BLOCK *) malloc(block_size);
+		if (!block)
+			return nullptr;
+		block->next = m_blocks;
+		m_blocks = block;
+		m_pos = (char *) (block + 1);
+		m_end = (char *) block + block_size;
+	}
+	void *ptr = m_pos;
+	m_pos += size;
+	return ptr;
+}
+
+char *TBNodeArena::AllocString(const char *str, int len)
+{
+	char *copy = (char *) Alloc(len + 1);
+	if (copy)
+	{
+		memcpy(copy, str, len);
+		copy[len] = 0;
+	}
+	return copy;
+}
+
+// == TBNode ============================================================================
+
+/** Header before each node allocation, so operator delete knows if it's from an arena.
+	It's as big as the node alignment, so the node after it is aligned. */
+union TBNodeAllocHeader
+{
+	bool in_arena;
+	void *align_ptr;
+	double align_double;
+};
+
+void *TBNode::operator new(size_t size) noexcept
+{
+	TBNodeAllocHeader *header = (TBNodeAllocHeader *) malloc(sizeof(TBNodeAllocHeader) + size);
+	if (!header)
+		return nullptr;
+	header->in_arena = false;
+	return header + 1;
+}
+
+void *TBNode::operator new(size_t size, TBNodeArena *arena) noexcept
+{
+	TBNodeAllocHeader *header = (TBNodeAllocHeader *) arena->Alloc(sizeof(TBNodeAllocHeader) + size);
+	if (!header)
+		return nullptr;
+	header->in_arena = true;
+	return header + 1;
+}
+
+void TBNode::operator delete(void *ptr)
+{
+	if (!ptr)
+		return;
+	TBNodeAllocHeader *header = (TBNodeAllocHeader *) ptr - 1;
+	if (!header->in_arena)
+		free(header);
+}
+
 TBNode::~TBNode()
 {
 	Clear();
@@ -45,6 +127,19 @@ TBNode *TBNode::Create(const char *name, int name_len)
 	return n;
 }
 
+// static
+TBNode *TBNode::Create(const char *name, TBNodeArena *arena)
+{
+	TBNode *n = new (arena) TBNode;
+	if (!n || !(n->m_name = arena->AllocString(name, strlen(name))))
+	{
+		delete n;
+		return nullptr;
+	}
+	n->m_name_in_arena = true;
+	return n;
+}
+
 //static
 const char *TBNode::GetNextNodeSeparator(const char *request)
 {
@@ -82,14 +177,65 @@ TBNode *TBNode::GetNodeFollowRef(const char *request, GET_MISS_POLICY mp)
 	return node;
 }
 
+/** Build the child index when a lookup has to compare this many children. */
+#define TB_NODE_CHILD_INDEX_THRESHOLD 16
+
+/** FNV-1a hash of a name that isn't null terminated, for the child index. */
+static uint32 GetNameHash(const char *name, int name_len)
+{
+	uint32 hash = 2166136261U;
+	for (int i = 0; i < name_len; i++)
+		hash = (hash ^ (uint8) name[i]) * 16777619U;
+	return hash;
+}
+
+static inline bool NameEquals(const char *node_name, const char *name, int name_len)
+{
+	return strncmp(node_name, name, name_len) == 0 && node_name[name_len] == 0;
+}
+
 TBNode *TBNode::GetNodeInternal(const char *name, int name_len) const
 {
-	for (TBNode *n = GetFirstChild(); n; n = n->GetNext())
+	if (m_child_index)
 	{
-		if (strncmp(n->m_name, name, name_len) == 0 && n->m_name[name_len] == 0)
+		// The index only has the first node with each hash, so names with the same
+		// hash as another name must be searched for the normal way.
+		TBNode *n = m_child_index->Get(GetNameHash(name, name_len));
+		if (!n || NameEquals(n->m_name, name, name_len))
 			return n;
 	}
-	return nullptr;
+	TBNode *found = nullptr;
+	int num_compared = 0;
+	for (TBNode *n = GetFirstChild(); n; n = n->GetNext())
+	{
+		num_compared++;
+		if (NameEquals(n->m_name, name, name_len))
+		{
+			found = n;
+			break;
+		}
+	}
+	if (!m_child_index && num_compared > TB_NODE_CHILD_INDEX_THRESHOLD)
+		BuildChildIndex();
+	return found;
+}
+
+void TBNode::BuildChildIndex() const
+{
+	// This is only an optimization, so it's fine if it fails.
+	m_child_index = new TBHashTableOf<TBNode>;
+	if (!m_child_index)
+		return;
+	for (TBNode *n = GetFirstChild(); n; n = n->GetNext())
+	{
+		uint32 hash = GetNameHash(n->m_name, strlen(n->m_name));
+		if (!m_child_index->Get(hash) && !m_child_index->Add(hash, n))
+		{
+			delete m_child_index;
+			m_child_index = nullptr;
+			return;
+		}
+	}
 }
 
 bool TBNode::CloneChildren(TBNode *source)
@@ -152,58 +298,59 @@ const char *TBNode::GetValueStringRaw(const char *request, const char *def)
 	return n ? n->m_value.GetString() : def;
 }
 
-class FileParser : public TBParserStream
+/** Files at least this big are mapped instead of read, if TBFile supports it. For smaller
+	files, mapping them costs more than reading them. */
+#define TB_NODE_MAP_FILE_MIN_SIZE (64 * 1024)
+
+class FileParser
 {
 public:
 	bool Read(const char *filename, TBParserTarget *target)
 	{
-		f = TBFile::Open(filename, TBFile::MODE_READ);
+		TBFile *f = TBFile::Open(filename, TBFile::MODE_READ);
 		if (!f)
 			return false;
+
+		// Get all data in one buffer, so it can be parsed in place.
+		TBTempBuffer buf;
+		long size = f->Size();
+		char *data = nullptr;
+		if (size >= TB_NODE_MAP_FILE_MIN_SIZE && size < 0x7fffffff)
+			data = f->Map();
+		if (!data && size >= 0 && size < 0x7fffffff && buf.Reserve((int) size + 1) &&
+			f->Read(buf.GetData(), 1, size) == (size_t) size)
+			data = buf.GetData();
+
 		TBParser p;
-		TBParser::STATUS status = p.Read(this, target);
+		TBParser::STATUS status = data ? p.Read(data, (int) size, target) : TBParser::STATUS_OUT_OF_MEMORY;
 		delete f;
 		return status == TBParser::STATUS_OK ? true : false;
 	}
-	virtual int GetMoreData(char *buf, int buf_len)
-	{
-		return f->Read(buf, 1, buf_len);
-	}
-private:
-	TBFile *f;
 };
 
-class DataParser : public TBParserStream
+class DataParser
 {
 public:
 	bool Read(const char *data, int data_len, TBParserTarget *target)
 	{
-		m_data = data;
-		m_data_len = data_len;
+		// Copy all data at once, so it can be parsed in place.
+		TBTempBuffer buf;
+		if (!buf.Append(data, data_len))
+			return false;
 		TBParser p;
-		TBParser::STATUS status = p.Read(this, target);
+		TBParser::STATUS status = p.Read(buf.GetData(), data_len, target);
 		return status == TBParser::STATUS_OK ? true : false;
 	}
-	virtual int GetMoreData(char *buf, int buf_len)
-	{
-		int consume = MIN(buf_len, m_data_len);
-		memcpy(buf, m_data, consume);
-		m_data += consume;
-		m_data_len -= consume;
-		return consume;
-	}
-private:
-	const char *m_data;
-	int m_data_len;
 };
 
 class TBNodeTarget : public TBParserTarget
 {
 public:
-	TBNodeTarget(TBNode *root, const char *filename)
+	TBNodeTarget(TBNode *root, const char *filename, TBNodeArena *arena)
 	{
 		m_root_node = m_target_node = root;
 		m_filename = filename;
+		m_arena = arena;
 	}
 	virtual void OnError(int line_nr, const char *error)
 	{
@@ -224,9 +371,16 @@ public:
 			IncludeFile(line_nr, value.GetString());
 		else if (strcmp(name, "@include") == 0)
 			IncludeRef(line_nr, value.GetString());
-		else if (TBNode *n = TBNode::Create(name))
+		else if (TBNode *n = m_arena ? TBNode::Create(name, m_arena) : TBNode::Create(name))
 		{
-			n->m_value.TakeOver(value);
+			// Copy strings to the arena too, and let the value refer to them.
+			char *arena_str = nullptr;
+			if (m_arena && value.IsString())
+				arena_str = m_arena->AllocString(value.GetString(), strlen(value.GetString()));
+			if (arena_str)
+				n->m_value.SetString(arena_str, TBValue::SET_AS_STATIC);
+			else
+				n->m_value.TakeOver(value);
 			m_target_node->Add(n);
 		}
 	}
@@ -249,7 +403,7 @@ public:
 		include_filename.AppendPath(m_filename);
 		include_filename.AppendString(filename);
 		TBNode content;
-		if (content.ReadFile(include_filename.GetData()))
+		if (content.ReadFileInternal(include_filename.GetData(), m_arena))
 		{
 			while (TBNode *content_n = content.GetFirstChild())
 			{
@@ -302,14 +456,20 @@ private:
 	TBNode *m_root_node;
 	TBNode *m_target_node;
 	const char *m_filename;
+	TBNodeArena *m_arena;
 };
 
 bool TBNode::ReadFile(const char *filename, TB_NODE_READ_FLAGS flags)
 {
 	if (!(flags & TB_NODE_READ_FLAGS_APPEND))
 		Clear();
+	return ReadFileInternal(filename, GetArenaForRead(flags));
+}
+
+bool TBNode::ReadFileInternal(const char *filename, TBNodeArena *arena)
+{
 	FileParser p;
-	TBNodeTarget t(this, filename);
+	TBNodeTarget t(this, filename, arena);
 	if (p.Read(filename, &t))
 	{
 		TBNodeRefTree::ResolveConditions(this);
@@ -328,16 +488,30 @@ void TBNode::ReadData(const char *data, int data_len, TB_NODE_READ_FLAGS flags)
 	if (!(flags & TB_NODE_READ_FLAGS_APPEND))
 		Clear();
 	DataParser p;
-	TBNodeTarget t(this, "{data}");
+	TBNodeTarget t(this, "{data}", GetArenaForRead(flags));
 	p.Read(data, data_len, &t);
 	TBNodeRefTree::ResolveConditions(this);
 }
 
+TBNodeArena *TBNode::GetArenaForRead(TB_NODE_READ_FLAGS flags)
+{
+	// If there's no memory for the arena, nodes are allocated the normal way.
+	if ((flags & TB_NODE_READ_FLAGS_ARENA) && !m_arena)
+		m_arena = new TBNodeArena;
+	return (flags & TB_NODE_READ_FLAGS_ARENA) ? m_arena : nullptr;
+}
+
 void TBNode::Clear()
 {
-	free(m_name);
+	if (!m_name_in_arena)
+		free(m_name);
 	m_name = nullptr;
+	m_name_in_arena = false;
 	m_children.DeleteAll();
+	InvalidateChildIndex();
+	// Delete the arena last, since the children may be allocated from it.
+	delete m_arena;
+	m_arena = nullptr;
 }
 
 }; // namespace tb
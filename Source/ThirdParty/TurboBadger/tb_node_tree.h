@@ -8,6 +8,7 @@
 
 #include "parser/tb_parser.h"
 #include "tb_linklist.h"
+#include "tb_hashtable.h"
 
 namespace tb {
 
@@ -16,9 +17,35 @@ enum TB_NODE_READ_FLAGS {
 	/** Read nodes without clearing first. Can be used to append
 		data from multiple sources, or inject dependencies. */
 	TB_NODE_READ_FLAGS_APPEND = 1,
+	/** Allocate the nodes, names and string values that are read from a TBNodeArena
+		owned by the node read into, instead of one heap allocation for each. The arena
+		is freed at once when that node is cleared or deleted, so the nodes read must
+		never be moved to another tree that may outlive it. */
+	TB_NODE_READ_FLAGS_ARENA = 2
 };
 MAKE_ENUM_FLAG_COMBO(TB_NODE_READ_FLAGS);
 
+/** TBNodeArena is a bump allocator for the nodes, names and string values of one
+	TBNode tree (See TB_NODE_READ_FLAGS_ARENA). Nothing is freed until the arena is
+	deleted, and then all memory is freed at once. */
+class TBNodeArena
+{
+public:
+	TBNodeArena() : m_blocks(nullptr), m_pos(nullptr), m_end(nullptr) {}
+	~TBNodeArena();
+
+	/** Allocate size bytes, aligned for any node or value. Returns nullptr on out of memory. */
+	void *Alloc(int size);
+
+	/** Allocate a null terminated copy of the first len bytes of str. */
+	char *AllocString(const char *str, int len);
+private:
+	struct BLOCK { BLOCK *next; double align; };
+	BLOCK *m_blocks;
+	char *m_pos;
+	char *m_end;
+};
+
 /** TBNode is a tree node with a string name and a value (TBValue).
 	It may have a parent TBNode and child TBNodes.
 
@@ -30,9 +57,16 @@ MAKE_ENUM_FLAG_COMBO(TB_NODE_READ_FLAGS);
 class TBNode : public TBLinkOf<TBNode>
 {
 public:
-	TBNode() : m_name(nullptr), m_parent(nullptr), m_cycle_id(0) {}
+	TBNode() : m_name(nullptr), m_parent(nullptr), m_cycle_id(0), m_name_in_arena(false), m_child_index(nullptr), m_arena(nullptr) {}
 	~TBNode();
 
+	/** Nodes can be allocated from a TBNodeArena, but are still deleted with delete
+		like any other node. The memory is only freed if it's not from an arena. */
+	static void *operator new(size_t size) noexcept;
+	static void *operator new(size_t size, TBNodeArena *arena) noexcept;
+	static void operator delete(void *ptr);
+	static void operator delete(void *ptr, TBNodeArena *arena) { operator delete(ptr); }
+
 	/** Create a new node with the given name. */
 	static TBNode *Create(const char *name);
 
@@ -52,19 +86,19 @@ public:
 	//bool WriteFile(const char *filename);
 
 	/** Add node as child to this node. */
-	void Add(TBNode *n) { m_children.AddLast(n); n->m_parent = this; }
+	void Add(TBNode *n) { m_children.AddLast(n); n->m_parent = this; InvalidateChildIndex(); }
 
 	/** Add node before the reference node (which must be a child to this node). */
-	void AddBefore(TBNode *n, TBNode *reference) { m_children.AddBefore(n, reference); n->m_parent = this; }
+	void AddBefore(TBNode *n, TBNode *reference) { m_children.AddBefore(n, reference); n->m_parent = this; InvalidateChildIndex(); }
 
 	/** Add node after the reference node (which must be a child to this node). */
-	void AddAfter(TBNode *n, TBNode *reference) { m_children.AddAfter(n, reference); n->m_parent = this; }
+	void AddAfter(TBNode *n, TBNode *reference) { m_children.AddAfter(n, reference); n->m_parent = this; InvalidateChildIndex(); }
 
 	/** Remove child node n from this node. */
-	void Remove(TBNode *n) { m_children.Remove(n); n->m_parent = nullptr; }
+	void Remove(TBNode *n) { m_children.Remove(n); n->m_parent = nullptr; InvalidateChildIndex(); }
 
 	/** Remove and delete child node n from this node. */
-	void Delete(TBNode *n) { m_children.Delete(n); }
+	void Delete(TBNode *n) { m_children.Delete(n); InvalidateChildIndex(); }
 
 	/** Create duplicates of all items in source and add them to this node.
 		Note: Nodes does not replace existing nodes with the same name. Cloned nodes
@@ -128,12 +162,22 @@ friend class TBNodeRefTree;
 	TBNode *GetNodeFollowRef(const char *request,
 							GET_MISS_POLICY mp = GET_MISS_POLICY_NULL);
 	TBNode *GetNodeInternal(const char *name, int name_len) const;
+	void BuildChildIndex() const;
+	bool ReadFileInternal(const char *filename, TBNodeArena *arena);
+	TBNodeArena *GetArenaForRead(TB_NODE_READ_FLAGS flags);
+	static TBNode *Create(const char *name, TBNodeArena *arena);
+	void InvalidateChildIndex() { if (m_child_index) { delete m_child_index; m_child_index = nullptr; } }
 	static TBNode *Create(const char *name, int name_len);
 	char *m_name;
 	TBValue m_value;
 	TBLinkListOf<TBNode> m_children;
 	TBNode *m_parent;
 	uint32 m_cycle_id;	///< Used to detect circular references.
+	bool m_name_in_arena;	///< True if m_name is allocated from an arena, and shouldn't be freed.
+	/** Index of the first child with each name hash. Built when looking up children
+		in a node with many children, and deleted when the children change. */
+	mutable TBHashTableOf<TBNode> *m_child_index;
+	TBNodeArena *m_arena;	///< The arena owned by this node, if read with TB_NODE_READ_FLAGS_ARENA.
 };
 
 }; // namespace tb
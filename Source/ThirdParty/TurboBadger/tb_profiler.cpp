@@ -0,0 +1,273 @@
+// ================================================================================
+// ==      This file is a part of Turbo Badger. (C) 2011-2014, Emil Segerås      ==
+// ==                     See tb_core.h for more information.                    ==
+// ================================================================================
+
+#include "tb_profiler.h"
+#include "tb_widgets_reader.h"
+#include "tb_widgets_common.h"
+#include "tb_window.h"
+#include "tb_system.h"
+#include <assert.h>
+#include <chrono>
+
+namespace tb {
+
+TBProfiler g_tb_profiler;
+
+// == TBProfilerFrame ===================================================================
+
+void TBProfilerFrame::Clear()
+{
+	for (int i = 0; i < TB_PROFILER_NUM_PHASES; i++)
+		phase_ms[i] = 0;
+	for (int i = 0; i < TB_PROFILER_NUM_COUNTERS; i++)
+		counters[i] = 0;
+}
+
+double TBProfilerFrame::GetTotalMS() const
+{
+	double total_ms = 0;
+	for (int i = 0; i < TB_PROFILER_NUM_PHASES; i++)
+		total_ms += phase_ms[i];
+	return total_ms;
+}
+
+// == TBProfiler ========================================================================
+
+TBProfiler::TBProfiler()
+	: m_enabled(false)
+	, m_in_frame(false)
+	, m_frame_index(0)
+	, m_num_frames(0)
+{
+	for (int i = 0; i < TB_PROFILER_NUM_PHASES; i++)
+		m_phase_start_ms[i] = -1;
+}
+
+void TBProfiler::SetEnabled(bool enabled)
+{
+	m_enabled = enabled;
+	m_in_frame = false;
+	m_frame.Clear();
+	m_frame_index = 0;
+	m_num_frames = 0;
+	for (int i = 0; i < TB_PROFILER_NUM_PHASES; i++)
+		m_phase_start_ms[i] = -1;
+}
+
+void TBProfiler::BeginFrame()
+{
+	if (!m_enabled)
+		return;
+	if (m_in_frame)
+	{
+		m_frames[m_frame_index] = m_frame;
+		m_frame_index = (m_frame_index + 1) % TB_PROFILER_HISTORY_SIZE;
+		m_num_frames = MIN(m_num_frames + 1, TB_PROFILER_HISTORY_SIZE);
+	}
+	m_frame.Clear();
+	m_in_frame = true;
+}
+
+void TBProfiler::BeginPhase(TB_PROFILER_PHASE phase)
+{
+	if (!m_enabled)
+		return;
+	assert(m_phase_start_ms[phase] < 0); // Phases can't be nested in themselves.
+	m_phase_start_ms[phase] = GetTimeMS();
+}
+
+void TBProfiler::EndPhase(TB_PROFILER_PHASE phase)
+{
+	// The profiler may have been enabled during the phase.
+	if (!m_enabled || m_phase_start_ms[phase] < 0)
+		return;
+	m_frame.phase_ms[phase] += GetTimeMS() - m_phase_start_ms[phase];
+	m_phase_start_ms[phase] = -1;
+}
+
+const TBProfilerFrame &TBProfiler::GetLastFrame() const
+{
+	static const TBProfilerFrame empty_frame;
+	if (!m_num_frames)
+		return empty_frame;
+	return m_frames[(m_frame_index + TB_PROFILER_HISTORY_SIZE - 1) % TB_PROFILER_HISTORY_SIZE];
+}
+
+int TBProfiler::GetAverageFrame(TBProfilerFrame &frame) const
+{
+	frame.Clear();
+	if (!m_num_frames)
+		return 0;
+	// Counters are summed in doubles, since they might overflow as uint32.
+	double counters[TB_PROFILER_NUM_COUNTERS] = { 0 };
+	for (int f = 0; f < m_num_frames; f++)
+	{
+		for (int i = 0; i < TB_PROFILER_NUM_PHASES; i++)
+			frame.phase_ms[i] += m_frames[f].phase_ms[i];
+		for (int i = 0; i < TB_PROFILER_NUM_COUNTERS; i++)
+			counters[i] += m_frames[f].counters[i];
+	}
+	for (int i = 0; i < TB_PROFILER_NUM_PHASES; i++)
+		frame.phase_ms[i] /= m_num_frames;
+	for (int i = 0; i < TB_PROFILER_NUM_COUNTERS; i++)
+		frame.counters[i] = (uint32) (counters[i] / m_num_frames + 0.5);
+	return m_num_frames;
+}
+
+// static
+const char *TBProfiler::GetPhaseName(TB_PROFILER_PHASE phase)
+{
+	switch (phase)
+	{
+	case TB_PROFILER_PHASE_MESSAGES:		return "Messages";
+	case TB_PROFILER_PHASE_ANIMATIONS:		return "Animations";
+	case TB_PROFILER_PHASE_PROCESS_STATES:	return "Process states";
+	case TB_PROFILER_PHASE_PROCESS:			return "Process";
+	case TB_PROFILER_PHASE_PAINT:			return "Paint";
+	case TB_PROFILER_PHASE_END_PAINT:		return "End paint";
+	case TB_PROFILER_PHASE_RENDER:			return "Render";
+	default: return "[UNKNOWN]";
+	};
+}
+
+// static
+const char *TBProfiler::GetCounterName(TB_PROFILER_COUNTER counter)
+{
+	switch (counter)
+	{
+	case TB_PROFILER_COUNTER_WIDGETS_VISITED:	return "Widgets visited";
+	case TB_PROFILER_COUNTER_QUADS:				return "Quads";
+	case TB_PROFILER_COUNTER_BATCHES:			return "Batches";
+	case TB_PROFILER_COUNTER_BYTES_UPLOADED:	return "Bytes uploaded";
+	case TB_PROFILER_COUNTER_GLYPHS:			return "Glyphs";
+	default: return "[UNKNOWN]";
+	};
+}
+
+// static
+double TBProfiler::GetTimeMS()
+{
+	// TBSystem::GetTimeMS may only have millisecond resolution, which is too
+	// little for the phases of a frame.
+	using namespace std::chrono;
+	return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// == ProfilerWindow ====================================================================
+
+/** How often ProfilerWindow updates the numbers shown. */
+#define TB_PROFILER_WINDOW_UPDATE_MS 500
+
+/** Window showing the phase times and counters of g_tb_profiler, for the last
+	frame and averaged over the history. */
+class ProfilerWindow : public TBWindow
+{
+public:
+	TBOBJECT_SUBCLASS(ProfilerWindow, TBWindow);
+
+	ProfilerWindow(TBWidget *root)
+		: m_was_enabled(g_tb_profiler.GetEnabled())
+		, m_next_update_ms(0)
+	{
+		SetText("Frame profiler");
+		// Don't take focus from the UI that is being profiled.
+		SetSettings(WINDOW_SETTINGS_TITLEBAR | WINDOW_SETTINGS_CLOSE_BUTTON);
+		g_widgets_reader->LoadData(this,
+			"TBLayout: axis: x, distribution-position: left top\n"
+			"	TBLayout: id: 'names', axis: y, position: left\n"
+			"		TBTextField: text: 'Frames:'\n"
+			"	TBLayout: id: 'last', axis: y, position: right\n"
+			"		TBTextField: text: 'Last'\n"
+			"	TBLayout: id: 'average', axis: y, position: right\n"
+			"		TBTextField: id: 'num_frames'\n");
+
+		for (int i = 0; i < TB_PROFILER_NUM_PHASES; i++)
+			AddRow(TBProfiler::GetPhaseName((TB_PROFILER_PHASE) i), " ms", &m_phase_fields[i]);
+		AddRow("Total", " ms", &m_total_field);
+		for (int i = 0; i < TB_PROFILER_NUM_COUNTERS; i++)
+			AddRow(TBProfiler::GetCounterName((TB_PROFILER_COUNTER) i), "", &m_counter_fields[i]);
+
+		if (!m_was_enabled)
+			g_tb_profiler.SetEnabled(true);
+		Update();
+
+		TBRect bounds(0, 0, root->GetRect().w, root->GetRect().h);
+		SetRect(GetResizeToFitContentRect().MoveIn(bounds).Clip(bounds));
+
+		root->AddChild(this);
+	}
+
+	~ProfilerWindow()
+	{
+		g_tb_profiler.SetEnabled(m_was_enabled);
+	}
+
+	virtual void OnProcess()
+	{
+		TBWindow::OnProcess();
+		if (TBSystem::GetTimeMS() >= m_next_update_ms)
+			Update();
+	}
+private:
+	struct ROW_FIELDS { TBTextField *last, *average; const char *unit; };
+
+	void AddRow(const char *name, const char *unit, ROW_FIELDS *fields)
+	{
+		TBTextField *name_field = new TBTextField();
+		name_field->SetText(name);
+		GetWidgetByID(TBIDC("names"))->AddChild(name_field);
+
+		fields->last = new TBTextField();
+		fields->last->SetTextAlign(TB_TEXT_ALIGN_RIGHT);
+		GetWidgetByID(TBIDC("last"))->AddChild(fields->last);
+
+		fields->average = new TBTextField();
+		fields->average->SetTextAlign(TB_TEXT_ALIGN_RIGHT);
+		GetWidgetByID(TBIDC("average"))->AddChild(fields->average);
+
+		fields->unit = unit;
+	}
+
+	void SetRow(ROW_FIELDS *fields, double last, double average, bool is_time)
+	{
+		TBStr str;
+		str.SetFormatted(is_time ? "%.3f%s" : "%.0f%s", last, fields->unit);
+		fields->last->SetText(str);
+		str.SetFormatted(is_time ? "%.3f%s" : "%.0f%s", average, fields->unit);
+		fields->average->SetText(str);
+	}
+
+	void Update()
+	{
+		const TBProfilerFrame &last = g_tb_profiler.GetLastFrame();
+		TBProfilerFrame average;
+		int num_frames = g_tb_profiler.GetAverageFrame(average);
+
+		TBStr str;
+		str.SetFormatted("Average of %d", num_frames);
+		GetWidgetByID(TBIDC("num_frames"))->SetText(str);
+
+		for (int i = 0; i < TB_PROFILER_NUM_PHASES; i++)
+			SetRow(&m_phase_fields[i], last.phase_ms[i], average.phase_ms[i], true);
+		SetRow(&m_total_field, last.GetTotalMS(), average.GetTotalMS(), true);
+		for (int i = 0; i < TB_PROFILER_NUM_COUNTERS; i++)
+			SetRow(&m_counter_fields[i], last.counters[i], average.counters[i], false);
+
+		m_next_update_ms = TBSystem::GetTimeMS() + TB_PROFILER_WINDOW_UPDATE_MS;
+	}
+
+	bool m_was_enabled;
+	double m_next_update_ms;
+	ROW_FIELDS m_phase_fields[TB_PROFILER_NUM_PHASES];
+	ROW_FIELDS m_total_field;
+	ROW_FIELDS m_counter_fields[TB_PROFILER_NUM_COUNTERS];
+};
+
+void ShowProfilerWindow(TBWidget *root)
+{
+	new ProfilerWindow(root);
+}
+
+}; // namespace tb
@@ -0,0 +1,131 @@
+// ================================================================================
+// ==      This file is a part of Turbo Badger. (C) 2011-2014, Emil Segerås      ==
+// ==                     See tb_core.h for more information.                    ==
+// ================================================================================
+
+#ifndef TB_PROFILER_H
+#define TB_PROFILER_H
+
+#include "tb_types.h"
+
+namespace tb {
+
+/** The parts of a frame that TBProfiler measures the CPU time of.
+	The backend that runs the frame measures them (See TBProfilerPhase). */
+enum TB_PROFILER_PHASE {
+	TB_PROFILER_PHASE_MESSAGES,			///< TBMessageHandler::ProcessMessages.
+	TB_PROFILER_PHASE_ANIMATIONS,		///< TBAnimationManager::Update.
+	TB_PROFILER_PHASE_PROCESS_STATES,	///< TBWidget::InvokeProcessStates.
+	TB_PROFILER_PHASE_PROCESS,			///< TBWidget::InvokeProcess.
+	TB_PROFILER_PHASE_PAINT,			///< TBRenderer::BeginPaint and TBWidget::InvokePaint.
+	TB_PROFILER_PHASE_END_PAINT,		///< TBRenderer::EndPaint, which flushes the open batches.
+	TB_PROFILER_PHASE_RENDER,			///< Submitting the batches, if the backend does it itself.
+
+	TB_PROFILER_NUM_PHASES
+};
+
+/** The things TBProfiler counts during a frame. */
+enum TB_PROFILER_COUNTER {
+	TB_PROFILER_COUNTER_WIDGETS_VISITED,	///< Widgets visited by process, process states and paint.
+	TB_PROFILER_COUNTER_QUADS,				///< Quads added to batches.
+	TB_PROFILER_COUNTER_BATCHES,			///< Batches flushed to the renderer backend.
+	TB_PROFILER_COUNTER_BYTES_UPLOADED,		///< Bitmap data uploaded by the renderer backend.
+	TB_PROFILER_COUNTER_GLYPHS,				///< Glyphs drawn.
+
+	TB_PROFILER_NUM_COUNTERS
+};
+
+/** The time of each phase and the counters of one frame. */
+class TBProfilerFrame
+{
+public:
+	TBProfilerFrame() { Clear(); }
+
+	void Clear();
+
+	/** Return the sum of the time of all phases. */
+	double GetTotalMS() const;
+
+	double phase_ms[TB_PROFILER_NUM_PHASES];
+	uint32 counters[TB_PROFILER_NUM_COUNTERS];
+};
+
+/** Number of frames kept by TBProfiler, for GetAverageFrame. */
+#define TB_PROFILER_HISTORY_SIZE 60
+
+/** TBProfiler measures the time of the phases of each frame (TB_PROFILER_PHASE),
+	and counts the work done in them (TB_PROFILER_COUNTER).
+
+	It's always compiled in, but does nothing until enabled with SetEnabled.
+	The backend calls BeginFrame at the start of each frame, and measures its
+	phases with TBProfilerPhase. See ShowProfilerWindow for a window showing the
+	results. */
+class TBProfiler
+{
+public:
+	TBProfiler();
+
+	/** Enable or disable profiling. Disabling it clears all frames. */
+	void SetEnabled(bool enabled);
+	bool GetEnabled() const { return m_enabled; }
+
+	/** End the current frame (if any) and begin a new one. */
+	void BeginFrame();
+
+	/** Begin measuring phase. Must be followed by EndPhase with the same phase.
+		A phase may be measured several times in a frame, the time is added. */
+	void BeginPhase(TB_PROFILER_PHASE phase);
+	void EndPhase(TB_PROFILER_PHASE phase);
+
+	/** Add amount to counter in the current frame. */
+	void Count(TB_PROFILER_COUNTER counter, uint32 amount) { if (m_enabled) m_frame.counters[counter] += amount; }
+
+	/** Get the frame that is currently being measured. */
+	const TBProfilerFrame &GetCurrentFrame() const { return m_frame; }
+
+	/** Get the last completed frame. It's cleared if there is none. */
+	const TBProfilerFrame &GetLastFrame() const;
+
+	/** Get the average of the completed frames in the history (up to
+		TB_PROFILER_HISTORY_SIZE). Returns the number of frames averaged. */
+	int GetAverageFrame(TBProfilerFrame &frame) const;
+
+	/** Get the number of completed frames in the history. */
+	int GetNumFrames() const { return m_num_frames; }
+
+	static const char *GetPhaseName(TB_PROFILER_PHASE phase);
+	static const char *GetCounterName(TB_PROFILER_COUNTER counter);
+
+	/** Get the time in milliseconds, with better resolution than TBSystem::GetTimeMS. */
+	static double GetTimeMS();
+private:
+	bool m_enabled;
+	bool m_in_frame;
+	TBProfilerFrame m_frame;
+	double m_phase_start_ms[TB_PROFILER_NUM_PHASES];
+	TBProfilerFrame m_frames[TB_PROFILER_HISTORY_SIZE];
+	int m_frame_index;	///< Index in m_frames of the next completed frame.
+	int m_num_frames;
+};
+
+extern TBProfiler g_tb_profiler;
+
+/** TBProfilerPhase measures a phase of g_tb_profiler during its lifetime. */
+class TBProfilerPhase
+{
+public:
+	TBProfilerPhase(TB_PROFILER_PHASE phase) : m_phase(phase) { g_tb_profiler.BeginPhase(phase); }
+	~TBProfilerPhase() { g_tb_profiler.EndPhase(m_phase); }
+private:
+	TB_PROFILER_PHASE m_phase;
+};
+
+#define TB_PROFILER_COUNT(counter, amount) g_tb_profiler.Count(TB_PROFILER_COUNTER_##counter, amount)
+
+/** Show a window showing the timing and counters of g_tb_profiler, updated a few
+	times per second. Profiling is enabled while the window is open. */
+void ShowProfilerWindow(class TBWidget *root);
+
+}; // namespace tb
+
+#endif // TB_PROFILER_H
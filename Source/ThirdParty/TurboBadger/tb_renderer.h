@@ -47,6 +47,20 @@ public:
 		Note: Implementations for batched renderers should call TBRenderer::FlushBitmap
 		to make sure any active batch is being flushed before the bitmap is changed. */
 	virtual void SetData(uint32 *data) = 0;
+
+	/** Update the part rect of the bitmap with the given data (in BGRA32 format).
+		data is the data for the entire bitmap (Width() * Height() pixels), but only
+		the pixels inside rect have changed since the last update.
+		The default implementation updates the entire bitmap with SetData.
+		Note: Implementations for batched renderers should call TBRenderer::FlushBitmap
+		to make sure any active batch is being flushed before the bitmap is changed. */
+	virtual void SetDataRect(uint32 *data, const TBRect &rect) { SetData(data); }
+
+	/** Update the part rect of a bitmap created with TBRenderer::CreateBitmapA8 with the
+		given data (8bit alpha). data is the data for the entire bitmap, like for SetDataRect.
+		Note: Implementations for batched renderers should call TBRenderer::FlushBitmap
+		to make sure any active batch is being flushed before the bitmap is changed. */
+	virtual void SetDataA8(uint8 *data, const TBRect &rect) {}
 };
 
 /** TBRenderer is a minimal interface for painting strings and bitmaps. */
@@ -54,6 +68,7 @@ public:
 class TBRenderer
 {
 public:
+	TBRenderer() : m_paint_count(0) {}
 	virtual ~TBRenderer() {}
 
 	/** Should be called before invoking paint on any widget.
@@ -115,6 +130,17 @@ public:
 		Return nullptr if fail. */
 	virtual TBBitmap *CreateBitmap(int width, int height, uint32 *data) = 0;
 
+	/** Return true if the renderer can create bitmaps with only an 8bit alpha channel
+		(See CreateBitmapA8). Those use a quarter of the memory of a BGRA32 bitmap, and
+		are used for glyphs that has no color of their own. */
+	virtual bool SupportsBitmapA8() { return false; }
+
+	/** Create a new TBBitmap from the given data (8bit alpha). The color of all pixels
+		is white, so the result is the color used when drawing with alpha from the data.
+		Width and height must be a power of two.
+		Return nullptr if fail or if not supported (See SupportsBitmapA8). */
+	virtual TBBitmap *CreateBitmapA8(int width, int height, uint8 *data) { return nullptr; }
+
 	/** Add a listener to this renderer. Does not take ownership. */
 	void AddListener(TBRendererListener *listener) { m_listeners.AddLast(listener); }
 
@@ -145,6 +171,12 @@ public:
 
 	/** End the hint scope started with BeginBatchHint. */
 	virtual void EndBatchHint() {}
+
+	/** Return the number of frames painted (the number of calls to BeginPaint). It can be
+		used as a cheap stamp to see what was used recently, f.ex by the glyph cache. */
+	uint32 GetPaintCount() const { return m_paint_count; }
+protected:
+	uint32 m_paint_count; ///< Should be increased by BeginPaint in subclasses.
 private:
 	TBLinkListOf<TBRendererListener> m_listeners;
 };
@@ -16,10 +16,71 @@ namespace tb {
 
 int select_list_sort_cb(TBSelectItemSource *source, const int *a, const int *b)
 {
-	int value = strcmp(source->GetItemString(*a), source->GetItemString(*b));
-	return source->GetSort() == TB_SORT_DESCENDING ? -value : value;
+	if (source->GetSort() != TB_SORT_NONE)
+	{
+		int value = strcmp(source->GetItemString(*a), source->GetItemString(*b));
+		if (value)
+			return source->GetSort() == TB_SORT_DESCENDING ? -value : value;
+	}
+	// Keep the source order for equal items, so the order is the same no matter
+	// if the list is sorted at once or one item at a time.
+	return *a - *b;
+}
+
+/** Make sure the index buffer has room for count items. */
+static bool ReserveIndex(TBTempBuffer &buffer, int count)
+{
+	int size = count * sizeof(int);
+	// Reserve some extra memory to reduce the reserve calls when items are added.
+	return size <= buffer.GetCapacity() || buffer.Reserve(size * 2);
+}
+
+/** Find the position of index in index_array, which is sorted by select_list_sort_cb.
+	Returns -1 if it's not found. */
+static int FindSortedPosition(TBSelectItemSource *source, const int *index_array, int count, int index)
+{
+	// The sort order includes the index for equal items, so only index itself compares equal.
+	int low = 0, high = count;
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		int value = select_list_sort_cb(source, &index_array[mid], &index);
+		if (value == 0)
+			return mid;
+		if (value < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	// The item may not be where the sort order says if its string has changed
+	// since it was sorted, so fall back to searching all of them.
+	for (int i = 0; i < count; i++)
+		if (index_array[i] == index)
+			return i;
+	return -1;
 }
 
+/** Remove index from index_array and shift all source indexes after it down by one, in one pass.
+	Returns the position it was removed from, or -1 if it's not found. */
+static int RemoveAndShiftIndex(int *index_array, int &count, int index)
+{
+	int position = -1;
+	int num_kept = 0;
+	for (int i = 0; i < count; i++)
+	{
+		int value = index_array[i];
+		if (value == index)
+			position = i;
+		else
+			index_array[num_kept++] = value > index ? value - 1 : value;
+	}
+	count = num_kept;
+	return position;
+}
+
+/** Number of items to create above and below the visible items in a virtualized list. */
+#define VIRTUAL_ITEM_MARGIN 4
+
 // == TBSelectList ==============================================
 
 TBSelectList::TBSelectList()
@@ -27,6 +88,15 @@ TBSelectList::TBSelectList()
 	, m_list_is_invalid(false)
 	, m_scroll_to_current(false)
 	, m_header_lng_string_id(TBIDC("TBList.header"))
+	, m_header(nullptr)
+	, m_num_all_items(0)
+	, m_virtualized(false)
+	, m_item_height(0)
+	, m_virtual_item_height(0)
+	, m_virtual_header_h(0)
+	, m_num_sorted_items(0)
+	, m_virtual_first(0)
+	, m_virtual_count(0)
 {
 	SetSource(&m_default_source);
 	SetIsFocusable(true);
@@ -43,10 +113,18 @@ TBSelectList::TBSelectList()
 	m_container.GetContentRoot()->AddChild(&m_layout);
 	m_container.SetScrollMode(SCROLL_MODE_Y_AUTO);
 	m_container.SetAdaptContentSize(true);
+	m_spacer_top.SetIgnoreInput(true);
+	m_spacer_top.data.SetInt(-1);
+	m_spacer_bottom.SetIgnoreInput(true);
+	m_spacer_bottom.data.SetInt(-1);
 }
 
 TBSelectList::~TBSelectList()
 {
+	if (m_spacer_top.GetParent())
+		m_spacer_top.GetParent()->RemoveChild(&m_spacer_top);
+	if (m_spacer_bottom.GetParent())
+		m_spacer_bottom.GetParent()->RemoveChild(&m_spacer_bottom);
 	m_container.GetContentRoot()->RemoveChild(&m_layout);
 	RemoveChild(&m_container);
 	SetSource(nullptr);
@@ -62,18 +140,29 @@ void TBSelectList::OnItemChanged(int index)
 	if (m_list_is_invalid) // We're updating all widgets soon.
 		return;
 
-	TBWidget *old_widget = GetItemWidget(index);
-	if (!old_widget) // We don't have this widget so we have nothing to update.
-		return;
-
 	// Replace the old widget representing the item, with a new one. Preserve its state.
-	WIDGET_STATE old_state = old_widget->GetStateRaw();
-
-	if (TBWidget *widget = CreateAndAddItemAfter(index, old_widget))
-		widget->SetStateRaw(old_state);
+	// The item may also have moved or changed filter match, so reinsert it.
+	WIDGET_STATE old_state = WIDGET_STATE_NONE;
+	TBWidget *old_widget = GetItemWidget(index);
+	bool had_widget = old_widget != nullptr;
+	if (had_widget)
+	{
+		old_state = old_widget->GetStateRaw();
+		old_widget->GetParent()->RemoveChild(old_widget);
+		delete old_widget;
+	}
 
-	old_widget->GetParent()->RemoveChild(old_widget);
-	delete old_widget;
+	RemoveSortedItem(index);
+	int position = InsertSortedItem(index);
+	if (position != -1 && !m_virtualized)
+	{
+		TBWidget *widget = AddItemWidget(position);
+		if (widget && had_widget)
+			widget->SetStateRaw(old_state);
+	}
+	UpdateHeader();
+	if (m_virtualized)
+		ResetVirtualItems();
 }
 
 void TBSelectList::OnItemAdded(int index)
@@ -81,9 +170,29 @@ void TBSelectList::OnItemAdded(int index)
 	if (m_list_is_invalid) // We're updating all widgets soon.
 		return;
 
-	// Sorting, filtering etc. makes it messy to handle dynamic addition of items.
-	// Resort to invalidate the entire list (may even be faster anyway)
-	InvalidateList();
+	// A virtual list with no items has no item height yet.
+	if (m_virtualized && m_item_height <= 0 && !m_num_sorted_items)
+	{
+		InvalidateList();
+		return;
+	}
+	if (!ReserveIndex(m_all_index, m_num_all_items + 1) ||
+		!ReserveIndex(m_sorted_index, m_num_all_items + 1))
+	{
+		InvalidateList();
+		return;
+	}
+
+	ShiftItemIndex(index, 1);
+	if (m_value >= index)
+		m_value++;
+
+	int position = InsertSortedItem(index);
+	if (position != -1 && !m_virtualized)
+		AddItemWidget(position);
+	UpdateHeader();
+	if (m_virtualized)
+		ResetVirtualItems();
 }
 
 void TBSelectList::OnItemRemoved(int index)
@@ -91,9 +200,23 @@ void TBSelectList::OnItemRemoved(int index)
 	if (m_list_is_invalid) // We're updating all widgets soon.
 		return;
 
-	// Sorting, filtering etc. makes it messy to handle dynamic addition of items.
-	// Resort to invalidate the entire list (may even be faster anyway)
-	InvalidateList();
+	if (TBWidget *widget = GetItemWidget(index))
+	{
+		widget->GetParent()->RemoveChild(widget);
+		delete widget;
+	}
+	// The item is already removed from the source, so it can't be found by its sort order.
+	RemoveAndShiftIndex((int *) m_all_index.GetData(), m_num_all_items, index);
+	RemoveAndShiftIndex((int *) m_sorted_index.GetData(), m_num_sorted_items, index);
+	ShiftItemWidgets(index + 1, -1);
+	if (m_value == index)
+		m_value = -1;
+	else if (m_value > index)
+		m_value--;
+
+	UpdateHeader();
+	if (m_virtualized)
+		ResetVirtualItems();
 }
 
 void TBSelectList::OnAllItemsRemoved()
@@ -110,7 +233,9 @@ void TBSelectList::SetFilter(const char *filter)
 	if (m_filter.Equals(new_filter))
 		return;
 	m_filter.Set(new_filter);
-	InvalidateList();
+	if (m_list_is_invalid) // We're updating all widgets soon.
+		return;
+	ApplyFilter();
 }
 
 void TBSelectList::SetHeaderString(const TBID& id)
@@ -121,6 +246,23 @@ void TBSelectList::SetHeaderString(const TBID& id)
 	InvalidateList();
 }
 
+void TBSelectList::SetVirtualized(bool virtualized)
+{
+	if (m_virtualized == virtualized)
+		return;
+	m_virtualized = virtualized;
+	InvalidateList();
+}
+
+void TBSelectList::SetItemHeight(int height)
+{
+	if (m_item_height == height)
+		return;
+	m_item_height = height;
+	if (m_virtualized)
+		InvalidateList();
+}
+
 void TBSelectList::InvalidateList()
 {
 	if (m_list_is_invalid)
@@ -134,9 +276,16 @@ void TBSelectList::ValidateList()
 	if (!m_list_is_invalid)
 		return;
 	m_list_is_invalid = false;
-	// FIX: Could delete and create only the changed items (faster filter change)
 
 	// Remove old items
+	if (m_spacer_top.GetParent())
+		m_spacer_top.GetParent()->RemoveChild(&m_spacer_top);
+	if (m_spacer_bottom.GetParent())
+		m_spacer_bottom.GetParent()->RemoveChild(&m_spacer_bottom);
+	m_header = nullptr;
+	m_num_all_items = m_num_sorted_items = 0;
+	m_virtual_first = m_virtual_count = 0;
+	m_virtual_header_h = 0;
 	while (TBWidget *child = m_layout.GetContentRoot()->GetFirstChild())
 	{
 		child->GetParent()->RemoveChild(child);
@@ -145,41 +294,56 @@ void TBSelectList::ValidateList()
 	if (!m_source || !m_source->GetNumItems())
 		return;
 
-	// Create a sorted list of the items we should include using the current filter.
-	TBTempBuffer sort_buf;
-	if (!sort_buf.Reserve(m_source->GetNumItems() * sizeof(int)))
+	// Create a sorted list of all items. It's kept up to date when items are
+	// added or removed, so filter changes don't have to sort again.
+	int num_items = m_source->GetNumItems();
+	if (!ReserveIndex(m_all_index, num_items) || !ReserveIndex(m_sorted_index, num_items))
 		return; // Out of memory
-	int *sorted_index = (int *) sort_buf.GetData();
+	int *all_index = (int *) m_all_index.GetData();
+	for (int i = 0; i < num_items; i++)
+		all_index[i] = i;
+	if (m_source->GetSort() != TB_SORT_NONE)
+		heap_sort<TBSelectItemSource*, int>(all_index, num_items, m_source, select_list_sort_cb);
+	m_num_all_items = num_items;
 
-	// Populate the sorted index list
+	// Populate the sorted index list with the items we should include using the current filter.
+	int *sorted_index = (int *) m_sorted_index.GetData();
 	int num_sorted_items = 0;
-	for (int i = 0; i < m_source->GetNumItems(); i++)
-		if (m_filter.IsEmpty() || m_source->Filter(i, m_filter))
-			sorted_index[num_sorted_items++] = i;
-
-	// Sort
-	if (m_source->GetSort() != TB_SORT_NONE)
-		insertion_sort<TBSelectItemSource*, int>(sorted_index, num_sorted_items, m_source, select_list_sort_cb);
+	for (int i = 0; i < num_items; i++)
+		if (m_filter.IsEmpty() || m_source->Filter(all_index[i], m_filter))
+			sorted_index[num_sorted_items++] = all_index[i];
+	m_num_sorted_items = num_sorted_items;
 
 	// Show header if we only show a subset of all items.
-	if (!m_filter.IsEmpty())
+	UpdateHeader();
+
+	if (m_virtualized)
 	{
-		if (TBWidget *widget = new TBTextField())
+		// Measure the item height from the first item, unless it's specified.
+		m_virtual_item_height = m_item_height;
+		if (m_virtual_item_height <= 0 && num_sorted_items)
 		{
-			TBStr str;
-			str.SetFormatted(g_tb_lng->GetString(m_header_lng_string_id), num_sorted_items, m_source->GetNumItems());
-			widget->SetText(str);
-			widget->SetSkinBg(TBIDC("TBList.header"));
-			widget->SetState(WIDGET_STATE_DISABLED, true);
-			widget->SetGravity(WIDGET_GRAVITY_ALL);
-			widget->data.SetInt(-1);
-			m_layout.GetContentRoot()->AddChild(widget);
+			if (TBWidget *widget = m_source->CreateItemWidget(sorted_index[0], this))
+			{
+				m_layout.GetContentRoot()->AddChild(widget);
+				m_virtual_item_height = widget->GetPreferredSize().pref_h;
+				m_layout.GetContentRoot()->RemoveChild(widget);
+				delete widget;
+			}
 		}
-	}
+		m_virtual_item_height = MAX(m_virtual_item_height, 1);
 
-	// Create new items
-	for (int i = 0; i < num_sorted_items; i++)
-		CreateAndAddItemAfter(sorted_index[i], nullptr);
+		// The spacers take the space of all items that are not created.
+		m_layout.GetContentRoot()->AddChild(&m_spacer_top);
+		m_layout.GetContentRoot()->AddChild(&m_spacer_bottom);
+		UpdateVirtualItems();
+	}
+	else
+	{
+		// Create new items
+		for (int i = 0; i < num_sorted_items; i++)
+			CreateAndAddItem(sorted_index[i], WIDGET_Z_REL_AFTER, nullptr);
+	}
 
 	SelectItem(m_value, true);
 
@@ -187,18 +351,283 @@ void TBSelectList::ValidateList()
 	m_scroll_to_current = true;
 }
 
-TBWidget *TBSelectList::CreateAndAddItemAfter(int index, TBWidget *reference)
+void TBSelectList::ApplyFilter()
 {
-	if (TBWidget *widget = m_source->CreateItemWidget(index, this))
+	// Filter the list of all items, so the filtered items are still sorted.
+	const int *all_index = (const int *) m_all_index.GetData();
+	TBTempBuffer filter_buf;
+	if (!ReserveIndex(filter_buf, MAX(m_num_all_items, 1)))
+	{
+		InvalidateList();
+		return;
+	}
+	int *new_index = (int *) filter_buf.GetData();
+	int num_new_items = 0;
+	for (int i = 0; i < m_num_all_items; i++)
+		if (m_filter.IsEmpty() || m_source->Filter(all_index[i], m_filter))
+			new_index[num_new_items++] = all_index[i];
+
+	if (!m_virtualized)
+	{
+		// The old and new lists are both in the order of the list of all items, so walk them
+		// together and only create or delete the widgets of the items that differ.
+		const int *old_index = (const int *) m_sorted_index.GetData();
+		int old_pos = 0, new_pos = 0;
+		TBWidget *widget = m_header ? m_header->GetNext() : m_layout.GetContentRoot()->GetFirstChild();
+		for (int i = 0; i < m_num_all_items; i++)
+		{
+			int index = all_index[i];
+			bool in_old = old_pos < m_num_sorted_items && old_index[old_pos] == index;
+			bool in_new = new_pos < num_new_items && new_index[new_pos] == index;
+			old_pos += in_old ? 1 : 0;
+			new_pos += in_new ? 1 : 0;
+			// Items may have no widget, if the source didn't create one.
+			bool has_widget = in_old && widget && widget->data.GetInt() == index;
+			if (in_old && in_new)
+			{
+				if (has_widget)
+					widget = widget->GetNext();
+			}
+			else if (has_widget)
+			{
+				TBWidget *next = widget->GetNext();
+				widget->GetParent()->RemoveChild(widget);
+				delete widget;
+				widget = next;
+			}
+			else if (in_new)
+			{
+				if (widget)
+					CreateAndAddItem(index, WIDGET_Z_REL_BEFORE, widget);
+				else
+					CreateAndAddItem(index, WIDGET_Z_REL_AFTER, nullptr);
+			}
+		}
+	}
+
+	memcpy(m_sorted_index.GetData(), new_index, num_new_items * sizeof(int));
+	m_num_sorted_items = num_new_items;
+	UpdateHeader();
+	if (m_virtualized)
+		ResetVirtualItems();
+}
+
+void TBSelectList::UpdateHeader()
+{
+	if (m_filter.IsEmpty())
+	{
+		if (m_header)
+		{
+			m_header->GetParent()->RemoveChild(m_header);
+			delete m_header;
+			m_header = nullptr;
+			m_virtual_header_h = 0;
+		}
+		return;
+	}
+	if (!m_header)
+	{
+		if (!(m_header = new TBTextField()))
+			return;
+		m_header->SetSkinBg(TBIDC("TBList.header"));
+		m_header->SetState(WIDGET_STATE_DISABLED, true);
+		m_header->SetGravity(WIDGET_GRAVITY_ALL);
+		m_header->data.SetInt(-1);
+		m_layout.GetContentRoot()->AddChildRelative(m_header, WIDGET_Z_REL_BEFORE, nullptr);
+	}
+	TBStr str;
+	str.SetFormatted(g_tb_lng->GetString(m_header_lng_string_id), m_num_sorted_items, m_num_all_items);
+	m_header->SetText(str);
+	m_virtual_header_h = m_header->GetPreferredSize().pref_h;
+}
+
+void TBSelectList::ShiftItemIndex(int index, int delta)
+{
+	int *all_index = (int *) m_all_index.GetData();
+	for (int i = 0; i < m_num_all_items; i++)
+		if (all_index[i] >= index)
+			all_index[i] += delta;
+	int *sorted_index = (int *) m_sorted_index.GetData();
+	for (int i = 0; i < m_num_sorted_items; i++)
+		if (sorted_index[i] >= index)
+			sorted_index[i] += delta;
+	ShiftItemWidgets(index, delta);
+}
+
+void TBSelectList::ShiftItemWidgets(int index, int delta)
+{
+	// Only the created widgets, so in a virtual list this is only the visible items.
+	for (TBWidget *tmp = m_layout.GetContentRoot()->GetFirstChild(); tmp; tmp = tmp->GetNext())
+		if (tmp->data.GetInt() >= index)
+			tmp->data.SetInt(tmp->data.GetInt() + delta);
+}
+
+int TBSelectList::InsertSortedItem(int index)
+{
+	int *all_index = (int *) m_all_index.GetData();
+	int position = (int) sorted_insert_position<TBSelectItemSource*, int>(all_index, m_num_all_items, index, m_source, select_list_sort_cb);
+	memmove(all_index + position + 1, all_index + position, (m_num_all_items - position) * sizeof(int));
+	all_index[position] = index;
+	m_num_all_items++;
+
+	if (!m_filter.IsEmpty() && !m_source->Filter(index, m_filter))
+		return -1;
+
+	int *sorted_index = (int *) m_sorted_index.GetData();
+	position = (int) sorted_insert_position<TBSelectItemSource*, int>(sorted_index, m_num_sorted_items, index, m_source, select_list_sort_cb);
+	memmove(sorted_index + position + 1, sorted_index + position, (m_num_sorted_items - position) * sizeof(int));
+	sorted_index[position] = index;
+	m_num_sorted_items++;
+	return position;
+}
+
+int TBSelectList::RemoveSortedItem(int index)
+{
+	int *all_index = (int *) m_all_index.GetData();
+	int position = FindSortedPosition(m_source, all_index, m_num_all_items, index);
+	if (position != -1)
+	{
+		memmove(all_index + position, all_index + position + 1, (m_num_all_items - position - 1) * sizeof(int));
+		m_num_all_items--;
+	}
+	position = GetSortedPosition(index);
+	if (position != -1)
+	{
+		int *sorted_index = (int *) m_sorted_index.GetData();
+		memmove(sorted_index + position, sorted_index + position + 1, (m_num_sorted_items - position - 1) * sizeof(int));
+		m_num_sorted_items--;
+	}
+	return position;
+}
+
+TBWidget *TBSelectList::AddItemWidget(int position)
+{
+	const int *sorted_index = (const int *) m_sorted_index.GetData();
+	// Add it after the closest item before it that has a widget.
+	for (int i = position - 1; i >= 0; i--)
+		if (TBWidget *reference = GetItemWidget(sorted_index[i]))
+			return CreateAndAddItem(sorted_index[position], WIDGET_Z_REL_AFTER, reference);
+	if (m_header)
+		return CreateAndAddItem(sorted_index[position], WIDGET_Z_REL_AFTER, m_header);
+	return CreateAndAddItem(sorted_index[position], WIDGET_Z_REL_BEFORE, nullptr);
+}
+
+TBWidget *TBSelectList::CreateAndAddItem(int index, WIDGET_Z_REL z, TBWidget *reference)
+{
+	TBWidget *widget = m_source->CreateItemWidget(index, this);
+	if (!widget && m_virtualized)
+	{
+		// A virtual list finds the items by their position between the spacers, and they
+		// must all have the item height, so add an empty disabled widget.
+		if ((widget = new TBWidget))
+			widget->SetState(WIDGET_STATE_DISABLED, true);
+	}
+	if (widget)
 	{
 		// Use item data as widget to index lookup
 		widget->data.SetInt(index);
-		m_layout.GetContentRoot()->AddChildRelative(widget, WIDGET_Z_REL_AFTER, reference);
+		if (m_virtualized)
+		{
+			LayoutParams lp;
+			lp.SetHeight(m_virtual_item_height);
+			widget->SetLayoutParams(lp);
+		}
+		if (index == m_value)
+			widget->SetState(WIDGET_STATE_SELECTED, true);
+		m_layout.GetContentRoot()->AddChildRelative(widget, z, reference);
 		return widget;
 	}
 	return nullptr;
 }
 
+bool TBSelectList::UpdateVirtualItems()
+{
+	if (!m_virtualized || m_list_is_invalid || !m_spacer_top.GetParent())
+		return false;
+
+	// Calculate the range of items that should exist from the scroll position.
+	const int item_h = m_virtual_item_height;
+	const int scroll_y = m_container.GetScrollInfo().y - m_virtual_header_h;
+	const int view_h = m_container.GetScrollRoot()->GetRect().h;
+	int first = MAX(scroll_y / item_h - VIRTUAL_ITEM_MARGIN, 0);
+	int last = MIN((scroll_y + view_h) / item_h + 1 + VIRTUAL_ITEM_MARGIN, m_num_sorted_items);
+	first = MIN(first, last);
+	if (first == m_virtual_first && last - first == m_virtual_count)
+		return false;
+
+	// Delete items that are no longer in range, and keep the rest.
+	const int *sorted_index = (const int *) m_sorted_index.GetData();
+	int old_first = m_virtual_first;
+	int old_last = m_virtual_first + m_virtual_count;
+	int position = old_first;
+	TBWidget *child = m_spacer_top.GetNext();
+	while (child && child != &m_spacer_bottom)
+	{
+		TBWidget *next = child->GetNext();
+		if (position < first || position >= last)
+		{
+			child->GetParent()->RemoveChild(child);
+			delete child;
+		}
+		child = next;
+		position++;
+	}
+	int keep_first = MAX(old_first, first);
+	int keep_last = MIN(old_last, last);
+	if (keep_first >= keep_last)
+		keep_first = keep_last = last;
+
+	// Create the new items before and after the kept items.
+	for (int i = keep_first - 1; i >= first; i--)
+		CreateAndAddItem(sorted_index[i], WIDGET_Z_REL_AFTER, &m_spacer_top);
+	for (int i = keep_last; i < last; i++)
+		CreateAndAddItem(sorted_index[i], WIDGET_Z_REL_AFTER, m_spacer_bottom.GetPrev());
+
+	m_virtual_first = first;
+	m_virtual_count = last - first;
+
+	LayoutParams lp;
+	lp.SetHeight(first * item_h);
+	m_spacer_top.SetLayoutParams(lp);
+	lp.SetHeight((m_num_sorted_items - last) * item_h);
+	m_spacer_bottom.SetLayoutParams(lp);
+	return true;
+}
+
+void TBSelectList::ResetVirtualItems()
+{
+	if (!m_spacer_top.GetParent())
+		return;
+	while (m_spacer_top.GetNext() != &m_spacer_bottom)
+	{
+		TBWidget *child = m_spacer_top.GetNext();
+		child->GetParent()->RemoveChild(child);
+		delete child;
+	}
+	// Make sure the range is updated even if it's empty.
+	m_virtual_first = 0;
+	m_virtual_count = -1;
+	UpdateVirtualItems();
+}
+
+int TBSelectList::GetSortedPosition(int index)
+{
+	if (index < 0)
+		return -1;
+	return FindSortedPosition(m_source, (const int *) m_sorted_index.GetData(), m_num_sorted_items, index);
+}
+
+bool TBSelectList::IsItemDisabled(int position)
+{
+	int index = ((const int *) m_sorted_index.GetData())[position];
+	if (TBWidget *widget = GetItemWidget(index))
+		return widget->GetDisabled();
+	// The item has no widget, so guess from what TBSelectItemSource::CreateItemWidget
+	// would create. Strings starting with '-' are separators.
+	const char *string = m_source->GetItemString(index);
+	return string && *string == '-' && !m_source->GetItemSubSource(index) && !m_source->GetItemImage(index);
+}
+
 void TBSelectList::SetValue(int value)
 {
 	if (value == m_value)
@@ -246,8 +675,15 @@ void TBSelectList::ScrollToSelectedItem()
 		return;
 	}
 	m_scroll_to_current = false;
+	int position;
 	if (TBWidget *widget = GetItemWidget(m_value))
 		m_container.ScrollIntoView(widget->GetRect());
+	else if (m_virtualized && (position = GetSortedPosition(m_value)) != -1)
+	{
+		// The item has no widget yet, but we know where it will be.
+		int y = m_virtual_header_h + position * m_virtual_item_height;
+		m_container.ScrollIntoView(TBRect(0, y, m_layout.GetRect().w, m_virtual_item_height));
+	}
 	else
 		m_container.ScrollTo(0, 0);
 }
@@ -260,12 +696,18 @@ void TBSelectList::OnSkinChanged()
 void TBSelectList::OnProcess()
 {
 	ValidateList();
+	UpdateVirtualItems();
 }
 
 void TBSelectList::OnProcessAfterChildren()
 {
 	if (m_scroll_to_current)
 		ScrollToSelectedItem();
+
+	// The layout or scroll may have changed while processing, so make sure the
+	// virtual items are created and layouted before painting.
+	if (UpdateVirtualItems())
+		m_container.InvokeProcess();
 }
 
 bool TBSelectList::OnEvent(const TBWidgetEvent &ev)
@@ -330,6 +772,32 @@ bool TBSelectList::ChangeValue(SPECIAL_KEY key)
 	else
 		return false;
 
+	if (m_virtualized)
+	{
+		// Step through the sorted items since most of them have no widgets.
+		int current = GetSortedPosition(m_value);
+		int origin = -1;
+		if (key == TB_KEY_HOME || (current == -1 && key == TB_KEY_DOWN))
+			current = 0;
+		else if (key == TB_KEY_END || (current == -1 && key == TB_KEY_UP))
+			current = m_num_sorted_items - 1;
+		else
+			origin = current;
+
+		while (current >= 0 && current < m_num_sorted_items)
+		{
+			if (current != origin && !IsItemDisabled(current))
+				break;
+			current += forward ? 1 : -1;
+		}
+		if (current >= 0 && current < m_num_sorted_items)
+		{
+			SetValue(((const int *) m_sorted_index.GetData())[current]);
+			return true;
+		}
+		return false;
+	}
+
 	TBWidget *item_root = m_layout.GetContentRoot();
 	TBWidget *current = GetItemWidget(m_value);
 	TBWidget *origin = nullptr;
@@ -9,6 +9,7 @@
 #include "tb_window.h"
 #include "tb_scroll_container.h"
 #include "tb_select_item.h"
+#include "tb_tempbuffer.h"
 
 namespace tb {
 
@@ -43,6 +44,20 @@ public:
 		at the top of the list when only a subset of all items are shown. */
 	void SetHeaderString(const TBID& id);
 
+	/** Set if the list should be virtualized. A virtualized list only creates widgets
+		for the items that are visible in the scroll viewport (plus a small margin),
+		and recycles them as the list is scrolled. This makes lists with a very large
+		number of items practical.
+
+		All items in a virtualized list have the same height. See SetItemHeight. */
+	void SetVirtualized(bool virtualized);
+	bool GetVirtualized() const { return m_virtualized; }
+
+	/** Set the height of each item in a virtualized list. If 0 (default), the
+		height is measured from the preferred height of the first item. */
+	void SetItemHeight(int height);
+	int GetItemHeight() const { return m_item_height; }
+
 	/** Make the list update its items to reflect the items from the
 		in the current source. The update will take place next time
 		the list is validated. */
@@ -101,8 +116,36 @@ protected:
 	bool m_list_is_invalid;
 	bool m_scroll_to_current;
 	TBID m_header_lng_string_id;
+	TBWidget *m_header;				///< The header widget, or nullptr if not shown.
+	TBTempBuffer m_all_index;		///< Source index of all items in sorted order.
+	int m_num_all_items;
+	bool m_virtualized;
+	int m_item_height;				///< Item height set by SetItemHeight, or 0 for measured.
+	int m_virtual_item_height;		///< The item height used by the current virtual list.
+	int m_virtual_header_h;			///< The height of the header (if any) in the virtual list.
+	TBTempBuffer m_sorted_index;	///< Source index of the filtered items in sorted order.
+	int m_num_sorted_items;
+	int m_virtual_first;			///< Position of the first created item in a virtual list.
+	int m_virtual_count;			///< Number of created items in a virtual list.
+	TBWidget m_spacer_top;			///< Takes the space of items above the created items.
+	TBWidget m_spacer_bottom;		///< Takes the space of items below the created items.
 private:
-	TBWidget *CreateAndAddItemAfter(int index, TBWidget *reference);
+	TBWidget *CreateAndAddItem(int index, WIDGET_Z_REL z, TBWidget *reference);
+	TBWidget *AddItemWidget(int position);
+	void ApplyFilter();
+	void UpdateHeader();
+	/** Shift the source index of all items from index by delta.
+		The TBSelectItemSource callbacks are index based, so adding or removing an item
+		changes the index of all items after it. That makes OnItemAdded and OnItemRemoved
+		O(n) in the number of items: one pass over the index lists and the created item widgets. */
+	void ShiftItemIndex(int index, int delta);
+	void ShiftItemWidgets(int index, int delta);
+	int InsertSortedItem(int index);
+	int RemoveSortedItem(int index);
+	void ResetVirtualItems();
+	bool UpdateVirtualItems();
+	int GetSortedPosition(int index);
+	bool IsItemDisabled(int position);
 };
 
 /** TBSelectDropdown shows a button that opens a popup with a TBSelectList with items
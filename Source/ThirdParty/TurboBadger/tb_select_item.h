@@ -96,7 +96,9 @@ public:
 
 	/** Create the item representation widget(s). By default, it will create
 		a TBTextField for string-only items, and other types for items that
-		also has image or submenu. */
+		also has image or submenu.
+		It may return nullptr to not show the item. A virtualized TBSelectList
+		shows an empty disabled widget instead, since all its items take space. */
 	virtual TBWidget *CreateItemWidget(int index, TBSelectItemViewer *viewer);
 
 	/** Get the number of items */
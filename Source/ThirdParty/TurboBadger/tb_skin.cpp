@@ -10,6 +10,10 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <atomic>
+#ifdef TB_SKIN_ASYNC_THREADS
+#include <thread>
+#endif
 
 namespace tb {
 
@@ -117,6 +121,8 @@ TBSkin::TBSkin()
 	, m_default_disabled_opacity(0.3f)
 	, m_default_placeholder_opacity(0.2f)
 	, m_default_spacing(0)
+	, m_loaded_from_atlas(false)
+	, m_async_loader(nullptr)
 {
 	g_renderer->AddListener(this);
 
@@ -133,10 +139,20 @@ bool TBSkin::Load(const char *skin_file, const char *override_skin_file)
 	return ReloadBitmaps();
 }
 
+bool TBSkin::LoadAsync(const char *skin_file, const char *override_skin_file)
+{
+	if (!LoadInternal(skin_file))
+		return false;
+	if (override_skin_file && !LoadInternal(override_skin_file))
+		return false;
+	ReloadBitmapsAsync();
+	return true;
+}
+
 bool TBSkin::LoadInternal(const char *skin_file)
 {
 	TBNode node;
-	if (!node.ReadFile(skin_file))
+	if (!node.ReadFile(skin_file, TB_NODE_READ_FLAGS_ARENA))
 		return false;
 
 	TBTempBuffer skin_path;
@@ -224,6 +240,8 @@ bool TBSkin::LoadInternal(const char *skin_file)
 
 void TBSkin::UnloadBitmaps()
 {
+	CancelAsync();
+
 	// Unset all bitmap pointers.
 	TBHashTableIteratorOf<TBSkinElement> it(&m_elements);
 	while (TBSkinElement *element = it.GetNextContent())
@@ -236,6 +254,11 @@ void TBSkin::UnloadBitmaps()
 bool TBSkin::ReloadBitmaps()
 {
 	UnloadBitmaps();
+
+	// Load the atlas first if possible. Then ReloadBitmapsInternal will find
+	// all bitmaps already loaded in the fragment manager.
+	m_loaded_from_atlas = !m_atlas_file.IsEmpty() && m_frag_manager.LoadAtlas(m_atlas_file, GetBitmapsHash());
+
 	bool success = ReloadBitmapsInternal();
 	// Create all bitmaps for the bitmap fragment maps
 	if (success)
@@ -286,8 +309,278 @@ bool TBSkin::ReloadBitmapsInternal()
 	return success;
 }
 
+/** Return hash with the given data added (FNV-1a, like TBGetHash). */
+static uint32 AddHashData(uint32 hash, const char *data, int len)
+{
+	for (int i = 0; i < len; i++)
+		hash = (hash ^ (uint8) data[i]) * 16777619U;
+	return hash;
+}
+
+/** Return hash with the given file name and, if the file exists, its size and modification
+	time added. The content is not read, since that would cost as much as loading the bitmaps. */
+static uint32 AddHashFile(uint32 hash, const char *filename)
+{
+	hash = AddHashData(hash, filename, strlen(filename) + 1);
+	if (TBFile *file = TBFile::Open(filename, TBFile::MODE_READ))
+	{
+		long size = file->Size();
+		double modified_time = file->GetModifiedTime();
+		hash = AddHashData(hash, (const char *) &size, sizeof(size));
+		hash = AddHashData(hash, (const char *) &modified_time, sizeof(modified_time));
+		delete file;
+	}
+	return hash;
+}
+
+uint32 TBSkin::GetBitmapsHash()
+{
+	// Hash everything that ReloadBitmapsInternal depends on, so an atlas baked
+	// from any other files (or DPI, or fragment manager settings) is not used.
+	int settings[4] = { m_dim_conv.GetSrcDPI(), m_dim_conv.GetDstDPI(),
+						m_frag_manager.GetAddBorder(), m_frag_manager.GetAllocator() };
+	uint32 hash = AddHashData(2166136261U, (const char *) settings, sizeof(settings));
+
+	TBTempBuffer filename_dst_DPI;
+	TBHashTableIteratorOf<TBSkinElement> it(&m_elements);
+	while (TBSkinElement *element = it.GetNextContent())
+	{
+		if (element->bitmap_file.IsEmpty())
+			continue;
+		if (m_dim_conv.NeedConversion())
+		{
+			m_dim_conv.GetDstDPIFilename(element->bitmap_file, &filename_dst_DPI);
+			hash = AddHashFile(hash, filename_dst_DPI.GetData());
+		}
+		hash = AddHashFile(hash, element->bitmap_file);
+	}
+	return hash;
+}
+
+bool TBSkin::BakeAtlas(const char *filename)
+{
+	return m_frag_manager.SaveAtlas(filename, GetBitmapsHash());
+}
+
+// == TBSkinAsyncLoader ===========================================================================
+
+/** A bitmap file used by one or more skin elements, decoded by TBSkinAsyncLoader. */
+class TBSkinAsyncJob
+{
+public:
+	TBSkinAsyncJob() : dedicated_map(false), image(nullptr), image_is_dst_dpi(false), decoded(false), packed(false) {}
+	~TBSkinAsyncJob() { delete image; }
+
+	/** Decode the image. Called on a worker thread (or main thread without TB_SKIN_ASYNC_THREADS). */
+	void Decode()
+	{
+		// Try the destination DPI file first, like TBSkin::ReloadBitmapsInternal.
+		if (!dst_dpi_file.IsEmpty() && (image = TBImageLoader::CreateFromFile(dst_dpi_file)))
+			image_is_dst_dpi = true;
+		else
+			image = TBImageLoader::CreateFromFile(bitmap_file);
+		decoded = true;
+	}
+
+	TBStr bitmap_file;					///< The bitmap file of the elements
+	TBStr dst_dpi_file;					///< The bitmap file in the destination DPI (or empty)
+	bool dedicated_map;
+	TBListOf<TBSkinElement> elements;	///< The elements using this file
+	TBImageLoader *image;				///< The decoded image (or nullptr if it failed)
+	bool image_is_dst_dpi;
+	std::atomic<bool> decoded;			///< Set when Decode is done. After that, image is owned by the main thread.
+	bool packed;						///< Set when packed into the skin fragment manager (main thread)
+};
+
+/** TBSkinAsyncLoader decodes the jobs for TBSkin::ReloadBitmapsAsync. */
+class TBSkinAsyncLoader
+{
+public:
+	TBSkinAsyncLoader() : num_packed(0), success(true), next_job(0), cancel(false)
+#ifdef TB_SKIN_ASYNC_THREADS
+		, threads(nullptr), num_threads(0)
+#endif
+	{}
+	~TBSkinAsyncLoader() { Stop(); }
+
+	/** Start decoding all jobs. No jobs may be added after this. */
+	void Start()
+	{
+#ifdef TB_SKIN_ASYNC_THREADS
+		int max_threads = MAX((int) std::thread::hardware_concurrency(), 1);
+		num_threads = MIN(MIN(max_threads, 8), jobs.GetNumItems());
+		if (num_threads)
+			threads = new std::thread[num_threads];
+		for (int i = 0; i < num_threads; i++)
+			threads[i] = std::thread(&TBSkinAsyncLoader::DecodeJobs, this);
+#endif
+	}
+
+	/** Stop decoding. Jobs currently being decoded are finished first. */
+	void Stop()
+	{
+		cancel = true;
+#ifdef TB_SKIN_ASYNC_THREADS
+		for (int i = 0; i < num_threads; i++)
+			threads[i].join();
+		delete [] threads;
+		threads = nullptr;
+		num_threads = 0;
+#endif
+	}
+
+	/** Decode the next job that is not taken. Return false if there is none. */
+	bool DecodeNextJob()
+	{
+		int index = next_job++;
+		if (cancel || index >= jobs.GetNumItems())
+			return false;
+		jobs[index]->Decode();
+		return true;
+	}
+
+	TBListAutoDeleteOf<TBSkinAsyncJob> jobs;
+	int num_packed;
+	bool success;
+private:
+	void DecodeJobs() { while (DecodeNextJob()) {} }
+	std::atomic<int> next_job;
+	std::atomic<bool> cancel;
+#ifdef TB_SKIN_ASYNC_THREADS
+	std::thread *threads;
+	int num_threads;
+#endif
+};
+
+void TBSkin::ReloadBitmapsAsync()
+{
+	UnloadBitmaps();
+
+	m_loaded_from_atlas = !m_atlas_file.IsEmpty() && m_frag_manager.LoadAtlas(m_atlas_file, GetBitmapsHash());
+
+	m_async_loader = new TBSkinAsyncLoader;
+	TBTempBuffer filename_dst_DPI;
+	TBHashTableIteratorOf<TBSkinElement> it(&m_elements);
+	while (TBSkinElement *element = it.GetNextContent())
+	{
+		if (element->bitmap_file.IsEmpty())
+			continue;
+		bool dedicated_map = element->type == SKIN_ELEMENT_TYPE_TILE;
+		if (m_dim_conv.NeedConversion())
+			m_dim_conv.GetDstDPIFilename(element->bitmap_file, &filename_dst_DPI);
+		const char *dst_dpi_file = m_dim_conv.NeedConversion() ? filename_dst_DPI.GetData() : "";
+
+		// Use bitmaps that are already loaded (from the atlas) right away.
+		if (*dst_dpi_file && (element->bitmap = m_frag_manager.GetFragment(dst_dpi_file)))
+		{
+			element->SetBitmapDPI(m_dim_conv, m_dim_conv.GetDstDPI());
+			continue;
+		}
+		if ((element->bitmap = m_frag_manager.GetFragment(element->bitmap_file.CStr())))
+		{
+			element->SetBitmapDPI(m_dim_conv, m_dim_conv.GetSrcDPI());
+			continue;
+		}
+
+		// Decode each file only once, even if used by many elements.
+		TBSkinAsyncJob *job = nullptr;
+		for (int i = 0; i < m_async_loader->jobs.GetNumItems() && !job; i++)
+		{
+			TBSkinAsyncJob *j = m_async_loader->jobs[i];
+			if (j->dedicated_map == dedicated_map && j->bitmap_file.Equals(element->bitmap_file))
+				job = j;
+		}
+		if (!job && m_async_loader->jobs.GrowIfNeeded() && (job = new TBSkinAsyncJob))
+		{
+			job->bitmap_file.Set(element->bitmap_file);
+			job->dst_dpi_file.Set(dst_dpi_file);
+			job->dedicated_map = dedicated_map;
+			m_async_loader->jobs.Add(job);
+		}
+		if (!job || !job->elements.Add(element))
+			m_async_loader->success = false;
+	}
+	m_async_loader->Start();
+
+	// Pack the jobs as they are decoded, from ProcessMessages.
+	PostMessage(TBIDC("TBSkin::ProcessAsync"), nullptr);
+}
+
+void TBSkin::ProcessAsync()
+{
+#ifndef TB_SKIN_ASYNC_THREADS
+	// Decode one bitmap per call, so we don't block for long.
+	m_async_loader->DecodeNextJob();
+#endif
+
+	// Pack the decoded jobs into fragments.
+	bool packed_any = false;
+	for (int i = 0; i < m_async_loader->jobs.GetNumItems(); i++)
+	{
+		TBSkinAsyncJob *job = m_async_loader->jobs[i];
+		if (job->packed || !job->decoded)
+			continue;
+		TBBitmapFragment *frag = nullptr;
+		if (TBImageLoader *img = job->image)
+		{
+			TBID id(job->image_is_dst_dpi ? job->dst_dpi_file.CStr() : job->bitmap_file.CStr());
+			frag = m_frag_manager.GetFragment(id);
+			if (!frag)
+				frag = m_frag_manager.CreateNewFragment(id, job->dedicated_map, img->Width(), img->Height(), img->Width(), img->Data());
+			delete job->image;
+			job->image = nullptr;
+		}
+		int bitmap_dpi = job->image_is_dst_dpi ? m_dim_conv.GetDstDPI() : m_dim_conv.GetSrcDPI();
+		for (int j = 0; j < job->elements.GetNumItems(); j++)
+		{
+			job->elements[j]->bitmap = frag;
+			job->elements[j]->SetBitmapDPI(m_dim_conv, bitmap_dpi);
+		}
+		if (!frag)
+			m_async_loader->success = false;
+		job->packed = true;
+		m_async_loader->num_packed++;
+		packed_any = true;
+	}
+	// Upload what has been packed so far.
+	if (packed_any)
+		m_frag_manager.ValidateBitmaps();
+
+	if (m_async_loader->num_packed < m_async_loader->jobs.GetNumItems())
+	{
+		PostMessageDelayed(TBIDC("TBSkin::ProcessAsync"), nullptr, 5);
+		return;
+	}
+
+	bool success = m_async_loader->success && m_frag_manager.ValidateBitmaps();
+	delete m_async_loader;
+	m_async_loader = nullptr;
+
+#ifdef TB_RUNTIME_DEBUG_INFO
+	TBStr info;
+	info.SetFormatted("Skin loaded using %d bitmaps.\n", m_frag_manager.GetNumMaps());
+	TBDebugOut(info);
+#endif
+	if (m_listener)
+		m_listener->OnSkinBitmapsLoaded(this, success);
+}
+
+void TBSkin::CancelAsync()
+{
+	DeleteAllMessages();
+	delete m_async_loader;
+	m_async_loader = nullptr;
+}
+
+void TBSkin::OnMessageReceived(TBMessage *msg)
+{
+	if (msg->message == TBIDC("TBSkin::ProcessAsync") && m_async_loader)
+		ProcessAsync();
+}
+
 TBSkin::~TBSkin()
 {
+	CancelAsync();
 	g_renderer->RemoveListener(this);
 }
 
@@ -13,6 +13,7 @@
 #include "tb_linklist.h"
 #include "tb_dimension.h"
 #include "tb_value.h"
+#include "tb_msg.h"
 
 namespace tb {
 
@@ -277,10 +278,18 @@ public:
 		in the skin or is overridden in an override skin.
 		This method can be used to f.ex feed custom properties into element->tag. */
 	virtual void OnSkinElementLoaded(TBSkin *skin, TBSkinElement *element, TBNode *node) = 0;
+
+	/** Called when all bitmaps have been loaded after calling TBSkin::LoadAsync or
+		TBSkin::ReloadBitmapsAsync. success is false if any bitmap failed to load.
+		Until then, elements are painted without the bitmaps that are not yet loaded,
+		so this is a good time to invalidate the layout and repaint. */
+	virtual void OnSkinBitmapsLoaded(TBSkin *skin, bool success) {}
 };
 
+class TBSkinAsyncLoader;
+
 /** TBSkin contains a list of TBSkinElement. */
-class TBSkin : private TBRendererListener
+class TBSkin : private TBRendererListener, private TBMessageHandler
 {
 public:
 	TBSkin();
@@ -300,6 +309,13 @@ public:
 		Returns true on success, and all bitmaps referred to also loaded successfully. */
 	bool Load(const char *skin_file, const char *override_skin_file = nullptr);
 
+	/** Like Load, but the bitmaps are loaded asynchronously. The skin files are loaded
+		immediately, but the bitmaps are decoded on worker threads (See TB_SKIN_ASYNC_THREADS),
+		and packed and uploaded from TBMessageHandler::ProcessMessages as they are decoded.
+		The listener is notified by TBSkinListener::OnSkinBitmapsLoaded when all are done.
+		Returns false if the skin files could not be loaded. */
+	bool LoadAsync(const char *skin_file, const char *override_skin_file = nullptr);
+
 	/** Unload all bitmaps used in this skin. */
 	void UnloadBitmaps();
 
@@ -307,6 +323,28 @@ public:
 		are loaded before loading new ones. */
 	bool ReloadBitmaps();
 
+	/** Like ReloadBitmaps, but the bitmaps are loaded asynchronously (See LoadAsync). */
+	void ReloadBitmapsAsync();
+
+	/** Return true if bitmaps are currently being loaded asynchronously. */
+	bool IsLoadingAsync() const { return m_async_loader != nullptr; }
+
+	/** Set a baked atlas file (See BakeAtlas) that should be used when loading bitmaps,
+		instead of loading and packing each bitmap file. It's only used if it was baked
+		from the same bitmap files (and DPI) that the skin currently use, so an outdated
+		atlas is not used. The files are compared by name, size and modification time
+		(See TBFile::GetModifiedTime), so the atlas check doesn't read them.
+		Should be set before calling Load. */
+	void SetAtlasFile(const char *filename) { m_atlas_file.Set(filename); }
+
+	/** Save the bitmaps that are currently loaded to an atlas file, that can be used
+		to load the skin faster next time (See SetAtlasFile). */
+	bool BakeAtlas(const char *filename);
+
+	/** Return true if the bitmaps were loaded from the atlas file (See SetAtlasFile)
+		the last time they were loaded. */
+	bool IsLoadedFromAtlas() const { return m_loaded_from_atlas; }
+
 	/** Get the dimension converter used for the current skin. This dimension converter
 		converts to px by the same factor as the skin (based on the skin DPI settings). */
 	const TBDimensionConverter *GetDimensionConverter() const { return &m_dim_conv; }
@@ -374,13 +412,17 @@ public:
 	void Debug();
 #endif
 
-	/** Get the fragment manager. */
+	/** Get the fragment manager. Skin bitmaps have mixed sizes, so they may pack tighter
+		with TB_FRAGMENT_ALLOCATOR_MAXRECTS (See TBBitmapFragmentManager::SetAllocator).
+		That should be set before the skin is loaded. */
 	TBBitmapFragmentManager *GetFragmentManager() { return &m_frag_manager; }
 
 	// Implementing TBRendererListener
 	virtual void OnContextLost();
 	virtual void OnContextRestored();
 private:
+	// Implementing TBMessageHandler
+	virtual void OnMessageReceived(TBMessage *msg);
 	friend class TBSkinElement;
 	TBSkinListener *m_listener;
 	TBHashTableAutoDeleteOf<TBSkinElement> m_elements;	///< All skin elements for this skin.
@@ -390,8 +432,14 @@ private:
 	float m_default_disabled_opacity;					///< Disabled opacity
 	float m_default_placeholder_opacity;				///< Placeholder opacity
 	int16 m_default_spacing;							///< Default layout spacing
+	TBStr m_atlas_file;									///< Baked atlas file (may be empty)
+	bool m_loaded_from_atlas;							///< If the bitmaps were loaded from m_atlas_file
+	TBSkinAsyncLoader *m_async_loader;					///< Bitmaps being loaded by ReloadBitmapsAsync
 	bool LoadInternal(const char *skin_file);
+	uint32 GetBitmapsHash();
 	bool ReloadBitmapsInternal();
+	void ProcessAsync();
+	void CancelAsync();
 	void PaintElement(const TBRect &dst_rect, TBSkinElement *element);
 	void PaintElementBGColor(const TBRect &dst_rect, TBSkinElement *element);
 	void PaintElementImage(const TBRect &dst_rect, TBSkinElement *element);
@@ -21,6 +21,60 @@ static void insertion_sort(TYPE *elements, size_t element_count, CONTEXT context
 	}
 }
 
+template<class CONTEXT, class TYPE>
+static void heap_sort_sift_down(TYPE *elements, size_t root, size_t element_count, CONTEXT context, int(*cmp)(CONTEXT context, const TYPE *a, const TYPE *b))
+{
+	TYPE value = elements[root];
+	size_t child;
+	while ((child = root * 2 + 1) < element_count)
+	{
+		if (child + 1 < element_count && cmp(context, &elements[child], &elements[child + 1]) < 0)
+			child++;
+		if (cmp(context, &value, &elements[child]) >= 0)
+			break;
+		elements[root] = elements[child];
+		root = child;
+	}
+	elements[root] = value;
+}
+
+/** Sort the elements in O(n log n) without using any extra memory.
+	Note: The sort is not stable, so cmp should only return 0 for equal elements
+	if their order doesn't matter. */
+template<class CONTEXT, class TYPE>
+static void heap_sort(TYPE *elements, size_t element_count, CONTEXT context, int(*cmp)(CONTEXT context, const TYPE *a, const TYPE *b))
+{
+	if (element_count < 2)
+		return;
+	for (size_t i = element_count / 2; i > 0; i--)
+		heap_sort_sift_down(elements, i - 1, element_count, context, cmp);
+	for (size_t i = element_count - 1; i > 0; i--)
+	{
+		TYPE tmp = elements[0];
+		elements[0] = elements[i];
+		elements[i] = tmp;
+		heap_sort_sift_down(elements, 0, i, context, cmp);
+	}
+}
+
+/** Return the position where value should be inserted in the sorted elements
+	to keep them sorted. If there are elements equal to value, the position
+	after them is returned. Uses binary search, so it's O(log n). */
+template<class CONTEXT, class TYPE>
+static size_t sorted_insert_position(const TYPE *elements, size_t element_count, const TYPE &value, CONTEXT context, int(*cmp)(CONTEXT context, const TYPE *a, const TYPE *b))
+{
+	size_t first = 0, last = element_count;
+	while (first < last)
+	{
+		size_t middle = first + (last - first) / 2;
+		if (cmp(context, &value, &elements[middle]) < 0)
+			last = middle;
+		else
+			first = middle + 1;
+	}
+	return first;
+}
+
 }; // namespace tb
 
 #endif // TB_SORT_H
@@ -350,6 +350,7 @@ void TBSelection::RemoveContent()
 
 			TBBlock *next = block->GetNext();
 			styledit->blocks.Delete(block);
+			styledit->block_index.Invalidate();
 			block = next;
 		}
 
@@ -398,35 +399,203 @@ bool TBSelection::GetText(TBStr &text) const
 // == TBTextOfs =========================================================================
 
 int32 TBTextOfs::GetGlobalOfs(TBStyleEdit *se) const
+{
+	return se->block_index.GetGlobalOfs(block) + ofs;
+}
+
+bool TBTextOfs::SetGlobalOfs(TBStyleEdit *se, int32 gofs)
+{
+	int32 new_ofs;
+	if (TBBlock *b = se->block_index.FindBlockFromGlobalOfs(gofs, new_ofs))
+	{
+		block = b;
+		ofs = new_ofs;
+		return true;
+	}
+	assert(!"out of range! not a valid global offset!");
+	return false;
+}
+
+// == TBBlockIndex ======================================================================
+
+bool TBBlockIndex::Validate()
+{
+	if (m_valid)
+		return true;
+	int num_blocks = 0;
+	for (TBBlock *block = styledit->blocks.GetFirst(); block; block = block->GetNext())
+		num_blocks++;
+	if (!m_blocks.Reserve(num_blocks * sizeof(TBBlock *)) ||
+		!m_tree.Reserve((num_blocks + 1) * sizeof(int32)))
+		return false;
+
+	// Build the fenwick tree in O(n) by adding each node to its parent.
+	TBBlock **blocks = (TBBlock **) m_blocks.GetData();
+	int32 *tree = (int32 *) m_tree.GetData();
+	int i = 0;
+	for (TBBlock *block = styledit->blocks.GetFirst(); block; block = block->GetNext(), i++)
+	{
+		blocks[i] = block;
+		block->index_pos = i;
+		tree[i + 1] = block->str_len;
+	}
+	for (i = 1; i <= num_blocks; i++)
+	{
+		int parent = i + (i & -i);
+		if (parent <= num_blocks)
+			tree[parent] += tree[i];
+	}
+	m_first = 0;
+	m_num_blocks = num_blocks;
+	m_valid = true;
+	return true;
+}
+
+bool TBBlockIndex::Append(TBBlock *block)
+{
+	int num_blocks = m_num_blocks + 1;
+	// Reserve some extra memory to reduce the reserve calls when blocks are added.
+	if ((num_blocks * (int) sizeof(TBBlock *) > m_blocks.GetCapacity() &&
+		!m_blocks.Reserve(num_blocks * 2 * sizeof(TBBlock *))) ||
+		((num_blocks + 1) * (int) sizeof(int32) > m_tree.GetCapacity() &&
+		!m_tree.Reserve((num_blocks + 1) * 2 * sizeof(int32))))
+		return false;
+	TBBlock **blocks = (TBBlock **) m_blocks.GetData();
+	blocks[m_num_blocks] = block;
+	block->index_pos = m_num_blocks;
+
+	// The new node is the sum of the block and the nodes it covers before it.
+	int32 *tree = (int32 *) m_tree.GetData();
+	int32 sum = block->str_len;
+	for (int i = num_blocks - 1; i > num_blocks - (num_blocks & -num_blocks); i -= i & -i)
+		sum += tree[i];
+	tree[num_blocks] = sum;
+	m_num_blocks = num_blocks;
+	return true;
+}
+
+void TBBlockIndex::OnBlockAdded(TBBlock *block)
+{
+	if (m_valid && (block->GetNext() || !Append(block)))
+		m_valid = false;
+}
+
+void TBBlockIndex::OnBlockRemoved(TBBlock *block)
+{
+	if (!m_valid)
+		return;
+	if (block->index_pos != m_first)
+	{
+		m_valid = false;
+		return;
+	}
+	// The length of the removed block stays in the tree, and is subtracted by
+	// GetGlobalOfs and FindBlockFromGlobalOfs. Rebuild the index when most of it
+	// is removed blocks, so it doesn't grow forever.
+	m_first++;
+	if (m_first > m_num_blocks / 2)
+		m_valid = false;
+}
+
+int32 TBBlockIndex::GetLengthBefore(int pos) const
+{
+	const int32 *tree = (const int32 *) m_tree.GetData();
+	int32 len = 0;
+	for (int i = pos; i > 0; i -= i & -i)
+		len += tree[i];
+	return len;
+}
+
+void TBBlockIndex::OnLengthChanged(TBBlock *block, int32 delta)
+{
+	if (!m_valid || !delta)
+		return;
+	assert(((TBBlock **) m_blocks.GetData())[block->index_pos] == block);
+	int32 *tree = (int32 *) m_tree.GetData();
+	for (int i = block->index_pos + 1; i <= m_num_blocks; i += i & -i)
+		tree[i] += delta;
+}
+
+TBBlock *TBBlockIndex::FindBlock(int32 y)
+{
+	y += styledit->ypos_base;
+	if (!Validate())
+	{
+		for (TBBlock *block = styledit->blocks.GetFirst(); block; block = block->GetNext())
+			if (y < block->ypos + block->height)
+				return block;
+		return nullptr;
+	}
+	TBBlock **blocks = (TBBlock **) m_blocks.GetData();
+	int first = m_first, last = m_num_blocks;
+	while (first < last)
+	{
+		int middle = first + (last - first) / 2;
+		if (y < blocks[middle]->ypos + blocks[middle]->height)
+			last = middle;
+		else
+			first = middle + 1;
+	}
+	return first < m_num_blocks ? blocks[first] : nullptr;
+}
+
+int32 TBBlockIndex::GetGlobalOfs(TBBlock *block)
 {
 	int32 gofs = 0;
-	TBBlock *b = se->blocks.GetFirst();
-	while (b && b != block)
+	if (!Validate())
 	{
-		gofs += b->str_len;
-		b = b->GetNext();
+		for (TBBlock *b = styledit->blocks.GetFirst(); b && b != block; b = b->GetNext())
+			gofs += b->str_len;
+		return gofs;
 	}
-	gofs += ofs;
-	return gofs;
+	return GetLengthBefore(block->index_pos) - GetLengthBefore(m_first);
 }
 
-bool TBTextOfs::SetGlobalOfs(TBStyleEdit *se, int32 gofs)
+TBBlock *TBBlockIndex::FindBlockFromGlobalOfs(int32 gofs, int32 &ofs)
 {
-	TBBlock *b = se->blocks.GetFirst();
-	while (b)
+	if (!Validate())
 	{
-		int b_len = b->str_len;
-		if (gofs <= b_len)
+		for (TBBlock *b = styledit->blocks.GetFirst(); b; b = b->GetNext())
 		{
-			block = b;
-			ofs = gofs;
-			return true;
+			if (gofs <= b->str_len)
+			{
+				ofs = gofs;
+				return b;
+			}
+			gofs -= b->str_len;
 		}
-		gofs -= b_len;
-		b = b->GetNext();
+		return nullptr;
 	}
-	assert(!"out of range! not a valid global offset!");
-	return false;
+	// Find the first block where the sum of lengths up to and including the
+	// block is at least gofs, by descending the fenwick tree.
+	const int32 *tree = (const int32 *) m_tree.GetData();
+	int32 first_gofs = gofs;
+	gofs += GetLengthBefore(m_first);
+	int pos = 0;
+	int step = 1;
+	while (step * 2 <= m_num_blocks)
+		step *= 2;
+	for (; step; step /= 2)
+	{
+		if (pos + step <= m_num_blocks && tree[pos + step] < gofs)
+		{
+			pos += step;
+			gofs -= tree[pos];
+		}
+	}
+	if (pos < m_first)
+	{
+		// The removed blocks before m_first may end at gofs.
+		pos = m_first;
+		gofs = first_gofs;
+	}
+	if (pos >= m_num_blocks)
+		return nullptr;
+	TBBlock *block = ((TBBlock **) m_blocks.GetData())[pos];
+	if (gofs > block->str_len)
+		return nullptr;
+	ofs = gofs;
+	return block;
 }
 
 // == TBCaret ============================================================================
@@ -454,12 +623,12 @@ void TBCaret::UpdatePos()
 	Invalidate();
 	TBTextFragment *fragment = GetFragment();
 	x = fragment->xpos + fragment->GetCharX(styledit->font, pos.ofs - fragment->ofs);
-	y = fragment->ypos + pos.block->ypos;
+	y = fragment->ypos + pos.block->ypos - styledit->ypos_base;
 	height = fragment->GetHeight(styledit->font);
 	if (!height)
 	{
 		// If we don't have height, we're probably inside a style switch embed.
-		y = fragment->line_ypos + pos.block->ypos;
+		y = fragment->line_ypos + pos.block->ypos - styledit->ypos_base;
 		height = fragment->line_height;
 	}
 	Invalidate();
@@ -539,7 +708,7 @@ bool TBCaret::Move(bool forward, bool word)
 bool TBCaret::Place(const TBPoint &point)
 {
 	TBBlock *block = styledit->FindBlock(point.y);
-	TBTextFragment *fragment = block->FindFragment(point.x, point.y - block->ypos);
+	TBTextFragment *fragment = block->FindFragment(point.x, point.y + styledit->ypos_base - block->ypos);
 	int ofs = fragment->ofs + fragment->GetCharOfs(styledit->font, point.x - fragment->xpos);
 
 	if (Place(block, ofs))
@@ -696,8 +865,10 @@ TBBlock::TBBlock(TBStyleEdit *styledit)
 	, ypos(0)
 	, height(0)
 	, align(styledit->align)
+	, pending_layout(0)
 	, line_width_max(0)
 	, str_len(0)
+	, index_pos(0)
 {
 }
 
@@ -714,6 +885,7 @@ void TBBlock::Clear()
 void TBBlock::Set(const char *newstr, int32 len)
 {
 	str.Set(newstr, len);
+	styledit->block_index.OnLengthChanged(this, len - str_len);
 	str_len = len;
 	Split();
 	Layout(true, true);
@@ -729,6 +901,20 @@ void TBBlock::SetAlign(TB_TEXT_ALIGN align)
 
 int32 TBBlock::InsertText(int32 ofs, const char *text, int32 len, bool allow_line_recurse)
 {
+	// Text inserted after the ending line break belongs to the next line. Otherwise any
+	// following lines would be inserted before the line that is split off.
+	if (ofs > 0 && ofs == str_len && is_linebreak(str[ofs - 1]) && styledit->packed.multiline_on)
+	{
+		TBBlock *next_block = GetNext();
+		if (!next_block)
+		{
+			next_block = new TBBlock(styledit);
+			styledit->blocks.AddAfter(next_block, this);
+			styledit->block_index.OnBlockAdded(next_block);
+		}
+		return next_block->InsertText(0, text, len, allow_line_recurse);
+	}
+
 	styledit->BeginLockScrollbars();
 	int first_line_len = len;
 	for(int i = 0; i < len; i++)
@@ -747,6 +933,7 @@ int32 TBBlock::InsertText(int32 ofs, const char *text, int32 len, bool allow_lin
 	int32 inserted_len = first_line_len;
 	str.Insert(ofs, text, first_line_len);
 	str_len += first_line_len;
+	styledit->block_index.OnLengthChanged(this, first_line_len);
 
 	Split();
 	Layout(true, true);
@@ -764,6 +951,7 @@ int32 TBBlock::InsertText(int32 ofs, const char *text, int32 len, bool allow_lin
 			{
 				next_block = new TBBlock(styledit);
 				styledit->blocks.AddLast(next_block);
+				styledit->block_index.OnBlockAdded(next_block);
 			}
 			int consumed = next_block->InsertText(0, next_line_ptr, remaining, false);
 			next_line_ptr += consumed;
@@ -782,6 +970,7 @@ void TBBlock::RemoveContent(int32 ofs, int32 len)
 		return;
 	str.Remove(ofs, len);
 	str_len -= len;
+	styledit->block_index.OnLengthChanged(this, -len);
 	Layout(true, true);
 }
 
@@ -800,6 +989,7 @@ void TBBlock::Split()
 			if (!block)
 				return;
 			styledit->blocks.AddAfter(block, this);
+			styledit->block_index.OnBlockAdded(block);
 
 			if (i < len - 1 && str.CStr()[i] == '\r' && str.CStr()[i + 1] == '\n')
 				i++;
@@ -809,6 +999,7 @@ void TBBlock::Split()
 			block->Set(str.CStr() + i, len);
 			str.Remove(i, len);
 			str_len -= len;
+			styledit->block_index.OnLengthChanged(this, -len);
 			break;
 		}
 	}
@@ -823,6 +1014,7 @@ void TBBlock::Merge()
 		str_len = str.Length();
 
 		styledit->blocks.Delete(next_block);
+		styledit->block_index.Invalidate();
 
 		height = 0; // Ensure that Layout propagate height to remaining blocks.
 		Layout(true, true);
@@ -888,6 +1080,10 @@ int TBBlock::GetStartIndentation(TBFontFace *font, int first_line_len) const
 
 void TBBlock::Layout(bool update_fragments, bool propagate_height)
 {
+	if (pending_layout == 2)
+		update_fragments = true;
+	pending_layout = 0;
+
 	// Create fragments from the word fragments
 	if (update_fragments || !fragments.GetFirst())
 	{
@@ -1056,7 +1252,7 @@ void TBBlock::Layout(bool update_fragments, bool propagate_height)
 		first_fragment_on_line = last_fragment_on_line->GetNext();
 	}
 
-	ypos = GetPrev() ? GetPrev()->ypos + GetPrev()->height : 0;
+	ypos = GetPrev() ? GetPrev()->ypos + GetPrev()->height : styledit->ypos_base;
 	SetSize(old_line_width_max, line_width_max, line_ypos, propagate_height);
 
 	Invalidate();
@@ -1090,7 +1286,7 @@ void TBBlock::SetSize(int32 old_w, int32 new_w, int32 new_h, bool propagate_heig
 	else if (new_w < old_w && old_w == styledit->content_width)
 		styledit->packed.calculate_content_width_needed = 1;
 
-	styledit->content_height = styledit->blocks.GetLast()->ypos + styledit->blocks.GetLast()->height;
+	styledit->content_height = styledit->blocks.GetLast()->ypos + styledit->blocks.GetLast()->height - styledit->ypos_base;
 
 	if (styledit->listener && styledit->packed.lock_scrollbars_counter == 0 && propagate_height)
 		styledit->listener->UpdateScrollbars();
@@ -1130,7 +1326,7 @@ TBTextFragment *TBBlock::FindFragment(int32 x, int32 y) const
 void TBBlock::Invalidate()
 {
 	if (styledit->listener)
-		styledit->listener->Invalidate(TBRect(0, - styledit->scroll_y + ypos, styledit->layout_width, height));
+		styledit->listener->Invalidate(TBRect(0, - styledit->scroll_y - styledit->ypos_base + ypos, styledit->layout_width, height));
 }
 
 void TBBlock::BuildSelectionRegion(int32 translate_x, int32 translate_y, TBTextProps *props,
@@ -1174,7 +1370,7 @@ void TBTextFragment::Init(TBBlock *block, uint16 ofs, uint16 len)
 void TBTextFragment::UpdateContentPos()
 {
 	if (content)
-		content->UpdatePos(xpos, ypos + block->ypos);
+		content->UpdatePos(xpos, ypos + block->ypos - block->styledit->ypos_base);
 }
 
 void TBTextFragment::BuildSelectionRegion(int32 translate_x, int32 translate_y, TBTextProps *props,
@@ -1370,8 +1566,11 @@ TBStyleEdit::TBStyleEdit()
 	, layout_height(0)
 	, content_width(0)
 	, content_height(0)
+	, ypos_base(0)
+	, block_index(nullptr)
 	, caret(nullptr)
 	, selection(nullptr)
+	, log_max_lines(0)
 	, scroll_x(0)
 	, scroll_y(0)
 	, select_state(0)
@@ -1380,6 +1579,7 @@ TBStyleEdit::TBStyleEdit()
 	, align(TB_TEXT_ALIGN_LEFT)
 	, packed_init(0)
 {
+	block_index.styledit = this;
 	caret.styledit = this;
 	selection.styledit = this;
 	TMPDEBUG(packed.show_whitespace = true);
@@ -1427,6 +1627,7 @@ void TBStyleEdit::Clear(bool init_new)
 {
 	undoredo.Clear(true, true);
 	selection.SelectNothing();
+	log_buffer.ResetAppendPos();
 
 	if (init_new && blocks.GetFirst() && IsEmpty())
 		return;
@@ -1434,10 +1635,13 @@ void TBStyleEdit::Clear(bool init_new)
 	for (TBBlock *block = blocks.GetFirst(); block; block = block->GetNext())
 		block->Invalidate();
 	blocks.DeleteAll();
+	block_index.Invalidate();
+	ypos_base = 0;
 
 	if (init_new)
 	{
 		blocks.AddLast(new TBBlock(this));
+		block_index.Invalidate();
 		blocks.GetFirst()->Set("", 0);
 	}
 
@@ -1482,6 +1686,7 @@ void TBStyleEdit::SetScrollPos(int32 x, int32 y)
 	{
 		scroll_x = x;
 		scroll_y = y;
+		LayoutVisibleBlocks();
 		listener->Scroll(dx, dy);
 	}
 }
@@ -1508,7 +1713,14 @@ void TBStyleEdit::SetLayoutSize(int32 width, int32 height, bool is_virtual_refor
 	layout_height = height;
 
 	if (reformat && GetSizeAffectsLayout())
+	{
 		Reformat(false);
+		// A virtual reformat is done to measure the content, so it must be complete.
+		if (is_virtual_reformat)
+			ReformatPending(0);
+	}
+	else
+		LayoutVisibleBlocks();
 
 	caret.UpdatePos();
 	caret.UpdateWantedX();
@@ -1526,21 +1738,93 @@ bool TBStyleEdit::GetSizeAffectsLayout() const
 
 void TBStyleEdit::Reformat(bool update_fragments)
 {
-	int ypos = 0;
+	// Mark all blocks for layout, but only layout what's visible (and the caret block) right
+	// away. Large documents would otherwise have to be layouted completely f.ex for each
+	// step while resizing.
+	for (TBBlock *block = blocks.GetFirst(); block; block = block->GetNext())
+		if (update_fragments || !block->pending_layout)
+			block->pending_layout = update_fragments ? 2 : 1;
+	packed.layout_pending = 1;
+
 	BeginLockScrollbars();
-	TBBlock *block = blocks.GetFirst();
-	while (block)
+	LayoutVisibleBlocks();
+	ReformatPending(REFORMAT_TIME_BUDGET);
+	EndLockScrollbars();
+}
+
+bool TBStyleEdit::ReformatPending(double max_time_ms)
+{
+	if (!packed.layout_pending)
+		return false;
+	double stop_time_ms = TBSystem::GetTimeMS() + max_time_ms;
+	bool pending = false;
+
+	BeginLockScrollbars();
+	int ypos = ypos_base;
+	int num_blocks = block_index.GetNumBlocks();
+	for (int i = 0; i < num_blocks; i++)
 	{
 		// Update ypos directly instead of using "propagate_height" since propagating
 		// would iterate forward through all remaining blocks and we're going to visit
 		// them all anyway.
+		TBBlock *block = block_index.GetBlock(i);
 		block->ypos = ypos;
-		block->Layout(update_fragments, false);
+		if (block->pending_layout)
+		{
+			if (!pending && (max_time_ms <= 0 || TBSystem::GetTimeMS() < stop_time_ms))
+				block->Layout(false, false);
+			else
+				pending = true;
+		}
 		ypos += block->height;
-		block = block->GetNext();
 	}
+	content_height = ypos - ypos_base;
+	packed.layout_pending = pending;
 	EndLockScrollbars();
 	listener->Invalidate(TBRect(0, 0, layout_width, layout_height));
+
+	if (pending)
+		listener->ReformatPendingStart();
+	return pending;
+}
+
+void TBStyleEdit::LayoutVisibleBlocks()
+{
+	if (!packed.layout_pending)
+		return;
+	bool height_changed = false;
+	if (caret.pos.block && caret.pos.block->pending_layout)
+	{
+		int old_height = caret.pos.block->height;
+		caret.pos.block->Layout(false, false);
+		height_changed |= old_height != caret.pos.block->height;
+	}
+	TBBlock *block = block_index.FindBlock(scroll_y - 1);
+	while (block && block->ypos - ypos_base - scroll_y <= layout_height)
+	{
+		if (block->pending_layout)
+		{
+			int old_height = block->height;
+			block->Layout(false, false);
+			height_changed |= old_height != block->height;
+		}
+		block = block->GetNext();
+	}
+	if (!height_changed)
+		return;
+
+	// Move the blocks after any block that changed height.
+	int ypos = ypos_base;
+	int num_blocks = block_index.GetNumBlocks();
+	for (int i = 0; i < num_blocks; i++)
+	{
+		block = block_index.GetBlock(i);
+		block->ypos = ypos;
+		ypos += block->height;
+	}
+	content_height = ypos - ypos_base;
+	if (listener && packed.lock_scrollbars_counter == 0)
+		listener->UpdateScrollbars();
 }
 
 int32 TBStyleEdit::GetContentWidth()
@@ -1569,13 +1853,7 @@ void TBStyleEdit::Paint(const TBRect &rect, const TBFontDescription &font_desc,
 	TBTextProps props(font_desc, text_color);
 
 	// Find the first visible block
-	TBBlock *first_visible_block = blocks.GetFirst();
-	while (first_visible_block)
-	{
-		if (first_visible_block->ypos + first_visible_block->height - scroll_y >= 0)
-			break;
-		first_visible_block = first_visible_block->GetNext();
-	}
+	TBBlock *first_visible_block = block_index.FindBlock(scroll_y - 1);
 
 	// Get the selection region for all visible blocks
 	TBRegion bg_region, fg_region;
@@ -1584,9 +1862,9 @@ void TBStyleEdit::Paint(const TBRect &rect, const TBFontDescription &font_desc,
 		TBBlock *block = first_visible_block;
 		while (block)
 		{
-			if (block->ypos - scroll_y > rect.y + rect.h)
+			if (block->ypos - ypos_base - scroll_y > rect.y + rect.h)
 				break;
-			block->BuildSelectionRegion(-scroll_x, -scroll_y, &props, bg_region, fg_region);
+			block->BuildSelectionRegion(-scroll_x, -scroll_y - ypos_base, &props, bg_region, fg_region);
 			block = block->GetNext();
 		}
 
@@ -1599,9 +1877,9 @@ void TBStyleEdit::Paint(const TBRect &rect, const TBFontDescription &font_desc,
 	TBBlock *block = first_visible_block;
 	while (block)
 	{
-		if (block->ypos - scroll_y > rect.y + rect.h)
+		if (block->ypos - ypos_base - scroll_y > rect.y + rect.h)
 			break;
-		block->Paint(-scroll_x, -scroll_y, &props);
+		block->Paint(-scroll_x, -scroll_y - ypos_base, &props);
 		block = block->GetNext();
 	}
 
@@ -1653,15 +1931,85 @@ void TBStyleEdit::InsertText(const char *text, int32 len, bool after_last, bool
 	caret.UpdateWantedX();
 }
 
-TBBlock *TBStyleEdit::FindBlock(int32 y) const
+void TBStyleEdit::AppendLogText(const char *text, int32 len)
 {
-	TBBlock *block = blocks.GetFirst();
-	while (block)
+	if (len == TB_ALL_TO_TERMINATION)
+		len = strlen(text);
+	if (len <= 0)
+		return;
+	bool flush_pending = log_buffer.GetAppendPos() > 0;
+	// Keep the buffer null terminated, since it will be inserted as a string.
+	if (!log_buffer.Append(text, len) || !log_buffer.Append("", 1))
+		return;
+	log_buffer.SetAppendPos(log_buffer.GetAppendPos() - 1);
+	if (!flush_pending)
+		listener->FlushLogStart();
+}
+
+void TBStyleEdit::FlushLog()
+{
+	if (!log_buffer.GetAppendPos() || !blocks.GetFirst())
+		return;
+	BeginLockScrollbars();
+	bool follow_end = scroll_y >= GetOverflowY();
+
+	// Insert at the end of the last block. Only the new blocks are layouted and
+	// nothing follows them, so nothing else is visited.
+	TBBlock *last = blocks.GetLast();
+	last->InsertText(last->str_len, log_buffer.GetData(), log_buffer.GetAppendPos(), true);
+	log_buffer.ResetAppendPos();
+
+	// Remove the oldest lines if there are too many.
+	int32 num_remove = log_max_lines > 0 ? block_index.GetNumBlocks() - log_max_lines : 0;
+	if (num_remove > 0)
 	{
-		if (y < block->ypos + block->height)
-			return block;
-		block = block->GetNext();
+		int32 removed_height = 0;
+		for (int32 i = 0; i < num_remove; i++)
+		{
+			TBBlock *block = blocks.GetFirst();
+			if (selection.start.block == block || selection.stop.block == block)
+				selection.SelectNothing();
+			if (caret.pos.block == block)
+				caret.Place(block->GetNext(), 0, false);
+			if (mousedown_fragment && mousedown_fragment->block == block)
+				mousedown_fragment = nullptr;
+			if (block->line_width_max == content_width)
+				packed.calculate_content_width_needed = 1;
+			removed_height += block->height;
+			block_index.OnBlockRemoved(block);
+			blocks.Delete(block);
+		}
+
+		// Offsets in the undo history are no longer valid.
+		undoredo.Clear(true, true);
+
+		// Move the base instead of all remaining blocks, so the cost only depends on
+		// the number of removed blocks. Move the blocks now and then so it can't overflow.
+		ypos_base += removed_height;
+		content_height -= removed_height;
+		if (ypos_base > 0x40000000)
+		{
+			int32 num_blocks = block_index.GetNumBlocks();
+			for (int32 i = 0; i < num_blocks; i++)
+				block_index.GetBlock(i)->ypos -= ypos_base;
+			ypos_base = 0;
+		}
+		caret.UpdatePos();
+
+		// Keep showing the same lines.
+		if (!follow_end)
+			SetScrollPos(scroll_x, scroll_y - removed_height);
 	}
+	if (follow_end)
+		SetScrollPos(scroll_x, GetOverflowY());
+	EndLockScrollbars();
+	listener->Invalidate(TBRect(0, 0, layout_width, layout_height));
+}
+
+TBBlock *TBStyleEdit::FindBlock(int32 y)
+{
+	if (TBBlock *block = block_index.FindBlock(y))
+		return block;
 	return blocks.GetLast();
 }
 
@@ -1693,9 +2041,9 @@ bool TBStyleEdit::KeyDown(int key, SPECIAL_KEY special_key, MODIFIER_KEYS modifi
 	else if (special_key == TB_KEY_RIGHT)
 		caret.Move(true, (modifierkeys & TB_CTRL) ? true : false);
 	else if (special_key == TB_KEY_UP)
-		handled = caret.Place(TBPoint(caret.wanted_x, old_caret_pos.block->ypos + old_caret_elm->line_ypos - 1));
+		handled = caret.Place(TBPoint(caret.wanted_x, old_caret_pos.block->ypos - ypos_base + old_caret_elm->line_ypos - 1));
 	else if (special_key == TB_KEY_DOWN)
-		handled = caret.Place(TBPoint(caret.wanted_x, old_caret_pos.block->ypos + old_caret_elm->line_ypos + old_caret_elm->line_height + 1));
+		handled = caret.Place(TBPoint(caret.wanted_x, old_caret_pos.block->ypos - ypos_base + old_caret_elm->line_ypos + old_caret_elm->line_height + 1));
 	else if (special_key == TB_KEY_PAGE_UP)
 		caret.Place(TBPoint(caret.wanted_x, caret.y - layout_height));
 	else if (special_key == TB_KEY_PAGE_DOWN)
@@ -1703,7 +2051,7 @@ bool TBStyleEdit::KeyDown(int key, SPECIAL_KEY special_key, MODIFIER_KEYS modifi
 	else if (special_key == TB_KEY_HOME && modifierkeys & TB_CTRL)
 		caret.Place(TBPoint(0, 0));
 	else if (special_key == TB_KEY_END && modifierkeys & TB_CTRL)
-		caret.Place(TBPoint(32000, blocks.GetLast()->ypos + blocks.GetLast()->height));
+		caret.Place(TBPoint(32000, blocks.GetLast()->ypos - ypos_base + blocks.GetLast()->height));
 	else if (special_key == TB_KEY_HOME)
 		caret.Place(TBPoint(0, caret.y));
 	else if (special_key == TB_KEY_END)
@@ -1836,7 +2184,7 @@ bool TBStyleEdit::MouseDown(const TBPoint &point, int button, int clicks, MODIFI
 			MouseMove(point);
 
 			if (caret.pos.block)
-				mousedown_fragment = caret.pos.block->FindFragment(mousedown_point.x, mousedown_point.y - caret.pos.block->ypos);
+				mousedown_fragment = caret.pos.block->FindFragment(mousedown_point.x, mousedown_point.y + ypos_base - caret.pos.block->ypos);
 		}
 		caret.ResetBlink();
 	}
@@ -1859,7 +2207,7 @@ bool TBStyleEdit::MouseUp(const TBPoint &point, int button, MODIFIER_KEYS modifi
 	select_state = 0;
 	if (caret.pos.block && !TBWidget::cancel_click)
 	{
-		TBTextFragment *fragment = caret.pos.block->FindFragment(point.x + scroll_x, point.y + scroll_y - caret.pos.block->ypos);
+		TBTextFragment *fragment = caret.pos.block->FindFragment(point.x + scroll_x, point.y + scroll_y + ypos_base - caret.pos.block->ypos);
 		if (fragment && fragment == mousedown_fragment)
 			fragment->Click(button, modifierkeys);
 	}
@@ -10,6 +10,7 @@
 #include "tb_linklist.h"
 #include "tb_widgets_common.h"
 #include "tb_list.h"
+#include "tb_tempbuffer.h"
 
 namespace tb {
 
@@ -39,6 +40,17 @@ public:
 	virtual void UpdateScrollbars() = 0;
 	virtual void CaretBlinkStart() = 0;
 	virtual void CaretBlinkStop() = 0;
+
+	/** Called when there are blocks left to layout after a reformat. The listener should
+		call TBStyleEdit::ReformatPending (f.ex from a delayed message) until it returns false.
+		If not implemented, pending blocks are still layouted when they become visible. */
+	virtual void ReformatPendingStart() {}
+
+	/** Called when text has been added by TBStyleEdit::AppendLogText and there was nothing
+		buffered before. The listener should call TBStyleEdit::FlushLog (f.ex from a message),
+		so that all text appended until then is added in one batch.
+		If not implemented, FlushLog must be called some other way. */
+	virtual void FlushLogStart() {}
 };
 
 /** Creates TBTextFragmentContent if the sequence of text matches known content. */
@@ -210,18 +222,77 @@ public:
 	TBStyleEdit *styledit;
 	TBLinkListOf<TBTextFragment> fragments;
 
-	int32 ypos;
+	int32 ypos;		///< Y position, relative to TBStyleEdit::ypos_base.
 	int16 height;
 	int8 align;
+	int8 pending_layout;	///< 1 if the block needs layout, 2 if it also needs its fragments updated.
 	int line_width_max;
 
 	TBStr str;
 	int32 str_len;
+	int32 index_pos;	///< Position in TBBlockIndex (only valid while the index is valid).
 
 private:
 	int GetStartIndentation(TBFontFace *font, int first_line_len) const;
 };
 
+/** TBBlockIndex makes it fast to find blocks from a y position or global offset in
+	documents with many blocks, without walking the block list.
+
+	It keeps an array of all blocks (ypos is already cumulative so it can be binary
+	searched) and a fenwick tree of the block lengths, so global offsets can be
+	converted in O(log n) and updated in O(log n) when the text of a block changes.
+	Blocks added last and removed first (as in the log mode of TBStyleEdit) are
+	updated in O(log n) too. When other blocks are added or removed, the index is
+	rebuilt the next time it's used. */
+
+class TBBlockIndex
+{
+public:
+	TBBlockIndex(TBStyleEdit *styledit) : styledit(styledit), m_first(0), m_num_blocks(0), m_valid(false) {}
+
+	/** Invalidate the index. Must be called when blocks are added or removed,
+		unless OnBlockAdded or OnBlockRemoved is called. */
+	void Invalidate() { m_valid = false; }
+
+	/** Should be called when a block has been added to the block list. */
+	void OnBlockAdded(TBBlock *block);
+
+	/** Should be called before a block is removed from the block list. */
+	void OnBlockRemoved(TBBlock *block);
+
+	/** Should be called when the str_len of a block has changed with delta. */
+	void OnLengthChanged(TBBlock *block, int32 delta);
+
+	/** Find the first block that ends below y, or nullptr if there is none. */
+	TBBlock *FindBlock(int32 y);
+
+	/** Get the global offset of the start of the given block. */
+	int32 GetGlobalOfs(TBBlock *block);
+
+	/** Find the block containing the global offset gofs (as TBTextOfs::SetGlobalOfs).
+		Sets ofs to the offset in the block. Returns nullptr if gofs is out of range. */
+	TBBlock *FindBlockFromGlobalOfs(int32 gofs, int32 &ofs);
+
+	/** Get the number of blocks, and validate the index so GetBlock can be used.
+		Iterating blocks by position is faster than following the links of the list. */
+	int GetNumBlocks() { return Validate() ? m_num_blocks - m_first : 0; }
+
+	/** Get the block at the given position. Only valid after GetNumBlocks. */
+	TBBlock *GetBlock(int pos) const { return ((TBBlock **) m_blocks.GetData())[m_first + pos]; }
+public:
+	TBStyleEdit *styledit;
+private:
+	bool Validate();
+	bool Append(TBBlock *block);
+	int32 GetLengthBefore(int pos) const;
+	TBTempBuffer m_blocks;	///< Array of TBBlock*.
+	TBTempBuffer m_tree;	///< Fenwick tree (int32) of block lengths.
+	int m_first;			///< Position of the first block. The ones before it are removed.
+	int m_num_blocks;		///< Number of blocks in the index, including the removed ones.
+	bool m_valid;
+};
+
 /** Event in the TBUndoRedoStack. Each insert or remove change is stored as a TBUndoEvent, but they may also be merged when appropriate. */
 
 class TBUndoEvent
@@ -371,13 +442,44 @@ public:
 	void AppendText(const char *text, int32 len = TB_ALL_TO_TERMINATION, bool clear_undo_redo = false) { InsertText(text, len, true, clear_undo_redo); }
 	void InsertBreak();
 
-	TBBlock *FindBlock(int32 y) const;
+	/** Set the maximum number of lines to keep when text is added with AppendLogText.
+		When exceeded, the oldest lines are removed. 0 means no limit (default). */
+	void SetLogMaxLines(int32 max_lines) { log_max_lines = max_lines; }
+	int32 GetLogMaxLines() const { return log_max_lines; }
+
+	/** Append text to the end, for use as a log or console. The text is buffered until
+		FlushLog is called, so many appends cost only one layout pass. Unlike AppendText,
+		this doesn't move the caret or record undo, and lines are removed from the top
+		if there's more than SetLogMaxLines. Buffered text is dropped by Clear. */
+	void AppendLogText(const char *text, int32 len = TB_ALL_TO_TERMINATION);
+
+	/** Add the text buffered by AppendLogText. If the view was scrolled to the bottom,
+		it will scroll to keep the new text visible. */
+	void FlushLog();
+
+	TBBlock *FindBlock(int32 y);
 
 	void ScrollIfNeeded(bool x = true, bool y = true);
 	void SetScrollPos(int32 x, int32 y);
 	void SetLayoutSize(int32 width, int32 height, bool is_virtual_reformat);
+
+	/** Layout all blocks again. The visible blocks and the caret block are layouted
+		immediately, and the rest as long as REFORMAT_TIME_BUDGET allows. The remaining
+		blocks keep their old height as an estimate until ReformatPending layouts them,
+		or they become visible. */
 	void Reformat(bool update_fragments);
 
+	/** Layout blocks that are still pending after Reformat, for at most max_time_ms
+		milliseconds (or until all are done if max_time_ms is 0).
+		Returns true if there are blocks left. */
+	bool ReformatPending(double max_time_ms);
+
+	/** Layout any pending blocks that are visible or have the caret. */
+	void LayoutVisibleBlocks();
+
+	/** Time in milliseconds that Reformat may spend on blocks that are not visible. */
+	static const int REFORMAT_TIME_BUDGET = 5;
+
 	int32 GetContentWidth();
 	int32 GetContentHeight() const;
 
@@ -391,13 +493,18 @@ public:
 	int32 layout_height;
 	int32 content_width;
 	int32 content_height;
+	int32 ypos_base;	///< TBBlock::ypos of the first block. FlushLog moves it instead of all blocks.
 
 	TBLinkListOf<TBBlock> blocks;
+	TBBlockIndex block_index;
 
 	TBCaret caret;
 	TBSelection selection;
 	TBUndoRedoStack undoredo;
 
+	int32 log_max_lines;
+	TBTempBuffer log_buffer;
+
 	int32 scroll_x;
 	int32 scroll_y;
 
@@ -421,6 +528,7 @@ public:
 		uint32 win_style_br : 1;
 		uint32 calculate_content_width_needed : 1;	///< If content_width needs to be updated next GetContentWidth-
 		uint32 lock_scrollbars_counter : 5;			///< Incremental counter for if UpdateScrollbar should be probhited.
+		uint32 layout_pending : 1;					///< If there may be blocks with pending_layout set.
 	} packed;
 	uint32 packed_init;
 	};
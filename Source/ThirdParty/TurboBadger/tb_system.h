@@ -71,12 +71,26 @@ public:
 class TBFile
 {
 public:
-	enum TBFileMode { MODE_READ };
+	enum TBFileMode { MODE_READ, MODE_WRITE };
 	static TBFile *Open(const char *filename, TBFileMode mode);
 
 	virtual ~TBFile() {}
 	virtual long Size() = 0;
 	virtual size_t Read(void *buf, size_t elemSize, size_t count) = 0;
+
+	/** Write to a file opened with MODE_WRITE. Implementations that can't write
+		files (f.ex from read only assets) don't need to implement this. */
+	virtual size_t Write(const void *buf, size_t elemSize, size_t count) { return 0; }
+
+	/** Map the whole file (opened with MODE_READ) into memory, as a private copy that
+		may be modified without changing the file. The mapping is valid until the file
+		is deleted. Returns nullptr if the file can't be mapped (f.ex if the
+		implementation doesn't support it), and then Read has to be used instead. */
+	virtual char *Map() { return nullptr; }
+
+	/** Get the time the file was last modified, in seconds since any fixed point in time,
+		or 0 if it's not known. It's used to detect changed files without reading them. */
+	virtual double GetModifiedTime() { return 0; }
 };
 
 }; // namespace tb
@@ -12,7 +12,10 @@
 #include "tb_system.h"
 #include "tb_scroller.h"
 #include "tb_font_renderer.h"
+#include "tb_tempbuffer.h"
+#include "tb_profiler.h"
 #include <assert.h>
+#include <math.h>
 #ifdef TB_ALWAYS_SHOW_EDIT_FOCUS
 #include "tb_editfield.h"
 #endif // TB_ALWAYS_SHOW_EDIT_FOCUS
@@ -52,6 +55,125 @@ private:
 	bool m_touch;
 };
 
+// == TBWidgetHitIndex ==================================================================
+
+/** Uniform grid over the rects of the children of a widget, used by TBWidget::GetWidgetAt.
+	Each cell lists the children that overlap it, in the same order as the children. */
+class TBWidgetHitIndex
+{
+public:
+	TBWidgetHitIndex() : m_valid(false), m_cells_x(0), m_cells_y(0), m_cell_w(1), m_cell_h(1) {}
+
+	/** Make the index rebuild before it's used next time. */
+	void Invalidate() { m_valid = false; }
+
+	/** Get the children of widget that may be hit at x, y (in the coordinates of the children).
+		Returns the number of children, and sets children to point to the first. */
+	int GetChildrenAt(const TBWidget *widget, int x, int y, TBWidget **&children)
+	{
+		if (!m_valid)
+			Rebuild(widget);
+		if (!m_bounds.Contains(TBPoint(x, y)))
+			return 0;
+		int cell = ((y - m_bounds.y) / m_cell_h) * m_cells_x + (x - m_bounds.x) / m_cell_w;
+		int *cell_start = (int *) m_cell_start.GetData();
+		children = (TBWidget **) m_cell_children.GetData() + cell_start[cell];
+		return cell_start[cell + 1] - cell_start[cell];
+	}
+private:
+	void Rebuild(const TBWidget *widget)
+	{
+		m_valid = true;
+		m_bounds = TBRect();
+		int num_children = 0;
+		for (TBWidget *child = widget->GetFirstChild(); child; child = child->GetNext())
+			if (!child->GetRect().IsEmpty())
+			{
+				m_bounds = num_children ? m_bounds.Union(child->GetRect()) : child->GetRect();
+				num_children++;
+			}
+		if (!num_children)
+			return;
+
+		// Aim for about one child per cell, with square-ish cells.
+		const int max_cells = 64;
+		m_cells_x = (int) sqrt((double) num_children * m_bounds.w / MAX(m_bounds.h, 1));
+		m_cells_x = CLAMP(m_cells_x, 1, max_cells);
+		m_cells_y = CLAMP((num_children + m_cells_x - 1) / m_cells_x, 1, max_cells);
+		if (!FillCells(widget, num_children))
+		{
+			// The children overlap a lot, so the grid wouldn't be much help anyway.
+			m_cells_x = m_cells_y = 1;
+			FillCells(widget, num_children);
+		}
+	}
+
+	/** Fill the cells with the children. Returns false if the children overlap so many cells that
+		it's not worth it (or on out of memory). */
+	bool FillCells(const TBWidget *widget, int num_children)
+	{
+		const int num_cells = m_cells_x * m_cells_y;
+		m_cell_w = (m_bounds.w + m_cells_x - 1) / m_cells_x;
+		m_cell_h = (m_bounds.h + m_cells_y - 1) / m_cells_y;
+		if (!m_cell_start.Reserve((num_cells + 1) * sizeof(int)))
+		{
+			m_bounds = TBRect();
+			return true;
+		}
+		int *cell_start = (int *) m_cell_start.GetData();
+		memset(cell_start, 0, (num_cells + 1) * sizeof(int));
+
+		// Count the children in each cell, and turn the counts into start indexes.
+		int x0, y0, x1, y1;
+		for (TBWidget *child = widget->GetFirstChild(); child; child = child->GetNext())
+			if (GetCells(child->GetRect(), x0, y0, x1, y1))
+				for (int y = y0; y <= y1; y++)
+					for (int x = x0; x <= x1; x++)
+						cell_start[y * m_cells_x + x + 1]++;
+		for (int i = 0; i < num_cells; i++)
+			cell_start[i + 1] += cell_start[i];
+		int num_entries = cell_start[num_cells];
+		if (num_cells > 1 && num_entries > num_children * 4)
+			return false;
+		if (!m_cell_children.Reserve(MAX(num_entries, 1) * sizeof(TBWidget *)))
+		{
+			m_bounds = TBRect();
+			return true;
+		}
+
+		// Add the children, in order. cell_start is used as the insert position
+		// and is shifted back afterwards.
+		TBWidget **cell_children = (TBWidget **) m_cell_children.GetData();
+		for (TBWidget *child = widget->GetFirstChild(); child; child = child->GetNext())
+			if (GetCells(child->GetRect(), x0, y0, x1, y1))
+				for (int y = y0; y <= y1; y++)
+					for (int x = x0; x <= x1; x++)
+						cell_children[cell_start[y * m_cells_x + x]++] = child;
+		memmove(cell_start + 1, cell_start, num_cells * sizeof(int));
+		cell_start[0] = 0;
+		return true;
+	}
+
+	/** Get the range of cells overlapped by rect. Returns false if it's empty. */
+	bool GetCells(const TBRect &rect, int &x0, int &y0, int &x1, int &y1) const
+	{
+		if (rect.IsEmpty())
+			return false;
+		x0 = (rect.x - m_bounds.x) / m_cell_w;
+		y0 = (rect.y - m_bounds.y) / m_cell_h;
+		x1 = (rect.x + rect.w - 1 - m_bounds.x) / m_cell_w;
+		y1 = (rect.y + rect.h - 1 - m_bounds.y) / m_cell_h;
+		return true;
+	}
+
+	bool m_valid;
+	TBRect m_bounds;			///< The union of all child rects.
+	int m_cells_x, m_cells_y;	///< The number of cells.
+	int m_cell_w, m_cell_h;		///< The size of each cell.
+	TBTempBuffer m_cell_start;	///< int array with the index of the first child of each cell (and the end).
+	TBTempBuffer m_cell_children; ///< TBWidget * array with the children of all cells.
+};
+
 // == TBWidget::PaintProps ==============================================================
 
 TBWidget::PaintProps::PaintProps()
@@ -71,6 +193,7 @@ TBWidget::TBWidget()
 	, m_layout_params(nullptr)
 	, m_scroller(nullptr)
 	, m_long_click_timer(nullptr)
+	, m_hit_index(nullptr)
 	, m_packed_init(0)
 {
 #ifdef TB_RUNTIME_DEBUG_INFO
@@ -96,6 +219,7 @@ TBWidget::~TBWidget()
 
 	delete m_scroller;
 	delete m_layout_params;
+	delete m_hit_index;
 
 	StopLongClickTimer();
 
@@ -110,6 +234,9 @@ void TBWidget::SetRect(const TBRect &rect)
 	TBRect old_rect = m_rect;
 	m_rect = rect;
 
+	if (m_parent && m_parent->m_hit_index)
+		m_parent->m_hit_index->Invalidate();
+
 	if (old_rect.w != m_rect.w || old_rect.h != m_rect.h)
 		OnResized(old_rect.w, old_rect.h);
 
@@ -313,6 +440,9 @@ void TBWidget::AddChildRelative(TBWidget *child, WIDGET_Z_REL z, TBWidget *refer
 			m_children.AddLast(child);
 	}
 
+	if (m_hit_index)
+		m_hit_index->Invalidate();
+
 	if (info == WIDGET_INVOKE_INFO_NORMAL)
 	{
 		OnChildAdded(child);
@@ -343,6 +473,9 @@ void TBWidget::RemoveChild(TBWidget *child, WIDGET_INVOKE_INFO info)
 	m_children.Remove(child);
 	child->m_parent = nullptr;
 
+	if (m_hit_index)
+		m_hit_index->Invalidate();
+
 	InvalidateLayout(INVALIDATE_LAYOUT_RECURSIVE);
 	Invalidate();
 	InvalidateSkinStates();
@@ -677,6 +810,26 @@ TBWidget *TBWidget::GetWidgetAt(int x, int y, bool include_children) const
 	x -= child_translation_x;
 	y -= child_translation_y;
 
+	if (m_hit_index)
+	{
+		// Only check the children near x, y. The last one hit is on top.
+		TBWidget **children;
+		for (int i = m_hit_index->GetChildrenAt(this, x, y, children) - 1; i >= 0; i--)
+		{
+			TBWidget *tmp = children[i];
+			WIDGET_HIT_STATUS hit_status = tmp->GetHitStatus(x - tmp->m_rect.x, y - tmp->m_rect.y);
+			if (!hit_status)
+				continue;
+			if (include_children && hit_status != WIDGET_HIT_STATUS_HIT_NO_CHILDREN)
+			{
+				if (TBWidget *child_match = tmp->GetWidgetAt(x - tmp->m_rect.x, y - tmp->m_rect.y, include_children))
+					return child_match;
+			}
+			return tmp;
+		}
+		return nullptr;
+	}
+
 	TBWidget *tmp = GetFirstChild();
 	TBWidget *last_match = nullptr;
 	while (tmp)
@@ -698,6 +851,19 @@ TBWidget *TBWidget::GetWidgetAt(int x, int y, bool include_children) const
 	return last_match;
 }
 
+void TBWidget::SetHitTestIndex(bool enable)
+{
+	if (enable == GetHitTestIndex())
+		return;
+	if (enable)
+		m_hit_index = new TBWidgetHitIndex;
+	else
+	{
+		delete m_hit_index;
+		m_hit_index = nullptr;
+	}
+}
+
 TBWidget *TBWidget::GetChildFromIndex(int index) const
 {
 	int i = 0;
@@ -1107,6 +1273,7 @@ void TBWidget::InvokeSkinUpdatesInternal(bool force_update)
 
 void TBWidget::InvokeProcessInternal()
 {
+	TB_PROFILER_COUNT(WIDGETS_VISITED, 1);
 	OnProcess();
 
 	for (TBWidget *child = GetFirstChild(); child; child = child->GetNext())
@@ -1121,6 +1288,7 @@ void TBWidget::InvokeProcessStates(bool force_update)
 		return;
 	update_widget_states = false;
 
+	TB_PROFILER_COUNT(WIDGETS_VISITED, 1);
 	OnProcessStates();
 
 	for (TBWidget *child = GetFirstChild(); child; child = child->GetNext())
@@ -1139,6 +1307,8 @@ float TBWidget::CalculateOpacityInternal(WIDGET_STATE state, TBSkinElement *skin
 
 void TBWidget::InvokePaint(const PaintProps &parent_paint_props)
 {
+	TB_PROFILER_COUNT(WIDGETS_VISITED, 1);
+
 	// Don't paint invisible widgets
 	if (m_opacity == 0 || m_rect.IsEmpty() || GetVisibility() != WIDGET_VISIBILITY_VISIBLE)
 		return;
@@ -22,6 +22,7 @@ class TBFontFace;
 class TBScroller;
 class TBWidgetListener;
 class TBLongClickTimer;
+class TBWidgetHitIndex;
 struct INFLATE_INFO;
 
 // == Generic widget stuff =================================================
@@ -562,6 +563,14 @@ public:
 		is true, the search will recurse into the childrens children. */
 	TBWidget *GetWidgetAt(int x, int y, bool include_children) const;
 
+	/** Set if this widget should keep a spatial index (a uniform grid) of the rects of its children,
+		so GetWidgetAt only has to check the children near the coordinate instead of all of them.
+		This is useful for widgets with very many children. The index is rebuilt when needed
+		after children have been added, removed or changed rect.
+		Note: The children must never hit outside their rect (See GetHitStatus). */
+	void SetHitTestIndex(bool enable);
+	bool GetHitTestIndex() const { return m_hit_index ? true : false; }
+
 	/** Get the child at the given index, or nullptr if there was no child at that index.
 		Note: Avoid calling this in loops since it does iteration. Consider iterating
 		the widgets directly instead! */
@@ -985,6 +994,7 @@ private:
 	LayoutParams *m_layout_params;	///< Layout params, or nullptr.
 	TBScroller *m_scroller;
 	TBLongClickTimer *m_long_click_timer;
+	TBWidgetHitIndex *m_hit_index;	///< Spatial index of the children, or nullptr. See SetHitTestIndex.
 	union {
 		struct {
 			uint16 is_group_root : 1;
@@ -13,14 +13,97 @@ namespace tb {
 
 // == TBWidgetString =======================================
 
+/** Return true if ofs is at the start of a character in the UTF-8 string str with the length len. */
+static bool IsCharStart(const char *str, int len, int ofs)
+{
+	return ofs >= len || (str[ofs] & 0xC0) != 0x80;
+}
+
+/** Get the longest length of the start of str (or the end, if from_end is true) that is at most
+	max_w wide, assuming that str with the length len is wider than max_w. Sets width to the
+	width of it. Since the width grows with the length, this is a binary search on the length
+	so only a few widths have to be measured. */
+static int GetFittingLength(TBFontFace *font, const char *str, int len, int max_w, bool from_end, int &width)
+{
+	int fits_len = 0, fits_w = 0;
+	int overflow_len = len;
+	while (true)
+	{
+		// Find a character start between fits_len and overflow_len.
+		int mid = (fits_len + overflow_len) / 2;
+		while (mid > fits_len && !IsCharStart(str, len, from_end ? len - mid : mid))
+			mid--;
+		if (mid == fits_len)
+		{
+			mid = (fits_len + overflow_len) / 2 + 1;
+			while (mid < overflow_len && !IsCharStart(str, len, from_end ? len - mid : mid))
+				mid++;
+			if (mid >= overflow_len)
+				break;
+		}
+		int w = from_end ? font->GetStringWidth(str + len - mid, mid) : font->GetStringWidth(str, mid);
+		if (w <= max_w)
+		{
+			fits_len = mid;
+			fits_w = w;
+		}
+		else
+			overflow_len = mid;
+	}
+	width = fits_w;
+	return fits_len;
+}
+
 TBWidgetString::TBWidgetString()
 	: m_text_align(TB_TEXT_ALIGN_CENTER)
+	, m_text_ellipsis(TB_TEXT_ELLIPSIS_END)
+	, m_cached_font(nullptr)
+	, m_cached_width(0)
+	, m_cut_max_w(-1)
+	, m_cut_start_len(0)
+	, m_cut_start_w(0)
+	, m_cut_end_ofs(0)
 {
 }
 
+void TBWidgetString::UpdateCache(TBFontFace *font)
+{
+	if (m_cached_font == font)
+		return;
+	m_cached_font = font;
+	m_cached_width = font->GetStringWidth(m_text);
+	m_cut_max_w = -1;
+}
+
+void TBWidgetString::UpdateCut(TBFontFace *font, int max_w)
+{
+	UpdateCache(font);
+	if (m_cut_max_w == max_w)
+		return;
+	m_cut_max_w = max_w;
+
+	// const char *end = "…"; // 2026 HORIZONTAL ELLIPSIS
+	// Some fonts seem to render ellipsis a lot uglier than three dots.
+	int available_w = MAX(0, max_w - font->GetStringWidth("..."));
+	int len = m_text.Length();
+	if (m_text_ellipsis == TB_TEXT_ELLIPSIS_MIDDLE)
+	{
+		// Give the start half of the space, and the end what's left of it.
+		m_cut_start_len = GetFittingLength(font, m_text, len, available_w / 2, false, m_cut_start_w);
+		int end_w;
+		m_cut_end_ofs = len - GetFittingLength(font, m_text, len, available_w - m_cut_start_w, true, end_w);
+	}
+	else
+	{
+		m_cut_start_len = GetFittingLength(font, m_text, len, available_w, false, m_cut_start_w);
+		m_cut_end_ofs = len;
+	}
+}
+
 int TBWidgetString::GetWidth(TBWidget *widget)
 {
-	return widget->GetFont()->GetStringWidth(m_text);
+	UpdateCache(widget->GetFont());
+	return m_cached_width;
 }
 
 int TBWidgetString::GetHeight(TBWidget *widget)
@@ -45,29 +128,36 @@ void TBWidgetString::Paint(TBWidget *widget, const TBRect &rect, const TBColor &
 	else
 	{
 		// There's not enough room for the entire string
-		// so cut it off and end with ellipsis (...)
-
-		// const char *end = "…"; // 2026 HORIZONTAL ELLIPSIS
-		// Some fonts seem to render ellipsis a lot uglier than three dots.
-		const char *end = "...";
-
-		int endw = font->GetStringWidth(end);
-		int startw = 0;
-		int startlen = 0;
-		while (m_text.CStr()[startlen])
+		// so cut it off and replace it with ellipsis (...)
+		// The cut is cached, so this only has to be calculated
+		// again if the text, font or width changes.
+		UpdateCut(font, rect.w);
+		x = rect.x;
+		font->DrawString(x, y, color, m_text, m_cut_start_len);
+		x += m_cut_start_w;
+		font->DrawString(x, y, color, "...");
+		if (m_cut_end_ofs < m_text.Length())
 		{
-			int new_startw = font->GetStringWidth(m_text, startlen);
-			if (new_startw + endw > rect.w)
-				break;
-			startw = new_startw;
-			startlen++;
+			x += font->GetStringWidth("...");
+			font->DrawString(x, y, color, m_text.CStr() + m_cut_end_ofs, m_text.Length() - m_cut_end_ofs);
 		}
-		startlen = MAX(0, startlen - 1);
-		font->DrawString(x, y, color, m_text, startlen);
-		font->DrawString(x + startw, y, color, end);
 	}
 }
 
+void TBWidgetString::GetVisibleText(TBWidget *widget, int max_w, TBStr &text)
+{
+	TBFontFace *font = widget->GetFont();
+	if (GetWidth(widget) <= max_w)
+	{
+		text.Set(m_text);
+		return;
+	}
+	UpdateCut(font, max_w);
+	text.Set(m_text, m_cut_start_len);
+	text.Append("...");
+	text.Append(m_text.CStr() + m_cut_end_ofs);
+}
+
 // == TBTextField =======================================
 
 /** This value on m_cached_text_width means it needs to be updated again. */
@@ -90,6 +180,14 @@ bool TBTextField::SetText(const char *text)
 	return m_text.SetText(text);
 }
 
+void TBTextField::SetTextEllipsis(TB_TEXT_ELLIPSIS ellipsis)
+{
+	if (ellipsis == m_text.GetTextEllipsis())
+		return;
+	m_text.SetTextEllipsis(ellipsis);
+	Invalidate();
+}
+
 void TBTextField::SetSqueezable(bool squeezable)
 {
 	if (squeezable == m_squeezable)
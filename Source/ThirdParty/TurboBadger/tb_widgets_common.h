@@ -19,6 +19,13 @@ enum TB_TEXT_ALIGN {
 	TB_TEXT_ALIGN_CENTER	///< Aligned center
 };
 
+/** TB_TEXT_ELLIPSIS specifies which part of a text is replaced with ellipsis
+	if there's not enough room for it. */
+enum TB_TEXT_ELLIPSIS {
+	TB_TEXT_ELLIPSIS_END,		///< The end is cut off
+	TB_TEXT_ELLIPSIS_MIDDLE		///< The middle is cut off, so the end remains visible (f.ex for paths)
+};
+
 /** TBWidgetString holds a string that can be painted as one line with the set alignment. */
 class TBWidgetString
 {
@@ -30,7 +37,10 @@ public:
 	int GetWidth(TBWidget *widget);
 	int GetHeight(TBWidget *widget);
 
-	bool SetText(const char *text) { return m_text.Set(text); }
+	/** Get the text as it's painted within the width max_w, with ellipsis if it doesn't fit. */
+	void GetVisibleText(TBWidget *widget, int max_w, TBStr &text);
+
+	bool SetText(const char *text) { InvalidateCache(); return m_text.Set(text); }
 	bool GetText(TBStr &text) const { return text.Set(m_text); }
 
 	bool IsEmpty() const { return m_text.IsEmpty(); }
@@ -39,9 +49,30 @@ public:
 		given when painting is larger than the text. */
 	void SetTextAlign(TB_TEXT_ALIGN align) { m_text_align = align; }
 	TB_TEXT_ALIGN GetTextAlign() { return m_text_align; }
+
+	/** Set which part of the text should be cut off if the space given
+		when painting is smaller than the text. Default is TB_TEXT_ELLIPSIS_END. */
+	void SetTextEllipsis(TB_TEXT_ELLIPSIS ellipsis) { m_text_ellipsis = ellipsis; InvalidateCache(); }
+	TB_TEXT_ELLIPSIS GetTextEllipsis() const { return m_text_ellipsis; }
+
+	/** Invalidate the cached width and cut off positions. This must be called if
+		m_text is changed without using SetText. */
+	void InvalidateCache() { m_cached_font = nullptr; }
 public:
 	TBStr m_text;
 	TB_TEXT_ALIGN m_text_align;
+	TB_TEXT_ELLIPSIS m_text_ellipsis;
+private:
+	void UpdateCache(TBFontFace *font);
+	void UpdateCut(TBFontFace *font, int max_w);
+
+	// Cached for m_cached_font (nullptr if not cached).
+	TBFontFace *m_cached_font;
+	int m_cached_width;			///< Width of m_text.
+	int m_cut_max_w;			///< The width m_cut_* were calculated for, or -1.
+	int m_cut_start_len;		///< Length of the text to paint before the ellipsis.
+	int m_cut_start_w;			///< Width of the text before the ellipsis.
+	int m_cut_end_ofs;			///< Offset of the text to paint after the ellipsis.
 };
 
 /** TBTextField is a one line text field that is not editable. */
@@ -66,6 +97,10 @@ public:
 	void SetTextAlign(TB_TEXT_ALIGN align) { m_text.SetTextAlign(align); }
 	TB_TEXT_ALIGN GetTextAlign() { return m_text.GetTextAlign(); }
 
+	/** Set which part of the text should be cut off if it doesn't fit. */
+	void SetTextEllipsis(TB_TEXT_ELLIPSIS ellipsis);
+	TB_TEXT_ELLIPSIS GetTextEllipsis() const { return m_text.GetTextEllipsis(); }
+
 	/** Set if this text field should be allowed to squeeze below its
 		preferred size. If squeezable it may shrink to width 0. */
 	void SetSqueezable(bool squeezable);
@@ -13,6 +13,8 @@
 #include "tb_node_tree.h"
 #include "tb_font_renderer.h"
 #include "tb_toggle_container.h"
+#include "tb_tempbuffer.h"
+#include "tb_system.h"
 #include "image/tb_image_widget.h"
 
 namespace tb {
@@ -40,6 +42,8 @@ void TBWidget::OnInflate(const INFLATE_INFO &info)
 
 	SetIgnoreInput(info.node->GetValueInt("ignore-input", GetIgnoreInput()) ? true : false);
 
+	SetHitTestIndex(info.node->GetValueInt("hit-test-index", GetHitTestIndex()) ? true : false);
+
 	SetOpacity(info.node->GetValueFloat("opacity", GetOpacity()));
 
 	if (const char *text = info.node->GetValueString("text", nullptr))
@@ -349,6 +353,9 @@ void TBSelectList::OnInflate(const INFLATE_INFO &info)
 {
 	// Read items (if there is any) into the default source
 	ReadItems(info.node, GetDefaultSource());
+	SetVirtualized(info.node->GetValueInt("virtualized", GetVirtualized()) ? true : false);
+	if (const char *item_height = info.node->GetValueString("item-height", nullptr))
+		SetItemHeight(g_tb_skin->GetDimensionConverter()->GetPxFromString(item_height, 0));
 	TBWidget::OnInflate(info);
 }
 
@@ -372,6 +379,11 @@ void TBTextField::OnInflate(const INFLATE_INFO &info)
 		else if (!strcmp(text_align, "center"))	SetTextAlign(TB_TEXT_ALIGN_CENTER);
 		else if (!strcmp(text_align, "right"))	SetTextAlign(TB_TEXT_ALIGN_RIGHT);
 	}
+	if (const char *text_ellipsis = info.node->GetValueString("text-ellipsis", nullptr))
+	{
+		if (!strcmp(text_ellipsis, "end"))			SetTextEllipsis(TB_TEXT_ELLIPSIS_END);
+		else if (!strcmp(text_ellipsis, "middle"))	SetTextEllipsis(TB_TEXT_ELLIPSIS_MIDDLE);
+	}
 	TBWidget::OnInflate(info);
 }
 
@@ -455,7 +467,7 @@ TBWidgetsReader::~TBWidgetsReader()
 bool TBWidgetsReader::LoadFile(TBWidget *target, const char *filename)
 {
 	TBNode node;
-	if (!node.ReadFile(filename))
+	if (!node.ReadFile(filename, TB_NODE_READ_FLAGS_ARENA))
 		return false;
 	LoadNodeTree(target, &node);
 	return true;
@@ -464,7 +476,7 @@ bool TBWidgetsReader::LoadFile(TBWidget *target, const char *filename)
 bool TBWidgetsReader::LoadData(TBWidget *target, const char *data)
 {
 	TBNode node;
-	node.ReadData(data);
+	node.ReadData(data, TB_NODE_READ_FLAGS_ARENA);
 	LoadNodeTree(target, &node);
 	return true;
 }
@@ -472,7 +484,7 @@ bool TBWidgetsReader::LoadData(TBWidget *target, const char *data)
 bool TBWidgetsReader::LoadData(TBWidget *target, const char *data, int data_len)
 {
 	TBNode node;
-	node.ReadData(data, data_len);
+	node.ReadData(data, data_len, TB_NODE_READ_FLAGS_ARENA);
 	LoadNodeTree(target, &node);
 	return true;
 }
@@ -494,36 +506,448 @@ void TBWidgetsReader::SetIDFromNode(TBID &id, TBNode *node)
 		id.Set(node->GetValue().GetInt());
 }
 
+bool TBWidgetsReader::AddFactory(TBWidgetFactory *wf)
+{
+	uint32 hash = TBGetHash(wf->name);
+	if (!factories_hash.Get(hash) && !factories_hash.Add(hash, wf))
+		return false;
+	factories.AddLast(wf);
+	return true;
+}
+
+void TBWidgetsReader::RemoveFactory(TBWidgetFactory *wf)
+{
+	factories.Remove(wf);
+	ClearTemplateCache();
+
+	// Let the next factory with the same name hash (if any) take its place.
+	uint32 hash = TBGetHash(wf->name);
+	if (factories_hash.Get(hash) != wf)
+		return;
+	factories_hash.Remove(hash);
+	for (TBWidgetFactory *other = factories.GetFirst(); other; other = other->GetNext())
+		if (TBGetHash(other->name) == hash)
+		{
+			factories_hash.Add(hash, other);
+			break;
+		}
+}
+
+TBWidgetFactory *TBWidgetsReader::GetFactory(const char *name)
+{
+	TBWidgetFactory *wc = factories_hash.Get(TBGetHash(name));
+	if (!wc || strcmp(name, wc->name) == 0)
+		return wc;
+
+	// Another name has the same hash, so search for it the slow way.
+	for (wc = factories.GetFirst(); wc; wc = wc->GetNext())
+		if (strcmp(name, wc->name) == 0)
+			return wc;
+	return nullptr;
+}
+
 bool TBWidgetsReader::CreateWidget(TBWidget *target, TBNode *node)
 {
 	// Find a widget creator from the node name
-	TBWidgetFactory *wc = nullptr;
-	for (wc = factories.GetFirst(); wc; wc = wc->GetNext())
-		if (strcmp(node->GetName(), wc->name) == 0)
-			break;
+	TBWidgetFactory *wc = GetFactory(node->GetName());
 	if (!wc)
 		return false;
 
+	TBWidget *new_widget = InflateWidget(target, node, wc);
+	if (!new_widget)
+		return false;
+
+	// Iterate through all nodes and create widgets
+	for (TBNode *n = node->GetFirstChild(); n; n = n->GetNext())
+		CreateWidget(new_widget, n);
+
+	if (node->GetValueInt("autofocus", 0))
+		new_widget->SetFocus(WIDGET_FOCUS_REASON_UNKNOWN);
+
+	return true;
+}
+
+TBWidget *TBWidgetsReader::InflateWidget(TBWidget *target, TBNode *node, TBWidgetFactory *wc)
+{
 	// Create the widget
 	INFLATE_INFO info(this, target->GetContentRoot(), node, wc->sync_type);
 	TBWidget *new_widget = wc->Create(&info);
 	if (!new_widget)
-		return false;
+		return nullptr;
 
 	// Read properties and add i to the hierarchy.
 	new_widget->OnInflate(info);
 
 	// If this assert is trigged, you probably forgot to call TBWidget::OnInflate from an overridden version.
 	assert(new_widget->GetParent());
+	return new_widget;
+}
 
-	// Iterate through all nodes and create widgets
-	for (TBNode *n = node->GetFirstChild(); n; n = n->GetNext())
-		CreateWidget(new_widget, n);
+void TBWidgetsReader::LoadTemplate(TBWidget *target, TBWidgetTemplate *widget_template)
+{
+	CreateWidgets(target, widget_template->m_items, widget_template->m_num_items);
+}
 
-	if (node->GetValueInt("autofocus", 0))
-		new_widget->SetFocus(WIDGET_FOCUS_REASON_UNKNOWN);
+bool TBWidgetsReader::LoadTemplate(TBWidget *target, const char *filename)
+{
+	TBWidgetTemplate *widget_template = GetTemplate(filename);
+	if (!widget_template)
+		return false;
+	LoadTemplate(target, widget_template);
+	return true;
+}
+
+void TBWidgetsReader::CreateWidgets(TBWidget *target, const TBWidgetTemplate::ITEM *items, int num_items)
+{
+	// Skip the descendants of each item, since they are created by the recursive call.
+	for (int i = 0; i < num_items; i += items[i].num_descendants + 1)
+	{
+		const TBWidgetTemplate::ITEM *item = &items[i];
+		TBWidget *new_widget = InflateWidget(target, item->node, item->factory);
+		if (!new_widget)
+			continue;
+
+		CreateWidgets(new_widget, item + 1, item->num_descendants);
+
+		if (item->autofocus_node && item->autofocus_node->GetValueFollowRef().GetInt())
+			new_widget->SetFocus(WIDGET_FOCUS_REASON_UNKNOWN);
+	}
+}
+
+TBWidgetTemplate *TBWidgetsReader::GetTemplate(const char *filename)
+{
+	if (TBWidgetTemplate *widget_template = templates.Get(TBID(filename)))
+		return widget_template;
+	TBWidgetTemplate *widget_template = new TBWidgetTemplate;
+	if (!widget_template || !widget_template->ReadFile(this, filename))
+	{
+		delete widget_template;
+		return nullptr;
+	}
+	// AddTemplate deletes the template if it fails.
+	if (!AddTemplate(filename, widget_template))
+		return nullptr;
+	return widget_template;
+}
+
+bool TBWidgetsReader::AddTemplate(const char *filename, TBWidgetTemplate *widget_template)
+{
+	TBID id(filename);
+	if (TBWidgetTemplate *old_template = templates.Get(id))
+	{
+		// Adding the cached template again would delete it.
+		if (old_template == widget_template)
+			return true;
+		templates.Delete(id);
+	}
+	if (!templates.Add(id, widget_template))
+	{
+		delete widget_template;
+		return false;
+	}
+	return true;
+}
+
+// == TBWidgetTemplate ==================================
+
+void TBWidgetTemplate::Clear()
+{
+	delete [] m_items;
+	m_items = nullptr;
+	m_num_items = 0;
+	m_node.Clear();
+}
+
+bool TBWidgetTemplate::Compile(TBWidgetsReader *reader, TBNode *node)
+{
+	Clear();
+	while (TBNode *child = node->GetFirstChild())
+	{
+		node->Remove(child);
+		m_node.Add(child);
+	}
+	return CompileItems(reader);
+}
+
+bool TBWidgetTemplate::ReadFile(TBWidgetsReader *reader, const char *filename)
+{
+	// Read straight into m_node so the arena lives as long as the template.
+	Clear();
+	if (!m_node.ReadFile(filename, TB_NODE_READ_FLAGS_ARENA))
+		return false;
+	return CompileItems(reader);
+}
+
+bool TBWidgetTemplate::ReadData(TBWidgetsReader *reader, const char *data, int data_len)
+{
+	Clear();
+	m_node.ReadData(data, data_len, TB_NODE_READ_FLAGS_ARENA);
+	return CompileItems(reader);
+}
+
+bool TBWidgetTemplate::CompileItems(TBWidgetsReader *reader)
+{
+	int num_items = CountItems(reader, &m_node);
+	if (num_items && !(m_items = new ITEM[num_items]))
+		return false;
+	AddItems(reader, &m_node);
+	assert(m_num_items == num_items);
+	return true;
+}
+
+int TBWidgetTemplate::CountItems(TBWidgetsReader *reader, TBNode *node) const
+{
+	// Nodes that has no factory are skipped with all their children, like in LoadNodeTree.
+	int count = 0;
+	for (TBNode *child = node->GetFirstChild(); child; child = child->GetNext())
+		if (reader->GetFactory(child->GetName()))
+			count += 1 + CountItems(reader, child);
+	return count;
+}
+
+int TBWidgetTemplate::AddItems(TBWidgetsReader *reader, TBNode *node)
+{
+	int first_item = m_num_items;
+	for (TBNode *child = node->GetFirstChild(); child; child = child->GetNext())
+	{
+		TBWidgetFactory *wc = reader->GetFactory(child->GetName());
+		if (!wc)
+			continue;
+		ITEM *item = &m_items[m_num_items++];
+		item->factory = wc;
+		item->node = child;
+		item->autofocus_node = child->GetNode("autofocus");
+		item->num_descendants = AddItems(reader, child);
+	}
+	return m_num_items - first_item;
+}
+
+// Compiled template layout (native byte order, since it's meant as a cache on the
+// platform it was saved on): TBTemplateHeader, then the number of children of the
+// root node followed by the children. Each child is written as its null terminated
+// name, its value, and then its own children the same way.
+#define TB_TEMPLATE_MAGIC		0x54575442 // "TBWT"
+#define TB_TEMPLATE_VERSION		1
+
+/** Max depth of nodes and arrays, so invalid data can't make us recurse too deep. */
+#define TB_TEMPLATE_MAX_DEPTH	256
+
+struct TBTemplateHeader
+{
+	uint32 magic;
+	uint32 version;
+	uint32 hash;
+};
+
+static bool WriteInt(TBTempBuffer &buf, int32 value)
+{
+	return buf.Append((const char *) &value, sizeof(value));
+}
+
+static bool WriteValue(TBTempBuffer &buf, TBValue &value)
+{
+	// Objects can't be saved, and are saved as null.
+	TBValue::TYPE type = value.GetType() == TBValue::TYPE_OBJECT ? TBValue::TYPE_NULL : value.GetType();
+	if (!WriteInt(buf, type))
+		return false;
+	switch (type)
+	{
+	case TBValue::TYPE_STRING:
+		return buf.Append(value.GetString(), strlen(value.GetString()) + 1);
+	case TBValue::TYPE_FLOAT:
+	{
+		float f = value.GetFloat();
+		return buf.Append((const char *) &f, sizeof(f));
+	}
+	case TBValue::TYPE_INT:
+		return WriteInt(buf, value.GetInt());
+	case TBValue::TYPE_ARRAY:
+	{
+		TBValueArray *arr = value.GetArray();
+		if (!WriteInt(buf, arr->GetLength()))
+			return false;
+		for (int i = 0; i < arr->GetLength(); i++)
+			if (!WriteValue(buf, *arr->GetValue(i)))
+				return false;
+		return true;
+	}
+	default:
+		return true;
+	}
+}
+
+static bool WriteChildren(TBTempBuffer &buf, TBNode *node)
+{
+	int num_children = 0;
+	for (TBNode *child = node->GetFirstChild(); child; child = child->GetNext())
+		num_children++;
+	if (!WriteInt(buf, num_children))
+		return false;
+	for (TBNode *child = node->GetFirstChild(); child; child = child->GetNext())
+	{
+		if (!buf.Append(child->GetName(), strlen(child->GetName()) + 1) ||
+			!WriteValue(buf, child->GetValue()) ||
+			!WriteChildren(buf, child))
+			return false;
+	}
+	return true;
+}
+
+/** Reads data saved by TBWidgetTemplate::SaveCompiled, and fails on any data out of bounds. */
+class TBTemplateDataReader
+{
+public:
+	TBTemplateDataReader(const char *data, int data_len) : src(data), src_end(data + data_len) {}
+
+	bool ReadInt(int32 &value)
+	{
+		if (src_end - src < (int) sizeof(value))
+			return false;
+		memcpy(&value, src, sizeof(value));
+		src += sizeof(value);
+		return true;
+	}
+
+	/** Read a null terminated string, or return nullptr. */
+	const char *ReadString()
+	{
+		const char *str = src;
+		const char *end = (const char *) memchr(src, 0, src_end - src);
+		if (!end)
+			return nullptr;
+		src = end + 1;
+		return str;
+	}
+
+	bool ReadValue(TBValue &value, int depth)
+	{
+		int32 type;
+		if (!ReadInt(type))
+			return false;
+		switch (type)
+		{
+		case TBValue::TYPE_NULL:
+			value.SetNull();
+			return true;
+		case TBValue::TYPE_STRING:
+		{
+			const char *str = ReadString();
+			if (!str)
+				return false;
+			value.SetString(str, TBValue::SET_NEW_COPY);
+			return true;
+		}
+		case TBValue::TYPE_FLOAT:
+		{
+			float f;
+			if (src_end - src < (int) sizeof(f))
+				return false;
+			memcpy(&f, src, sizeof(f));
+			src += sizeof(f);
+			value.SetFloat(f);
+			return true;
+		}
+		case TBValue::TYPE_INT:
+		{
+			int32 i;
+			if (!ReadInt(i))
+				return false;
+			value.SetInt(i);
+			return true;
+		}
+		case TBValue::TYPE_ARRAY:
+		{
+			int32 length;
+			if (depth > TB_TEMPLATE_MAX_DEPTH || !ReadInt(length) || length < 0)
+				return false;
+			TBValueArray *arr = new TBValueArray;
+			if (!arr)
+				return false;
+			value.SetArray(arr, TBValue::SET_TAKE_OWNERSHIP);
+			for (int i = 0; i < length; i++)
+			{
+				TBValue *element = arr->AddValue();
+				if (!element || !ReadValue(*element, depth + 1))
+					return false;
+			}
+			return true;
+		}
+		default:
+			return false;
+		}
+	}
+
+	bool ReadChildren(TBNode *node, int depth)
+	{
+		int32 num_children;
+		if (depth > TB_TEMPLATE_MAX_DEPTH || !ReadInt(num_children) || num_children < 0)
+			return false;
+		for (int i = 0; i < num_children; i++)
+		{
+			const char *name = ReadString();
+			TBNode *child = name ? TBNode::Create(name) : nullptr;
+			if (!child)
+				return false;
+			node->Add(child);
+			if (!ReadValue(child->GetValue(), depth + 1) || !ReadChildren(child, depth + 1))
+				return false;
+		}
+		return true;
+	}
+
+	const char *src;
+	const char *src_end;
+};
+
+bool TBWidgetTemplate::SaveCompiled(TBTempBuffer &buf, uint32 hash)
+{
+	TBTemplateHeader header = { TB_TEMPLATE_MAGIC, TB_TEMPLATE_VERSION, hash };
+	return buf.Append((const char *) &header, sizeof(header)) &&
+			WriteChildren(buf, &m_node);
+}
 
+bool TBWidgetTemplate::SaveCompiledFile(const char *filename, uint32 hash)
+{
+	TBTempBuffer buf;
+	if (!SaveCompiled(buf, hash))
+		return false;
+	TBFile *file = TBFile::Open(filename, TBFile::MODE_WRITE);
+	if (!file)
+		return false;
+	bool success = file->Write(buf.GetData(), 1, buf.GetAppendPos()) == (size_t) buf.GetAppendPos();
+	delete file;
+	return success;
+}
+
+bool TBWidgetTemplate::LoadCompiled(TBWidgetsReader *reader, const char *data, int data_len, uint32 hash)
+{
+	Clear();
+	TBTemplateHeader header;
+	if (data_len < (int) sizeof(header))
+		return false;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != TB_TEMPLATE_MAGIC || header.version != TB_TEMPLATE_VERSION || header.hash != hash)
+		return false;
+	TBTemplateDataReader data_reader(data + sizeof(header), data_len - sizeof(header));
+	if (!data_reader.ReadChildren(&m_node, 0) || !CompileItems(reader))
+	{
+		Clear();
+		return false;
+	}
 	return true;
 }
 
+bool TBWidgetTemplate::LoadCompiledFile(TBWidgetsReader *reader, const char *filename, uint32 hash)
+{
+	// Read the whole file at once.
+	TBTempBuffer buf;
+	TBFile *file = TBFile::Open(filename, TBFile::MODE_READ);
+	if (!file)
+		return false;
+	long size = file->Size();
+	bool read_ok = buf.Reserve(size) && file->Read(buf.GetData(), 1, size) == (size_t) size;
+	delete file;
+	return read_ok && LoadCompiled(reader, buf.GetData(), size, hash);
+}
+
 }; // namespace tb
@@ -7,6 +7,8 @@
 #define TBWIDGETS_READER_H
 
 #include "tb_linklist.h"
+#include "tb_hashtable.h"
+#include "tb_node_tree.h"
 #include "tb_widgets.h"
 
 namespace tb {
@@ -15,6 +17,7 @@ class TBWidgetsReader;
 class TBWidgetFactory;
 class TBWidget;
 class TBNode;
+class TBTempBuffer;
 
 /** INFLATE_INFO contains info passed to TBWidget::OnInflate during resource loading. */
 struct INFLATE_INFO {
@@ -35,6 +38,7 @@ class TBWidgetFactory : public TBLinkOf<TBWidgetFactory>
 {
 public:
 	TBWidgetFactory(const char *name, TBValue::TYPE sync_type);
+	virtual ~TBWidgetFactory() {}
 
 	/** Create and return the new widget or nullptr on out of memory. */
 	virtual TBWidget *Create(INFLATE_INFO *info) = 0;
@@ -81,6 +85,74 @@ public:
 	static classname##WidgetFactory classname##_wf; \
 	void classname##WidgetFactory::ReadCustomProps(classname *widget, INFLATE_INFO *info)
 
+/** TBWidgetTemplate is a compiled widget resource, that can be inflated any number
+	of times without parsing it again.
+
+	When compiled, the factory of each widget node is resolved and the widget nodes
+	are stored in a flat array (in the order they are created), so inflating it is a
+	straight walk over that array. The nodes are still passed to TBWidget::OnInflate,
+	so widgets read their properties the same way as from TBWidgetsReader::LoadFile.
+
+	Note that conditions (@if), includes and files are resolved when the resource
+	is read, so a template won't change if the TBNodeRefTree values they depend on
+	change later. References in property values are still followed when inflating.
+
+	The template keeps pointers to the factories, so it must not be used after any of
+	them is removed from the reader. */
+class TBWidgetTemplate
+{
+public:
+	TBWidgetTemplate() : m_items(nullptr), m_num_items(0) {}
+	~TBWidgetTemplate() { Clear(); }
+
+	/** Compile a template from the children of node. The children are moved from
+		node into the template, so node must not have been read with
+		TB_NODE_READ_FLAGS_ARENA (the arena would be freed with node). */
+	bool Compile(TBWidgetsReader *reader, TBNode *node);
+
+	/** Read a resource file and compile it. */
+	bool ReadFile(TBWidgetsReader *reader, const char *filename);
+
+	/** Read a resource from a buffer and compile it. */
+	bool ReadData(TBWidgetsReader *reader, const char *data, int data_len);
+
+	/** Append the template in binary form to buf, so it can be loaded later without
+		parsing with LoadCompiled. The format uses native byte order, so it's meant to
+		be used as a cache on the platform it was saved on.
+		hash should identify the source of the template (f.ex a hash of the resource
+		file and anything it includes), so LoadCompiled can tell if it's outdated. */
+	bool SaveCompiled(TBTempBuffer &buf, uint32 hash);
+
+	/** Save the template in binary form to a file. See SaveCompiled. */
+	bool SaveCompiledFile(const char *filename, uint32 hash);
+
+	/** Load a template saved with SaveCompiled. Returns false if the data is invalid
+		or was saved with a different hash. */
+	bool LoadCompiled(TBWidgetsReader *reader, const char *data, int data_len, uint32 hash);
+
+	/** Load a template saved with SaveCompiledFile. See LoadCompiled. */
+	bool LoadCompiledFile(TBWidgetsReader *reader, const char *filename, uint32 hash);
+
+	/** Get the number of widgets inflated by this template (if no OnInflate creates more). */
+	int GetNumWidgets() const { return m_num_items; }
+
+	void Clear();
+private:
+	friend class TBWidgetsReader;
+	struct ITEM {
+		TBWidgetFactory *factory;
+		TBNode *node;
+		TBNode *autofocus_node;	///< The autofocus node, or nullptr if there is none.
+		int num_descendants;	///< The number of items following this one that are its descendants.
+	};
+	bool CompileItems(TBWidgetsReader *reader);
+	int CountItems(TBWidgetsReader *reader, TBNode *node) const;
+	int AddItems(TBWidgetsReader *reader, TBNode *node);
+	TBNode m_node;
+	ITEM *m_items;
+	int m_num_items;
+};
+
 /**
 	TBWidgetsReader parse a resource file (or buffer) into a TBNode tree,
 	and turn it into a hierarchy of widgets. It can create all types of widgets
@@ -101,6 +173,9 @@ public:
 
 	Files can be included by using the syntax "@file filename".
 
+	Resources that are loaded many times can be compiled into a TBWidgetTemplate
+	once, using GetTemplate, and then inflated with LoadTemplate.
+
 	Each factory may have its own set of properties, but a set of generic
 	properties is always supported on all widgets. Those are:
 
@@ -144,8 +219,11 @@ public:
 	/** Add a widget factory. Does not take ownership of the factory.
 		The easiest way to add factories for custom widget types, is using the
 		TB_WIDGET_FACTORY macro that automatically register it during startup. */
-	bool AddFactory(TBWidgetFactory *wf) { factories.AddLast(wf); return true; }
-	void RemoveFactory(TBWidgetFactory *wf) { factories.Remove(wf); }
+	bool AddFactory(TBWidgetFactory *wf);
+	void RemoveFactory(TBWidgetFactory *wf);
+
+	/** Get the factory for the given widget name, or nullptr if there is none. */
+	TBWidgetFactory *GetFactory(const char *name);
 
 	/** Set the id from the given node. */
 	static void SetIDFromNode(TBID &id, TBNode *node);
@@ -154,10 +232,34 @@ public:
 	bool LoadData(TBWidget *target, const char *data);
 	bool LoadData(TBWidget *target, const char *data, int data_len);
 	void LoadNodeTree(TBWidget *target, TBNode *node);
+
+	/** Create the widgets in the template and add them to target. */
+	void LoadTemplate(TBWidget *target, TBWidgetTemplate *widget_template);
+
+	/** Create the widgets in the template for the given file (See GetTemplate),
+		and add them to target. Returns false if the file couldn't be read. */
+	bool LoadTemplate(TBWidget *target, const char *filename);
+
+	/** Get the compiled template for the given resource file. The file is read and
+		compiled the first time, and then kept in the template cache until
+		ClearTemplateCache is called. Returns nullptr if the file couldn't be read. */
+	TBWidgetTemplate *GetTemplate(const char *filename);
+
+	/** Add a template (f.ex loaded with TBWidgetTemplate::LoadCompiledFile) to the
+		template cache, so GetTemplate returns it for the given file.
+		Takes ownership of the template, also if it fails. */
+	bool AddTemplate(const char *filename, TBWidgetTemplate *widget_template);
+
+	/** Delete all templates in the template cache. */
+	void ClearTemplateCache() { templates.DeleteAll(); }
 private:
 	bool Init();
 	bool CreateWidget(TBWidget *target, TBNode *node);
+	TBWidget *InflateWidget(TBWidget *target, TBNode *node, TBWidgetFactory *wc);
+	void CreateWidgets(TBWidget *target, const TBWidgetTemplate::ITEM *items, int num_items);
 	TBLinkListOf<TBWidgetFactory> factories;
+	TBHashTableOf<TBWidgetFactory> factories_hash;	///< The first added factory for each name hash.
+	TBHashTableAutoDeleteOf<TBWidgetTemplate> templates;
 };
 
 }; // namespace tb
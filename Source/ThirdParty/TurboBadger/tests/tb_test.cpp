@@ -12,17 +12,23 @@
 // as an library.
 TB_FORCE_LINK_TEST_GROUP(tb_color);
 TB_FORCE_LINK_TEST_GROUP(tb_dimension_converter);
+TB_FORCE_LINK_TEST_GROUP(tb_font_renderer);
 TB_FORCE_LINK_TEST_GROUP(tb_geometry);
+TB_FORCE_LINK_TEST_GROUP(tb_hashtable);
 TB_FORCE_LINK_TEST_GROUP(tb_linklist);
+TB_FORCE_LINK_TEST_GROUP(tb_msg);
+TB_FORCE_LINK_TEST_GROUP(tb_node_tree);
 TB_FORCE_LINK_TEST_GROUP(tb_node_ref_tree);
 TB_FORCE_LINK_TEST_GROUP(tb_object);
 TB_FORCE_LINK_TEST_GROUP(tb_parser);
+TB_FORCE_LINK_TEST_GROUP(tb_profiler);
 TB_FORCE_LINK_TEST_GROUP(tb_space_allocator);
 TB_FORCE_LINK_TEST_GROUP(tb_editfield);
 TB_FORCE_LINK_TEST_GROUP(tb_tempbuffer);
 TB_FORCE_LINK_TEST_GROUP(tb_test);
 TB_FORCE_LINK_TEST_GROUP(tb_value);
 TB_FORCE_LINK_TEST_GROUP(tb_widget_value_text);
+TB_FORCE_LINK_TEST_GROUP(tb_widget_hit_index);
 #endif
 
 namespace tb {
@@ -0,0 +1,95 @@
+// ================================================================================
+// ==      This file is a part of Turbo Badger. (C) 2011-2014, Emil Segerås      ==
+// ==                     See tb_core.h for more information.                    ==
+// ================================================================================
+
+#include "tb_test.h"
+#include "tb_font_renderer.h"
+
+#ifdef TB_UNIT_TESTING
+
+using namespace tb;
+
+TB_TEST_GROUP(tb_font_renderer)
+{
+	/** Font renderer that renders nothing, but gives each code point its own
+		advance, so that it's visible if the advance of another one is returned. */
+	class AdvanceFontRenderer : public TBFontRenderer
+	{
+	public:
+		AdvanceFontRenderer(int size) : m_size(size) {}
+		virtual TBFontFace *Create(TBFontManager *font_manager, const char *filename,
+									const TBFontDescription &font_desc) { return nullptr; }
+		virtual bool RenderGlyph(TBFontGlyphData *data, UCS4 cp) { return false; }
+		virtual void GetGlyphMetrics(TBGlyphMetrics *metrics, UCS4 cp) { metrics->advance = GetAdvance(m_size, cp); }
+		virtual TBFontMetrics GetMetrics()
+		{
+			TBFontMetrics metrics;
+			metrics.ascent = m_size - m_size / 4;
+			metrics.descent = m_size / 4;
+			metrics.height = m_size;
+			return metrics;
+		}
+		static int GetAdvance(int size, UCS4 cp) { return size + cp / 0x80; }
+	private:
+		int m_size;
+	};
+
+	TBFontFace *CreateFontFace(const char *id, int size)
+	{
+		TBFontDescription font_desc;
+		font_desc.SetID(TBIDC(id));
+		font_desc.SetSize(size);
+		return new TBFontFace(g_font_manager->GetGlyphCache(), new AdvanceFontRenderer(size), font_desc);
+	}
+
+	TB_TEST(shared_slot)
+	{
+		// U+0100, U+0200 and U+0380 use the same slot in the advance table as U+0080.
+		TBFontFace *font = CreateFontFace("advance_test", 10);
+		TB_VERIFY(font->GetStringWidth("\xC4\x80") == AdvanceFontRenderer::GetAdvance(10, 0x100));
+		TB_VERIFY(font->GetStringWidth("\xC8\x80") == AdvanceFontRenderer::GetAdvance(10, 0x200));
+		TB_VERIFY(font->GetStringWidth("\xC4\x80") == AdvanceFontRenderer::GetAdvance(10, 0x100));
+		TB_VERIFY(font->GetStringWidth("\xCE\x80") == AdvanceFontRenderer::GetAdvance(10, 0x380));
+		TB_VERIFY(font->GetStringWidth("\xC2\x80") == AdvanceFontRenderer::GetAdvance(10, 0x80));
+
+		// 'A' and U+0141 use the same low bits, but ASCII has its own slots.
+		TB_VERIFY(font->GetStringWidth("A") == AdvanceFontRenderer::GetAdvance(10, 'A'));
+		TB_VERIFY(font->GetStringWidth("\xC5\x81") == AdvanceFontRenderer::GetAdvance(10, 0x141));
+		TB_VERIFY(font->GetStringWidth("A") == AdvanceFontRenderer::GetAdvance(10, 'A'));
+
+		// Alternating between code points in the same slot in one string.
+		TB_VERIFY(font->GetStringWidth("\xC4\x80\xC8\x80\xC4\x80" "A\xC5\x81") ==
+					AdvanceFontRenderer::GetAdvance(10, 0x100) * 2 +
+					AdvanceFontRenderer::GetAdvance(10, 0x200) +
+					AdvanceFontRenderer::GetAdvance(10, 'A') +
+					AdvanceFontRenderer::GetAdvance(10, 0x141));
+		delete font;
+	}
+
+	TB_TEST(other_face_or_size)
+	{
+		// Each font face has its own advance table, so a face with another size or
+		// font must not get the advances cached by the first.
+		TBFontFace *font = CreateFontFace("advance_test", 10);
+		TB_VERIFY(font->GetStringWidth("A\xC4\x80") == AdvanceFontRenderer::GetAdvance(10, 'A') +
+														AdvanceFontRenderer::GetAdvance(10, 0x100));
+
+		TBFontFace *larger_font = CreateFontFace("advance_test", 20);
+		TB_VERIFY(larger_font->GetStringWidth("A") == AdvanceFontRenderer::GetAdvance(20, 'A'));
+		TB_VERIFY(larger_font->GetStringWidth("\xC4\x80") == AdvanceFontRenderer::GetAdvance(20, 0x100));
+
+		TBFontFace *other_font = CreateFontFace("advance_test_other", 30);
+		TB_VERIFY(other_font->GetStringWidth("A") == AdvanceFontRenderer::GetAdvance(30, 'A'));
+		TB_VERIFY(other_font->GetStringWidth("\xC4\x80") == AdvanceFontRenderer::GetAdvance(30, 0x100));
+
+		// The first face still has its own advances.
+		TB_VERIFY(font->GetStringWidth("A\xC4\x80") == AdvanceFontRenderer::GetAdvance(10, 'A') +
+														AdvanceFontRenderer::GetAdvance(10, 0x100));
+		delete other_font;
+		delete larger_font;
+		delete font;
+	}
+}
+
+#endif // TB_UNIT_TESTING
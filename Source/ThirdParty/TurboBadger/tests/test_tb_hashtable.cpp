@@ -0,0 +1,313 @@
+// ================================================================================
+// ==      This file is a part of Turbo Badger. (C) 2011-2014, Emil Segerås      ==
+// ==                     See tb_core.h for more information.                    ==
+// ================================================================================
+
+#include "tb_test.h"
+#include "tb_hashtable.h"
+#include "tb_profiler.h"
+#include "tb_system.h"
+
+#ifdef TB_UNIT_TESTING
+
+using namespace tb;
+
+/** Get a key for index i, spread like the TBID hash of a string. This is the
+	murmur3 finalizer, which never gives the same key for different i. */
+static uint32 GetSpreadKey(uint32 i)
+{
+	i ^= i >> 16;
+	i *= 0x85ebca6bU;
+	i ^= i >> 13;
+	i *= 0xc2b2ae35U;
+	i ^= i >> 16;
+	return i;
+}
+
+TB_TEST_GROUP(tb_hashtable)
+{
+	class Item
+	{
+	public:
+		Item(uint32 key) : key(key) {}
+		uint32 key;
+	};
+
+	TBHashTableAutoDeleteOf<Item> table;
+
+	/** Get a key for index i. Keys that differ only in the high bits are
+		included, to make sure they don't all end up in the same place. */
+	uint32 GetKey(int i) { return i % 3 == 0 ? (uint32) i << 20 : (uint32) i * 2654435761U; }
+
+	/** Return true if all keys in the range begin - end (and none other) are in the table. */
+	bool ContainsRange(int begin, int end, int max)
+	{
+		for (int i = 0; i < max; i++)
+		{
+			Item *item = table.Get(GetKey(i));
+			bool should_exist = i >= begin && i < end;
+			if (should_exist != (item != nullptr) || (item && item->key != GetKey(i)))
+				return false;
+		}
+		return true;
+	}
+
+	TB_TEST(empty)
+	{
+		TB_VERIFY(!table.Get(0));
+		TB_VERIFY(!table.Get(123));
+	}
+
+	TB_TEST(add)
+	{
+		for (int i = 0; i < 1000; i++)
+			TB_VERIFY(table.Add(GetKey(i), new Item(GetKey(i))));
+		TB_VERIFY(ContainsRange(0, 1000, 2000));
+	}
+
+	TB_TEST(iterate)
+	{
+		int count = 0;
+		uint32 key_sum = 0, expected_key_sum = 0;
+		TBHashTableIteratorOf<Item> it(&table);
+		while (Item *item = it.GetNextContent())
+		{
+			count++;
+			key_sum += item->key;
+		}
+		for (int i = 0; i < 1000; i++)
+			expected_key_sum += GetKey(i);
+		TB_VERIFY(count == 1000);
+		TB_VERIFY(key_sum == expected_key_sum);
+	}
+
+	TB_TEST(remove)
+	{
+		// Remove items so that items after them have to be moved back.
+		for (int i = 0; i < 500; i++)
+			table.Delete(GetKey(i));
+		TB_VERIFY(ContainsRange(500, 1000, 2000));
+
+		Item *item = (Item *) table.Remove(GetKey(700));
+		TB_VERIFY(item && item->key == GetKey(700));
+		TB_VERIFY(!table.Get(GetKey(700)));
+		TB_VERIFY(table.Add(GetKey(700), item));
+		TB_VERIFY(ContainsRange(500, 1000, 2000));
+	}
+
+	TB_TEST(add_after_remove)
+	{
+		for (int i = 1000; i < 1500; i++)
+			TB_VERIFY(table.Add(GetKey(i), new Item(GetKey(i))));
+		TB_VERIFY(ContainsRange(500, 1500, 2000));
+	}
+
+	TB_TEST(rehash)
+	{
+		TB_VERIFY(table.Rehash(8192));
+		TB_VERIFY(ContainsRange(500, 1500, 2000));
+		// Too few buckets for the items should still keep all items.
+		TB_VERIFY(table.Rehash(16));
+		TB_VERIFY(ContainsRange(500, 1500, 2000));
+	}
+
+	TB_TEST(delete_all)
+	{
+		table.DeleteAll();
+		TB_VERIFY(ContainsRange(0, 0, 2000));
+		TB_VERIFY(table.Add(GetKey(1), new Item(GetKey(1))));
+		TB_VERIFY(ContainsRange(1, 2, 2000));
+		table.DeleteAll();
+	}
+
+	TB_TEST(spread_keys)
+	{
+		TBHashTable spread_table;
+		for (uint32 i = 0; i < 1000; i++)
+			TB_VERIFY(spread_table.Add(GetSpreadKey(i), &table));
+		for (uint32 i = 0; i < 1000; i++)
+		{
+			TB_VERIFY(spread_table.Get(GetSpreadKey(i)));
+			TB_VERIFY(!spread_table.Get(GetSpreadKey(1000 + i)));
+		}
+		for (uint32 i = 0; i < 1000; i += 2)
+			TB_VERIFY(spread_table.Remove(GetSpreadKey(i)));
+		for (uint32 i = 0; i < 1000; i++)
+			TB_VERIFY((spread_table.Get(GetSpreadKey(i)) != nullptr) == (i % 2 == 1));
+	}
+}
+
+#ifdef TB_UNIT_TESTING_BENCHMARKS
+
+/** The chained hash table TBHashTable used before it used open addressing.
+	One ITEM is allocated for each entry, and chained in its bucket. Used as
+	reference in the benchmark. */
+class ChainedHashTable
+{
+public:
+	ChainedHashTable() : m_buckets(nullptr), m_num_buckets(0), m_num_items(0) {}
+	~ChainedHashTable()
+	{
+		for (uint32 i = 0; i < m_num_buckets; i++)
+			while (ITEM *item = m_buckets[i])
+			{
+				m_buckets[i] = item->next;
+				delete item;
+			}
+		delete [] m_buckets;
+	}
+	void *Get(uint32 key) const
+	{
+		if (!m_num_buckets)
+			return nullptr;
+		for (ITEM *item = m_buckets[key & (m_num_buckets - 1)]; item; item = item->next)
+			if (item->key == key)
+				return item->content;
+		return nullptr;
+	}
+	bool Add(uint32 key, void *content)
+	{
+		// Grow if more items than buckets
+		if ((!m_num_buckets || m_num_items >= m_num_buckets) && !Rehash(m_num_items ? m_num_items * 2 : 16))
+			return false;
+		ITEM *item = new ITEM;
+		if (!item)
+			return false;
+		uint32 bucket = key & (m_num_buckets - 1);
+		item->key = key;
+		item->content = content;
+		item->next = m_buckets[bucket];
+		m_buckets[bucket] = item;
+		m_num_items++;
+		return true;
+	}
+	void *Remove(uint32 key)
+	{
+		if (!m_num_buckets)
+			return nullptr;
+		for (ITEM **item = &m_buckets[key & (m_num_buckets - 1)]; *item; item = &(*item)->next)
+			if ((*item)->key == key)
+			{
+				ITEM *removed = *item;
+				void *content = removed->content;
+				*item = removed->next;
+				delete removed;
+				m_num_items--;
+				return content;
+			}
+		return nullptr;
+	}
+private:
+	bool Rehash(uint32 new_num_buckets)
+	{
+		ITEM **new_buckets = new ITEM*[new_num_buckets];
+		if (!new_buckets)
+			return false;
+		memset(new_buckets, 0, sizeof(ITEM*) * new_num_buckets);
+		for (uint32 i = 0; i < m_num_buckets; i++)
+			while (ITEM *item = m_buckets[i])
+			{
+				m_buckets[i] = item->next;
+				uint32 bucket = item->key & (new_num_buckets - 1);
+				item->next = new_buckets[bucket];
+				new_buckets[bucket] = item;
+			}
+		delete [] m_buckets;
+		m_buckets = new_buckets;
+		m_num_buckets = new_num_buckets;
+		return true;
+	}
+	struct ITEM {
+		uint32 key;
+		ITEM *next;
+		void *content;
+	} **m_buckets;
+	uint32 m_num_buckets;
+	uint32 m_num_items;
+};
+
+/** Time of each operation in a hash table, in nanoseconds. */
+struct HASH_TABLE_TIMES { double insert, hit, miss, remove; };
+
+/** Insert num_items items in a new HASH_TABLE, look up all of them (in another
+	order) and as many missing keys, and then remove them. Repeat so that about
+	the same number of operations is done for any num_items. TBProfiler::GetTimeMS
+	is used since TBSystem::GetTimeMS may only have millisecond resolution. */
+template<class HASH_TABLE>
+static bool BenchmarkHashTable(int num_items, HASH_TABLE_TIMES &times)
+{
+	uint32 *keys = new uint32[num_items * 2];
+	if (!keys)
+		return false;
+	// Present keys, and then missing keys in a different order (7919 is a prime,
+	// and i * 7919 fits in an uint32 for the sizes used).
+	for (int i = 0; i < num_items; i++)
+	{
+		keys[i] = GetSpreadKey(i);
+		keys[num_items + i] = GetSpreadKey((uint32) i * 7919U % num_items);
+	}
+
+	const int repeat = MAX(1, 1000000 / num_items);
+	double insert_ms = 0, hit_ms = 0, miss_ms = 0, remove_ms = 0;
+	bool ok = true;
+	for (int r = 0; r < repeat && ok; r++)
+	{
+		HASH_TABLE table;
+		double start_time = TBProfiler::GetTimeMS();
+		for (int i = 0; i < num_items; i++)
+			ok &= table.Add(keys[i], keys + i);
+		double hit_time = TBProfiler::GetTimeMS();
+		for (int i = num_items; i < num_items * 2; i++)
+			ok &= table.Get(keys[i]) != nullptr;
+		double miss_time = TBProfiler::GetTimeMS();
+		for (int i = 0; i < num_items; i++)
+			ok &= !table.Get(GetSpreadKey(num_items + i));
+		double remove_time = TBProfiler::GetTimeMS();
+		for (int i = num_items; i < num_items * 2; i++)
+			ok &= table.Remove(keys[i]) != nullptr;
+		double end_time = TBProfiler::GetTimeMS();
+		insert_ms += hit_time - start_time;
+		hit_ms += miss_time - hit_time;
+		miss_ms += remove_time - miss_time;
+		remove_ms += end_time - remove_time;
+	}
+	delete [] keys;
+
+	double ns_per_op = 1000000.0 / ((double) num_items * repeat);
+	times.insert = insert_ms * ns_per_op;
+	times.hit = hit_ms * ns_per_op;
+	times.miss = miss_ms * ns_per_op;
+	times.remove = remove_ms * ns_per_op;
+	return ok;
+}
+
+/** Benchmark TBHashTable and ChainedHashTable with num_items items, and print the times. */
+static bool BenchmarkHashTables(int num_items)
+{
+	HASH_TABLE_TIMES chained, open;
+	if (!BenchmarkHashTable<ChainedHashTable>(num_items, chained) ||
+		!BenchmarkHashTable<TBHashTable>(num_items, open))
+		return false;
+	if (test_settings & TB_TEST_VERBOSE)
+		TBDebugPrint("  n=%d (ns per op, chained -> TBHashTable): insert %.1f -> %.1f, "
+					"hit %.1f -> %.1f, miss %.1f -> %.1f, remove %.1f -> %.1f\n", num_items,
+					chained.insert, open.insert, chained.hit, open.hit,
+					chained.miss, open.miss, chained.remove, open.remove);
+	return true;
+}
+
+TB_TEST_GROUP(tb_hashtable_benchmark)
+{
+	TB_TEST(small)
+	{
+		TB_VERIFY(BenchmarkHashTables(1000));
+	}
+	TB_TEST(large)
+	{
+		TB_VERIFY(BenchmarkHashTables(100000));
+	}
+}
+
+#endif // TB_UNIT_TESTING_BENCHMARKS
+
+#endif // TB_UNIT_TESTING
@@ -0,0 +1,126 @@
+// ================================================================================
+// ==      This file is a part of Turbo Badger. (C) 2011-2014, Emil Segerås      ==
+// ==                     See tb_core.h for more information.                    ==
+// ================================================================================
+
+#include "tb_test.h"
+#include "tb_msg.h"
+#include "tb_str.h"
+#include "tb_system.h"
+
+#ifdef TB_UNIT_TESTING
+
+using namespace tb;
+
+TB_TEST_GROUP(tb_msg)
+{
+	/** Handler that records the v1 value of each message it receives. */
+	class Recorder : public TBMessageHandler
+	{
+	public:
+		virtual void OnMessageReceived(TBMessage *msg)
+		{
+			TBStr str;
+			str.SetFormatted("%d,", msg->data->v1.GetInt());
+			received.Append(str);
+		}
+		TBStr received;
+	};
+
+	Recorder recorder;
+
+	/** Handler that posts a new message with no delay for each message it receives. */
+	class Reposter : public TBMessageHandler
+	{
+	public:
+		Reposter() : num_received(0) {}
+		virtual void OnMessageReceived(TBMessage *msg)
+		{
+			num_received++;
+			PostMessageDelayed(msg->message, nullptr, 0);
+		}
+		int num_received;
+	};
+
+	/** Post a message with a unique id (v1 + 1) to fire at the given time. */
+	void Post(int v1, double fire_time)
+	{
+		recorder.PostMessageOnTime(TBID((uint32) v1 + 1), new TBMessageData(v1, 0), fire_time);
+	}
+
+	TB_TEST(Setup)
+	{
+		recorder.DeleteAllMessages();
+		recorder.received.Clear();
+	}
+
+	TB_TEST(fire_time_order)
+	{
+		Post(3, 30);
+		Post(1, 10);
+		Post(5, 50);
+		Post(2, 20);
+		Post(4, 40);
+		TBMessageHandler::ProcessMessages();
+		TB_VERIFY_STR(recorder.received, "1,2,3,4,5,");
+	}
+
+	TB_TEST(same_time_in_post_order)
+	{
+		for (int i = 0; i < 6; i++)
+			Post(i, i % 2 ? 10 : 20);
+		TBMessageHandler::ProcessMessages();
+		TB_VERIFY_STR(recorder.received, "1,3,5,0,2,4,");
+	}
+
+	TB_TEST(delete_message)
+	{
+		// Post many messages in reverse order, and delete every third.
+		for (int i = 99; i >= 0; i--)
+			Post(i, i + 1);
+		for (int i = 0; i < 100; i += 3)
+			recorder.DeleteMessage(recorder.GetMessageByID(TBID((uint32) i + 1)));
+		TBMessageHandler::ProcessMessages();
+
+		TBStr expected;
+		for (int i = 0; i < 100; i++)
+			if (i % 3)
+			{
+				TBStr str;
+				str.SetFormatted("%d,", i);
+				expected.Append(str);
+			}
+		TB_VERIFY_STR(recorder.received, expected);
+	}
+
+	TB_TEST(not_yet)
+	{
+		double later = TBSystem::GetTimeMS() + 100000;
+		Post(1, later);
+		Post(2, 10);
+		TBMessageHandler::ProcessMessages();
+		TB_VERIFY_STR(recorder.received, "2,");
+		TB_VERIFY(TBMessageHandler::GetNextMessageFireTime() <= later);
+		TB_VERIFY(recorder.GetMessageByID(TBID(2)));
+	}
+
+	TB_TEST(repost_with_no_delay)
+	{
+		// Messages posted while processing should wait for the next call.
+		Reposter reposter;
+		reposter.PostMessageOnTime(TBIDC("repost"), nullptr, 0);
+		TBMessageHandler::ProcessMessages();
+		TB_VERIFY(reposter.num_received == 1);
+		TBMessageHandler::ProcessMessages();
+		TB_VERIFY(reposter.num_received == 2);
+		TB_VERIFY(reposter.GetMessageByID(TBIDC("repost")));
+		reposter.DeleteAllMessages();
+	}
+
+	TB_TEST(Shutdown)
+	{
+		recorder.DeleteAllMessages();
+	}
+}
+
+#endif // TB_UNIT_TESTING
@@ -0,0 +1,189 @@
+// ================================================================================
+// ==      This file is a part of Turbo Badger. (C) 2011-2014, Emil Segerås      ==
+// ==                     See tb_core.h for more information.                    ==
+// ================================================================================
+
+#include "tb_test.h"
+#include "tb_node_tree.h"
+#include "tb_system.h"
+
+#ifdef TB_UNIT_TESTING
+
+using namespace tb;
+
+TB_TEST_GROUP(tb_node_tree)
+{
+	TBNode node;
+
+	TBNode *AddChild(const char *name, int value)
+	{
+		TBNode *n = TBNode::Create(name);
+		n->GetValue().SetInt(value);
+		node.Add(n);
+		return n;
+	}
+
+	/** Return true if all children n0 - n(num - 1) are found with the right value. */
+	bool FindAll(int num)
+	{
+		TBStr name;
+		for (int i = 0; i < num; i++)
+		{
+			name.SetFormatted("n%d", i);
+			if (node.GetValueInt(name, -1) != i)
+				return false;
+		}
+		return true;
+	}
+
+	TB_TEST(Init)
+	{
+		// Enough children for lookups to use the child index.
+		for (int i = 0; i < 200; i++)
+		{
+			TBStr name;
+			name.SetFormatted("n%d", i);
+			AddChild(name, i);
+		}
+		AddChild("n5", 1000);
+	}
+
+	TB_TEST(lookup)
+	{
+		TB_VERIFY(FindAll(200));
+		TB_VERIFY(node.GetValueInt("missing", -1) == -1);
+		TB_VERIFY(node.GetValueInt("n", -1) == -1);
+		TB_VERIFY(node.GetValueInt("n1000", -1) == -1);
+	}
+
+	TB_TEST(duplicate_name)
+	{
+		// The first child with a name should always be found.
+		TB_VERIFY(node.GetValueInt("n5", -1) == 5);
+		node.Delete(node.GetNode("n5"));
+		TB_VERIFY(node.GetValueInt("n5", -1) == 1000);
+	}
+
+	TB_TEST(changed_children)
+	{
+		TB_VERIFY(node.GetValueInt("n100", -1) == 100);
+		node.Delete(node.GetNode("n100"));
+		TB_VERIFY(node.GetValueInt("n100", -1) == -1);
+
+		TBNode *added = AddChild("added", 1);
+		TB_VERIFY(node.GetNode("added") == added);
+		TB_VERIFY(node.GetValueInt("n199", -1) == 199);
+	}
+
+	TB_TEST(sub_request)
+	{
+		TBNode *child = node.GetNode("n7>sub>value", TBNode::GET_MISS_POLICY_CREATE);
+		TB_VERIFY(child && child->GetParent()->GetParent() == node.GetNode("n7"));
+		TB_VERIFY(node.GetNode("n7>sub>value") == child);
+		TB_VERIFY(!node.GetNode("n7>value"));
+	}
+
+	TB_TEST(arena_read)
+	{
+		TBNode arena_node;
+		TB_VERIFY(arena_node.ReadFile("demo01/ui_resources/test_tb_parser.tb.txt", TB_NODE_READ_FLAGS_ARENA));
+		TB_VERIFY_STR(arena_node.GetValueString("strings>string1", ""), "A string");
+		TB_VERIFY(arena_node.GetValueInt("numbers>integer1", 0) == 42);
+		// Included nodes should be allocated from the same arena.
+		TB_VERIFY_STR(arena_node.GetValueString("include_file>file1>something1", ""), "Chocolate");
+		TB_VERIFY_STR(arena_node.GetValueString("include_file>file2>something2", ""), "Cake");
+	}
+
+	TB_TEST(arena_modify)
+	{
+		TBNode arena_node;
+		arena_node.ReadData("a: \"foo\"\nb\n\tc: \"bar\"\n", TB_NODE_READ_FLAGS_ARENA);
+
+		// Nodes from the arena can be deleted, and mixed with heap nodes.
+		arena_node.Delete(arena_node.GetNode("a"));
+		TB_VERIFY(!arena_node.GetNode("a"));
+		TBNode *heap_child = TBNode::Create("d");
+		heap_child->GetValue().SetString("baz", TBValue::SET_NEW_COPY);
+		arena_node.GetNode("b")->Add(heap_child);
+
+		// Strings from the arena can be changed.
+		arena_node.GetNode("b>c")->GetValue().SetString("changed", TBValue::SET_NEW_COPY);
+		TB_VERIFY_STR(arena_node.GetValueString("b>c", ""), "changed");
+		TB_VERIFY_STR(arena_node.GetValueString("b>d", ""), "baz");
+
+		// Values copied out of the tree must stay valid after it's cleared.
+		TBValue copy;
+		copy.Copy(arena_node.GetNode("b>d")->GetValue());
+		arena_node.ReadData("e: 1", TB_NODE_READ_FLAGS_ARENA | TB_NODE_READ_FLAGS_APPEND);
+		TB_VERIFY(arena_node.GetValueInt("e", 0) == 1);
+		arena_node.ReadData("f: 2");
+		TB_VERIFY(!arena_node.GetNode("b") && arena_node.GetValueInt("f", 0) == 2);
+		TB_VERIFY_STR(copy.GetString(), "baz");
+	}
+
+	TB_TEST(Shutdown)
+	{
+		node.Clear();
+	}
+}
+
+#ifdef TB_UNIT_TESTING_BENCHMARKS
+
+/** Find a child by comparing the name of each child in order, like TBNode did
+	before it had a child index. Used as reference in the benchmark. */
+static TBNode *GetChildLinear(TBNode *node, const char *name)
+{
+	for (TBNode *n = node->GetFirstChild(); n; n = n->GetNext())
+		if (strcmp(n->GetName(), name) == 0)
+			return n;
+	return nullptr;
+}
+
+/** Look up all children of a node with num_children children, with GetNode
+	and with GetChildLinear. Print the time of each. */
+static bool BenchmarkChildLookup(int num_children)
+{
+	TBNode node;
+	TBStr name;
+	for (int i = 0; i < num_children; i++)
+	{
+		name.SetFormatted("element_%d", i);
+		TBNode *n = TBNode::Create(name);
+		if (!n)
+			return false;
+		node.Add(n);
+	}
+
+	const int num_lookups = 200000;
+	TBNode *expected = node.GetFirstChild();
+	double start_time = TBSystem::GetTimeMS();
+	for (int i = 0; i < num_lookups; i++, expected = expected->GetNext() ? expected->GetNext() : node.GetFirstChild())
+		if (node.GetNode(expected->GetName()) != expected)
+			return false;
+	double indexed_ms = TBSystem::GetTimeMS() - start_time;
+
+	start_time = TBSystem::GetTimeMS();
+	for (int i = 0; i < num_lookups; i++, expected = expected->GetNext() ? expected->GetNext() : node.GetFirstChild())
+		if (GetChildLinear(&node, expected->GetName()) != expected)
+			return false;
+	double linear_ms = TBSystem::GetTimeMS() - start_time;
+
+	if (test_settings & TB_TEST_VERBOSE)
+		TBDebugPrint("  %d lookups in %d children: GetNode %.1f ms, linear %.1f ms\n",
+					num_lookups, num_children, indexed_ms, linear_ms);
+	return true;
+}
+
+TB_TEST_GROUP(tb_node_tree_benchmark)
+{
+	TB_TEST(child_lookup)
+	{
+		TB_VERIFY(BenchmarkChildLookup(8));
+		TB_VERIFY(BenchmarkChildLookup(64));
+		TB_VERIFY(BenchmarkChildLookup(512));
+	}
+}
+
+#endif // TB_UNIT_TESTING_BENCHMARKS
+
+#endif // TB_UNIT_TESTING
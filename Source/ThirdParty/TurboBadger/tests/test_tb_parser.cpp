@@ -5,6 +5,7 @@
 
 #include "tb_test.h"
 #include "tb_node_tree.h"
+#include "tb_system.h"
 
 #ifdef TB_UNIT_TESTING
 
@@ -203,6 +204,75 @@ TB_TEST_GROUP(tb_parser)
 		TB_VERIFY_STR(node.GetValueString("defines_test>cycle", ""), "@>defines_test>cycle");
 	}
 
+	/** Target that records everything into a string. */
+	class RecordingTarget : public TBParserTarget
+	{
+	public:
+		virtual void OnError(int line_nr, const char *error) { Add(line_nr, "error", error); }
+		virtual void OnComment(int line_nr, const char *comment) { Add(line_nr, "comment", comment); }
+		virtual void OnToken(int line_nr, const char *name, TBValue &value) { Add(line_nr, name, value.GetString()); }
+		virtual void Enter() { result.Append("{"); }
+		virtual void Leave() { result.Append("}"); }
+		void Add(int line_nr, const char *name, const char *value)
+		{
+			TBStr str;
+			str.SetFormatted("%d:%s=%s;", line_nr, name, value);
+			result.Append(str);
+		}
+		TBStr result;
+	};
+
+	class DataStream : public TBParserStream
+	{
+	public:
+		DataStream(const char *data, int data_len) : data(data), data_len(data_len) {}
+		virtual int GetMoreData(char *buf, int buf_len)
+		{
+			int consume = MIN(buf_len, data_len);
+			memcpy(buf, data, consume);
+			data += consume;
+			data_len -= consume;
+			return consume;
+		}
+		const char *data;
+		int data_len;
+	};
+
+	/** Return true if parsing data in place gives the same result as parsing it from a stream. */
+	bool InPlaceEqualsStream(const char *data, int data_len)
+	{
+		RecordingTarget stream_target, in_place_target;
+		DataStream stream(data, data_len);
+		TBParser stream_parser, in_place_parser;
+		TBTempBuffer buf;
+		if (stream_parser.Read(&stream, &stream_target) != TBParser::STATUS_OK ||
+			!buf.Append(data, data_len) ||
+			in_place_parser.Read(buf.GetData(), data_len, &in_place_target) != TBParser::STATUS_OK)
+			return false;
+		return stream_target.result.Length() > 0 && stream_target.result.Equals(in_place_target.result);
+	}
+
+	TB_TEST(in_place)
+	{
+		TBTempBuffer file_data;
+		TBFile *file = TBFile::Open("demo01/ui_resources/test_tb_parser.tb.txt", TBFile::MODE_READ);
+		TB_VERIFY(file);
+		long size = file->Size();
+		TB_VERIFY(file_data.Reserve(size));
+		TB_VERIFY(file->Read(file_data.GetData(), 1, size) == (size_t) size);
+		delete file;
+		TB_VERIFY(InPlaceEqualsStream(file_data.GetData(), size));
+
+		// BOM, CRLF line breaks, and no line break at the end.
+		const char *data = "\xEF\xBB\xBF" "a: 1\r\nb\r\n\tc: 'x'\r\n# comment\r\nd: 2";
+		TB_VERIFY(InPlaceEqualsStream(data, strlen(data)));
+		TBNode tmp;
+		tmp.ReadData(data);
+		TB_VERIFY(tmp.GetValueInt("a", 0) == 1);
+		TB_VERIFY_STR(tmp.GetValueString("b>c", ""), "x");
+		TB_VERIFY(tmp.GetValueInt("d", 0) == 2);
+	}
+
 	// More coverage in test_tb_node_ref_tree.cpp...
 }
 
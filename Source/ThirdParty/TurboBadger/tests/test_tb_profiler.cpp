@@ -0,0 +1,72 @@
+// ================================================================================
+// ==      This file is a part of Turbo Badger. (C) 2011-2014, Emil Segerås      ==
+// ==                     See tb_core.h for more information.                    ==
+// ================================================================================
+
+#include "tb_test.h"
+#include "tb_profiler.h"
+
+#ifdef TB_UNIT_TESTING
+
+using namespace tb;
+
+TB_TEST_GROUP(tb_profiler)
+{
+	TBProfiler profiler;
+
+	TB_TEST(disabled)
+	{
+		profiler.BeginFrame();
+		profiler.Count(TB_PROFILER_COUNTER_QUADS, 10);
+		profiler.BeginFrame();
+		TB_VERIFY(profiler.GetNumFrames() == 0);
+		TB_VERIFY(profiler.GetCurrentFrame().counters[TB_PROFILER_COUNTER_QUADS] == 0);
+	}
+
+	TB_TEST(frames)
+	{
+		profiler.SetEnabled(true);
+		// Counts before the first frame belong to it.
+		profiler.Count(TB_PROFILER_COUNTER_QUADS, 1);
+		profiler.BeginFrame();
+		TB_VERIFY(profiler.GetNumFrames() == 0);
+
+		profiler.Count(TB_PROFILER_COUNTER_QUADS, 10);
+		profiler.Count(TB_PROFILER_COUNTER_QUADS, 20);
+		profiler.BeginPhase(TB_PROFILER_PHASE_PAINT);
+		profiler.EndPhase(TB_PROFILER_PHASE_PAINT);
+		profiler.BeginFrame();
+		TB_VERIFY(profiler.GetNumFrames() == 1);
+		TB_VERIFY(profiler.GetLastFrame().counters[TB_PROFILER_COUNTER_QUADS] == 30);
+		TB_VERIFY(profiler.GetLastFrame().phase_ms[TB_PROFILER_PHASE_PAINT] >= 0);
+		TB_VERIFY(profiler.GetCurrentFrame().counters[TB_PROFILER_COUNTER_QUADS] == 0);
+	}
+
+	TB_TEST(average)
+	{
+		// Fill the history with frames counting 0 - 99 glyphs. Only the last
+		// TB_PROFILER_HISTORY_SIZE frames should be averaged.
+		for (int i = 0; i < 100; i++)
+		{
+			profiler.Count(TB_PROFILER_COUNTER_GLYPHS, i);
+			profiler.BeginFrame();
+		}
+		TBProfilerFrame average;
+		TB_VERIFY(profiler.GetAverageFrame(average) == TB_PROFILER_HISTORY_SIZE);
+		TB_VERIFY(profiler.GetLastFrame().counters[TB_PROFILER_COUNTER_GLYPHS] == 99);
+		// The average is rounded to the nearest integer.
+		double expected = (100 - TB_PROFILER_HISTORY_SIZE + 99) / 2.0;
+		TB_VERIFY(average.counters[TB_PROFILER_COUNTER_GLYPHS] == (uint32) (expected + 0.5));
+	}
+
+	TB_TEST(enable_clears)
+	{
+		profiler.SetEnabled(false);
+		TB_VERIFY(profiler.GetNumFrames() == 0);
+		TBProfilerFrame average;
+		TB_VERIFY(profiler.GetAverageFrame(average) == 0);
+		TB_VERIFY(profiler.GetLastFrame().GetTotalMS() == 0);
+	}
+}
+
+#endif // TB_UNIT_TESTING
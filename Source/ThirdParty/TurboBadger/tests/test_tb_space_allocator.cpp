@@ -5,6 +5,10 @@
 
 #include "tb_test.h"
 #include "tb_bitmap_fragment.h"
+#include "tb_font_renderer.h"
+#include "tb_node_tree.h"
+#include "tb_system.h"
+#include "tb_tempbuffer.h"
 
 #ifdef TB_UNIT_TESTING
 
@@ -127,4 +131,213 @@ TB_TEST_GROUP(tb_space_allocator)
 	}
 }
 
+/** Return true if any of the num_rects first rects in rects intersects rect. */
+static bool IntersectsAny(const TBRect *rects, int num_rects, const TBRect &rect)
+{
+	for (int i = 0; i < num_rects; i++)
+		if (!rects[i].IsEmpty() && rects[i].Intersects(rect))
+			return true;
+	return false;
+}
+
+TB_TEST_GROUP(tb_max_rects_allocator)
+{
+	TB_TEST(no_overlap)
+	{
+		const int size = 64;
+		TBMaxRectsAllocator mra(size, size);
+		TBRect rects[100];
+		int num_rects = 0;
+
+		// Fill up with mixed sizes.
+		for (; num_rects < 100; num_rects++)
+		{
+			TBRect rect = mra.AllocRect(3 + (num_rects * 7) % 11, 2 + (num_rects * 5) % 13);
+			if (rect.IsEmpty())
+				break;
+			TB_VERIFY(rect.x >= 0 && rect.y >= 0 && rect.x + rect.w <= size && rect.y + rect.h <= size);
+			TB_VERIFY(!IntersectsAny(rects, num_rects, rect));
+			rects[num_rects] = rect;
+		}
+		TB_VERIFY(num_rects > 20);
+
+		// Free every other, and fill up again.
+		for (int i = 0; i < num_rects; i += 2)
+		{
+			mra.FreeRect(rects[i]);
+			rects[i] = TBRect();
+		}
+		for (int i = 0; i < num_rects; i += 2)
+		{
+			TBRect rect = mra.AllocRect(2 + i % 5, 2 + i % 3);
+			if (rect.IsEmpty())
+				continue;
+			TB_VERIFY(rect.x >= 0 && rect.y >= 0 && rect.x + rect.w <= size && rect.y + rect.h <= size);
+			TB_VERIFY(!IntersectsAny(rects, num_rects, rect));
+			rects[i] = rect;
+		}
+
+		// Free all, and we should have all space again.
+		for (int i = 0; i < num_rects; i++)
+			if (!rects[i].IsEmpty())
+				mra.FreeRect(rects[i]);
+		TB_VERIFY(mra.IsAllAvailable());
+		TB_VERIFY(mra.AllocRect(size, size).Equals(TBRect(0, 0, size, size)));
+	}
+
+	TB_TEST(mixed_heights)
+	{
+		// Rows would waste the space under the short fragment. MaxRects should not.
+		TBMaxRectsAllocator mra(32, 32);
+		TB_VERIFY(!mra.AllocRect(16, 32).IsEmpty());
+		TB_VERIFY(!mra.AllocRect(16, 8).IsEmpty());
+		TB_VERIFY(!mra.AllocRect(16, 24).IsEmpty());
+		TB_VERIFY(mra.AllocRect(1, 1).IsEmpty());
+	}
+}
+
+/** A set of fragment sizes to benchmark the fragment allocators with. */
+class FragmentSizeSet
+{
+public:
+	FragmentSizeSet() : num_sizes(0) {}
+	void Add(int w, int h)
+	{
+		if (num_sizes < MAX_SIZES && w > 0 && h > 0)
+		{
+			sizes[num_sizes].x = w;
+			sizes[num_sizes].y = h;
+			num_sizes++;
+		}
+	}
+	enum { MAX_SIZES = 1024 };
+	TBPoint sizes[MAX_SIZES];
+	int num_sizes;
+};
+
+/** Add the size of all bitmaps used by the skin elements in the given skin file. */
+static void AddSkinBitmapSizes(FragmentSizeSet &set, const char *skin_dir, const char *skin_file)
+{
+	TBNode node;
+	TBStr filename;
+	filename.SetFormatted("%s%s", skin_dir, skin_file);
+	if (!node.ReadFile(filename))
+		return;
+	TBNode *elements = node.GetNode("elements");
+	for (TBNode *n = elements ? elements->GetFirstChild() : nullptr; n; n = n->GetNext())
+	{
+		const char *bitmap = n->GetValueString("bitmap", nullptr);
+		if (!bitmap)
+			continue;
+		filename.SetFormatted("%s%s", skin_dir, bitmap);
+		if (TBImageLoader *img = TBImageLoader::CreateFromFile(filename))
+		{
+			set.Add(img->Width(), img->Height());
+			delete img;
+		}
+	}
+}
+
+/** Add the size of the glyphs of the default font, at the default font size and larger
+	sizes (scaled up from the default, since the font may not have other sizes created). */
+static void AddGlyphSizes(FragmentSizeSet &set)
+{
+	TBFontFace *font = g_font_manager->GetFontFace(g_font_manager->GetDefaultFontDescription());
+	const int scales[] = { 2, 3, 4 }; // in halves
+	for (int s = 0; s < 3; s++)
+		for (char c = 33; c < 127; c++)
+		{
+			char str[2] = { c, 0 };
+			set.Add(font->GetStringWidth(str) * scales[s] / 2, font->GetHeight() * scales[s] / 2);
+		}
+}
+
+/** Create fragments of all sizes in the set, in a fragment manager using the given allocator.
+	Print the number of maps needed, the pack efficiency and the time it took.
+	The pack efficiency is the area of all fragments in percent of the area of all maps,
+	except the unused part below the lowest fragment in each map. */
+static bool BenchmarkAllocator(const char *set_name, const FragmentSizeSet &set,
+								TB_FRAGMENT_ALLOCATOR allocator, bool add_border)
+{
+	TBTempBuffer data;
+	int max_pixels = 0;
+	for (int i = 0; i < set.num_sizes; i++)
+		max_pixels = MAX(max_pixels, set.sizes[i].x * set.sizes[i].y);
+	if (!data.Reserve(max_pixels * sizeof(uint32)))
+		return false;
+	memset(data.GetData(), 0, max_pixels * sizeof(uint32));
+
+	// Use small maps, so the difference shows in the number of maps too.
+	const int map_size = 256;
+	const int iterations = 20;
+	int num_maps = 0;
+	int efficiency = 0;
+	double start_time = TBSystem::GetTimeMS();
+	for (int iteration = 0; iteration < iterations; iteration++)
+	{
+		TBBitmapFragmentManager fm;
+		fm.SetAllocator(allocator);
+		fm.SetAddBorder(add_border);
+		fm.SetDefaultMapSize(map_size, map_size);
+
+		const int max_maps = 16;
+		TBBitmapFragmentMap *maps[max_maps];
+		int map_bottom[max_maps];
+		int fragment_pixels = 0;
+		num_maps = 0;
+		for (int i = 0; i < set.num_sizes; i++)
+		{
+			const TBPoint &size = set.sizes[i];
+			TBBitmapFragment *frag = fm.CreateNewFragment(TBID(i + 1), false, size.x, size.y, size.x, (uint32 *) data.GetData());
+			if (!frag)
+				return false;
+			fragment_pixels += size.x * size.y;
+
+			int m = 0;
+			while (m < num_maps && maps[m] != frag->m_map)
+				m++;
+			if (m == num_maps)
+			{
+				if (num_maps == max_maps)
+					return false;
+				maps[num_maps] = frag->m_map;
+				map_bottom[num_maps++] = 0;
+			}
+			map_bottom[m] = MAX(map_bottom[m], frag->m_alloc_rect.y + frag->m_alloc_rect.h);
+		}
+		int used_map_pixels = 0;
+		for (int m = 0; m < num_maps; m++)
+			used_map_pixels += map_size * map_bottom[m];
+		efficiency = used_map_pixels ? fragment_pixels * 100 / used_map_pixels : 0;
+	}
+	double ms = (TBSystem::GetTimeMS() - start_time) / iterations;
+
+	if (test_settings & TB_TEST_VERBOSE)
+		TBDebugPrint("  %s (%d fragments) with %s: %d maps, %d%% efficiency, %.3f ms\n",
+					set_name, set.num_sizes,
+					allocator == TB_FRAGMENT_ALLOCATOR_MAXRECTS ? "maxrects" : "rows",
+					num_maps, efficiency, ms);
+	return true;
+}
+
+TB_TEST_GROUP(tb_fragment_allocator_benchmark)
+{
+	TB_TEST(skin)
+	{
+		FragmentSizeSet set;
+		AddSkinBitmapSizes(set, "resources/default_skin/", "skin.tb.txt");
+		if (!set.num_sizes)
+			TB_PASS(); // The skin is not available where the tests are run from.
+		TB_VERIFY(BenchmarkAllocator("skin", set, TB_FRAGMENT_ALLOCATOR_ROWS, true));
+		TB_VERIFY(BenchmarkAllocator("skin", set, TB_FRAGMENT_ALLOCATOR_MAXRECTS, true));
+	}
+	TB_TEST(glyphs)
+	{
+		FragmentSizeSet set;
+		AddGlyphSizes(set);
+		TB_VERIFY(BenchmarkAllocator("glyphs", set, TB_FRAGMENT_ALLOCATOR_ROWS, false));
+		TB_VERIFY(BenchmarkAllocator("glyphs", set, TB_FRAGMENT_ALLOCATOR_MAXRECTS, false));
+	}
+}
+
 #endif // TB_UNIT_TESTING
@@ -251,6 +251,146 @@ TB_TEST_GROUP(tb_editfield)
 						"this_is_a_long_line_that_should_not_wrap", TB_CARET_POS_END);
 		TB_VERIFY(sedit->GetContentHeight() == font_size * 2);
 	}
+
+	/** Check that the block index gives the same result as walking the blocks. */
+	bool BlockIndexIsCorrect()
+	{
+		int32 gofs = 0;
+		for (TBBlock *block = sedit->blocks.GetFirst(); block; block = block->GetNext())
+		{
+			if (TBTextOfs(block, 0).GetGlobalOfs(sedit) != gofs)
+				return false;
+			TBTextOfs ofs;
+			if (block->str_len && (!ofs.SetGlobalOfs(sedit, gofs + 1) || ofs.block != block || ofs.ofs != 1))
+				return false;
+			if (block->height && sedit->FindBlock(block->ypos - sedit->ypos_base + block->height - 1) != block)
+				return false;
+			gofs += block->str_len;
+		}
+		return true;
+	}
+
+	TB_TEST(block_index)
+	{
+		TBStr text;
+		for (int i = 0; i < 200; i++)
+			text.Append(i % 7 ? "Line\n" : "A longer line\n");
+		edit->SetText(text);
+		TB_VERIFY(BlockIndexIsCorrect());
+
+		// Edit within blocks and change the number of blocks.
+		sedit->caret.SetGlobalOfs(50);
+		sedit->InsertText("inserted");
+		TB_VERIFY(BlockIndexIsCorrect());
+		sedit->InsertText("break\nin\nthe middle");
+		TB_VERIFY(BlockIndexIsCorrect());
+		sedit->selection.Select(20, 300);
+		sedit->selection.RemoveContent();
+		TB_VERIFY(BlockIndexIsCorrect());
+		sedit->Undo();
+		TB_VERIFY(BlockIndexIsCorrect());
+		sedit->AppendText("appended\nlines");
+		TB_VERIFY(BlockIndexIsCorrect());
+	}
+
+	TB_TEST(reformat_pending)
+	{
+		TBFontDescription fd;
+		fd.SetSize(16);
+		edit->SetFontDescription(fd);
+		edit->SetWrapping(true);
+		TBStr text;
+		for (int i = 0; i < 2000; i++)
+			text.Append("Some words that will wrap when the edit field is narrow enough\n");
+		edit->SetText(text);
+
+		// Resize, so only some blocks are layouted now.
+		edit->SetRect(TBRect(0, 0, 200, 300));
+		TB_VERIFY(!sedit->blocks.GetFirst()->pending_layout);
+		TB_VERIFY(sedit->caret.pos.block->ypos == 0);
+
+		// Layout the rest, and compare with the height of a complete layout.
+		TB_VERIFY(!sedit->ReformatPending(0));
+		int32 height = sedit->GetContentHeight();
+		for (TBBlock *block = sedit->blocks.GetFirst(); block; block = block->GetNext())
+			TB_VERIFY(!block->pending_layout);
+		sedit->Clear();
+		edit->SetText(text);
+		TB_VERIFY(sedit->GetContentHeight() == height);
+
+		edit->SetWrapping(false);
+		edit->SetRect(TBRect(0, 0, 1000, 1000));
+	}
+
+	TB_TEST(log)
+	{
+		TBFontDescription fd;
+		fd.SetSize(16);
+		edit->SetFontDescription(fd);
+		edit->SetText("");
+		sedit->SetLogMaxLines(200);
+
+		TBStr line;
+		for (int i = 0; i < 500; i++)
+		{
+			line.SetFormatted("Line %d\n", i);
+			sedit->AppendLogText(line);
+		}
+		TB_VERIFY(sedit->IsEmpty());
+
+		// All lines are added at once, and only the last 200 are kept.
+		sedit->FlushLog();
+		TB_VERIFY(sedit->blocks.CountLinks() == 200);
+		TB_VERIFY(sedit->blocks.GetFirst()->str.Equals("Line 300\n"));
+		TB_VERIFY(sedit->blocks.GetLast()->str.Equals("Line 499\n"));
+		TB_VERIFY(sedit->GetContentHeight() == 200 * 16);
+		TB_VERIFY(!sedit->CanUndo());
+		TB_VERIFY(BlockIndexIsCorrect());
+
+		// We were at the bottom, so we should follow the new lines.
+		TB_VERIFY(sedit->scroll_y > 0 && sedit->scroll_y == sedit->GetOverflowY());
+
+		// When not at the bottom, the visible lines should stay in view.
+		sedit->SetScrollPos(0, 1000);
+		sedit->AppendLogText("One\nTwo\n");
+		sedit->FlushLog();
+		TB_VERIFY(sedit->blocks.CountLinks() == 200);
+		TB_VERIFY(sedit->scroll_y == 1000 - 2 * 16);
+		TB_VERIFY(sedit->blocks.GetLast()->GetPrev()->str.Equals("One\n"));
+		TB_VERIFY(sedit->blocks.GetLast()->str.Equals("Two\n"));
+		TB_VERIFY(BlockIndexIsCorrect());
+
+		// Removing lines moves the base instead of the remaining lines.
+		TBBlock *last = sedit->blocks.GetLast();
+		int32 last_ypos = last->ypos;
+		for (int i = 0; i < 300; i++)
+		{
+			line.SetFormatted("Flush %d\n", i);
+			sedit->AppendLogText(line);
+			sedit->FlushLog();
+			if (i == 100)
+				TB_VERIFY(last->ypos == last_ypos);
+			if (i % 50 == 0)
+				TB_VERIFY(BlockIndexIsCorrect());
+		}
+		TB_VERIFY(sedit->blocks.CountLinks() == 200);
+		TB_VERIFY(sedit->blocks.GetFirst()->str.Equals("Flush 100\n"));
+		TB_VERIFY(sedit->blocks.GetFirst()->ypos == sedit->ypos_base);
+		TB_VERIFY(sedit->GetContentHeight() == 200 * 16);
+		TB_VERIFY(BlockIndexIsCorrect());
+
+		// Positions are still relative to the first line.
+		sedit->caret.Place(TBPoint(0, 16 * 3 + 1));
+		TB_VERIFY(sedit->caret.pos.block->str.Equals("Flush 103\n"));
+		TB_VERIFY(sedit->caret.y == 16 * 3);
+
+		// Clear drops text that isn't added yet.
+		sedit->AppendLogText("Dropped\n");
+		edit->SetText("");
+		sedit->FlushLog();
+		TB_VERIFY(sedit->IsEmpty());
+		sedit->SetLogMaxLines(0);
+	}
 }
 
 #endif // TB_UNIT_TESTING
@@ -0,0 +1,553 @@
+// ================================================================================
+// ==      This file is a part of Turbo Badger. (C) 2011-2014, Emil Segerås      ==
+// ==                     See tb_core.h for more information.                    ==
+// ================================================================================
+
+#include "tb_test.h"
+#include "tb_widgets.h"
+#include "tb_widgets_common.h"
+#include "tb_select.h"
+#include "tb_widgets_reader.h"
+#include "tb_tempbuffer.h"
+#include "tb_system.h"
+
+#ifdef TB_UNIT_TESTING
+
+using namespace tb;
+
+TB_TEST_GROUP(tb_widget_hit_index)
+{
+	TBWidget *indexed, *linear;
+
+	/** Add the same children to both widgets. */
+	void AddChild(const TBRect &rect, bool disabled = false, bool button = false)
+	{
+		TBWidget *parents[2] = { indexed, linear };
+		for (int i = 0; i < 2; i++)
+		{
+			TBWidget *child = button ? new TBButton : new TBWidget;
+			child->SetRect(rect);
+			child->SetState(WIDGET_STATE_DISABLED, disabled);
+			// Nested child, to test include_children.
+			TBWidget *nested = new TBWidget;
+			nested->SetRect(TBRect(2, 2, rect.w / 2, rect.h / 2));
+			child->AddChild(nested);
+			parents[i]->AddChild(child);
+		}
+	}
+
+	/** Return the index of the widget, or -1. Used to compare results in the two trees. */
+	int GetPath(TBWidget *root, TBWidget *widget)
+	{
+		if (!widget)
+			return -1;
+		if (widget->GetParent() != root)
+			return GetPath(root, widget->GetParent()) * 1000 + 999;
+		return root->GetIndexFromChild(widget);
+	}
+
+	bool HitEqual(int x, int y)
+	{
+		for (int include_children = 0; include_children < 2; include_children++)
+		{
+			TBWidget *a = indexed->GetWidgetAt(x, y, include_children ? true : false);
+			TBWidget *b = linear->GetWidgetAt(x, y, include_children ? true : false);
+			if (GetPath(indexed, a) != GetPath(linear, b))
+				return false;
+		}
+		return true;
+	}
+
+	/** Compare the hits at the edges, nested child and center of each child, and on a sparse grid. */
+	bool HitsEqual()
+	{
+		for (TBWidget *child = linear->GetFirstChild(); child; child = child->GetNext())
+		{
+			const TBRect &r = child->GetRect();
+			const int xs[6] = { r.x - 1, r.x, r.x + 2, r.x + r.w / 2, r.x + r.w - 1, r.x + r.w };
+			const int ys[6] = { r.y - 1, r.y, r.y + 2, r.y + r.h / 2, r.y + r.h - 1, r.y + r.h };
+			for (int j = 0; j < 6; j++)
+				for (int i = 0; i < 6; i++)
+					if (!HitEqual(xs[i], ys[j]))
+						return false;
+		}
+		for (int y = -10; y < 1100; y += 37)
+			for (int x = -10; x < 1100; x += 37)
+				if (!HitEqual(x, y))
+					return false;
+		return true;
+	}
+
+	TB_TEST(Init)
+	{
+		indexed = new TBWidget;
+		linear = new TBWidget;
+		indexed->SetHitTestIndex(true);
+		TB_VERIFY(indexed->GetHitTestIndex());
+		TB_VERIFY(!linear->GetHitTestIndex());
+		indexed->SetRect(TBRect(0, 0, 1000, 1000));
+		linear->SetRect(TBRect(0, 0, 1000, 1000));
+	}
+
+	TB_TEST(empty)
+	{
+		TB_VERIFY(!indexed->GetWidgetAt(10, 10, true));
+	}
+
+	TB_TEST(grid)
+	{
+		for (int i = 0; i < 100; i++)
+			AddChild(TBRect((i % 10) * 100, (i / 10) * 100, 90, 90), i % 13 == 0, i % 7 == 0);
+		TB_VERIFY(HitsEqual());
+	}
+
+	TB_TEST(overlapping)
+	{
+		// Some children on top of others, and one large child on top of many.
+		for (int i = 0; i < 30; i++)
+			AddChild(TBRect(i * 31, i * 17, 80, 60));
+		AddChild(TBRect(300, 300, 400, 400));
+		TB_VERIFY(HitsEqual());
+	}
+
+	TB_TEST(rect_changed)
+	{
+		indexed->GetChildFromIndex(5)->SetRect(TBRect(900, 900, 150, 150));
+		linear->GetChildFromIndex(5)->SetRect(TBRect(900, 900, 150, 150));
+		TB_VERIFY(HitsEqual());
+	}
+
+	TB_TEST(child_removed)
+	{
+		TBWidget *a = indexed->GetChildFromIndex(110);
+		TBWidget *b = linear->GetChildFromIndex(110);
+		indexed->RemoveChild(a);
+		linear->RemoveChild(b);
+		delete a;
+		delete b;
+		TB_VERIFY(HitsEqual());
+	}
+
+	TB_TEST(Shutdown)
+	{
+		delete indexed;
+		delete linear;
+	}
+}
+
+TB_TEST_GROUP(tb_select_list_virtual)
+{
+	TBSelectList *list;
+
+	/** Return the number of item widgets that exist in the list. */
+	int GetNumItemWidgets()
+	{
+		int count = 0;
+		for (int i = 0; i < list->GetDefaultSource()->GetNumItems(); i++)
+			if (list->GetItemWidget(i))
+				count++;
+		return count;
+	}
+
+	TB_TEST(Init)
+	{
+		list = new TBSelectList;
+		list->SetVirtualized(true);
+		list->SetItemHeight(20);
+		list->SetRect(TBRect(0, 0, 200, 200));
+		TBStr str;
+		for (int i = 0; i < 50000; i++)
+		{
+			str.SetFormatted("Item %d", i);
+			list->GetDefaultSource()->AddItem(new TBGenericStringItem(str));
+		}
+		list->InvokeProcess();
+	}
+
+	TB_TEST(only_visible_created)
+	{
+		TB_VERIFY(list->GetItemWidget(0));
+		TB_VERIFY(!list->GetItemWidget(1000));
+		TB_VERIFY(GetNumItemWidgets() < 30);
+
+		// The scroll extent should still cover all items.
+		TB_VERIFY(list->GetScrollContainer()->GetScrollInfo().max_y > 50000 * 20 - 400);
+	}
+
+	TB_TEST(scroll)
+	{
+		list->GetScrollContainer()->ScrollTo(0, 20000 * 20);
+		list->InvokeProcess();
+		TB_VERIFY(!list->GetItemWidget(0));
+		TB_VERIFY(list->GetItemWidget(20000));
+		TB_VERIFY(list->GetItemWidget(20000)->GetRect().y == 20000 * 20);
+		TB_VERIFY(GetNumItemWidgets() < 30);
+	}
+
+	TB_TEST(change_value)
+	{
+		list->SetValue(40000);
+		list->InvokeProcess();
+		TB_VERIFY(list->GetItemWidget(40000));
+		TB_VERIFY(list->GetItemWidget(40000)->GetState(WIDGET_STATE_SELECTED));
+		TB_VERIFY(list->ChangeValue(TB_KEY_DOWN));
+		TB_VERIFY(list->GetValue() == 40001);
+		TB_VERIFY(list->ChangeValue(TB_KEY_END));
+		TB_VERIFY(list->GetValue() == 49999);
+		list->InvokeProcess();
+		TB_VERIFY(list->GetItemWidget(49999));
+	}
+
+	TB_TEST(Shutdown)
+	{
+		delete list;
+	}
+}
+
+TB_TEST_GROUP(tb_select_list_incremental)
+{
+	TBSelectList *list;
+
+	/** Get the source index of all item widgets, in the order they are shown. */
+	void GetItemOrder(TBStr &order)
+	{
+		order.Clear();
+		TBWidget *layout = list->GetScrollContainer()->GetContentRoot()->GetFirstChild();
+		for (TBWidget *child = layout->GetFirstChild(); child; child = child->GetNext())
+		{
+			TBStr str;
+			str.SetFormatted("%d:%s,", child->data.GetInt(), child->GetText().CStr());
+			order.Append(str);
+		}
+	}
+
+	/** Return true if the items are the same as if the list had been rebuilt. */
+	bool EqualsRebuiltList()
+	{
+		TBStr incremental, rebuilt;
+		GetItemOrder(incremental);
+		list->InvalidateList();
+		list->ValidateList();
+		GetItemOrder(rebuilt);
+		return incremental.Equals(rebuilt);
+	}
+
+	void AddItem(const char *str, int index)
+	{
+		list->GetDefaultSource()->AddItem(new TBGenericStringItem(str), index);
+	}
+
+	TB_TEST(Init)
+	{
+		list = new TBSelectList;
+		list->GetDefaultSource()->SetSort(TB_SORT_ASCENDING);
+		list->SetRect(TBRect(0, 0, 200, 200));
+		const char *names[] = { "banana", "apple", "cherry", "apple", "fig", "date", "grape", "lemon", "lime" };
+		for (int i = 0; i < 9; i++)
+			AddItem(names[i], i);
+		list->ValidateList();
+	}
+
+	TB_TEST(filter)
+	{
+		list->SetFilter("a");
+		TB_VERIFY(EqualsRebuiltList());
+		list->SetFilter("ap");
+		TB_VERIFY(EqualsRebuiltList());
+		list->SetFilter("l");
+		TB_VERIFY(EqualsRebuiltList());
+		list->SetFilter(nullptr);
+		TB_VERIFY(EqualsRebuiltList());
+	}
+
+	TB_TEST(add_remove)
+	{
+		AddItem("avocado", 0);
+		TB_VERIFY(EqualsRebuiltList());
+		list->SetFilter("e");
+		AddItem("melon", 4);
+		AddItem("kiwi", 2);
+		TB_VERIFY(EqualsRebuiltList());
+		list->GetDefaultSource()->DeleteItem(1);
+		list->GetDefaultSource()->DeleteItem(5);
+		TB_VERIFY(EqualsRebuiltList());
+		list->SetFilter(nullptr);
+		TB_VERIFY(EqualsRebuiltList());
+	}
+
+	TB_TEST(change)
+	{
+		list->SetFilter("an");
+		list->GetDefaultSource()->GetItem(3)->str.Set("orange");
+		list->GetDefaultSource()->InvokeItemChanged(3);
+		TB_VERIFY(EqualsRebuiltList());
+		list->GetDefaultSource()->GetItem(0)->str.Set("aaa");
+		list->GetDefaultSource()->InvokeItemChanged(0);
+		TB_VERIFY(EqualsRebuiltList());
+	}
+
+	TB_TEST(value_follows_item)
+	{
+		list->SetFilter(nullptr);
+		list->SetValue(2);
+		TBStr selected(list->GetDefaultSource()->GetItemString(2));
+		AddItem("zucchini", 0);
+		TB_VERIFY(list->GetValue() == 3);
+		TB_VERIFY(selected.Equals(list->GetDefaultSource()->GetItemString(list->GetValue())));
+		list->GetDefaultSource()->DeleteItem(0);
+		TB_VERIFY(list->GetValue() == 2);
+	}
+
+	/** Source that creates no widget for items starting with 'x'. */
+	class NoWidgetSource : public TBGenericStringItemSource
+	{
+	public:
+		virtual TBWidget *CreateItemWidget(int index, TBSelectItemViewer *viewer)
+		{
+			if (*GetItemString(index) == 'x')
+				return nullptr;
+			return TBGenericStringItemSource::CreateItemWidget(index, viewer);
+		}
+	};
+
+	TB_TEST(items_without_widget)
+	{
+		NoWidgetSource source;
+		source.SetSort(TB_SORT_ASCENDING);
+		const char *names[] = { "b", "xa", "c", "xd", "a" };
+		for (int i = 0; i < 5; i++)
+			source.AddItem(new TBGenericStringItem(names[i]));
+		list->SetFilter(nullptr);
+		list->SetSource(&source);
+		list->ValidateList();
+
+		// Items without a widget are not shown at all.
+		TBStr order;
+		GetItemOrder(order);
+		TB_VERIFY_STR(order, "4:a,0:b,2:c,");
+
+		source.AddItem(new TBGenericStringItem("bb"), 0);
+		source.AddItem(new TBGenericStringItem("xb"), 3);
+		source.AddItem(new TBGenericStringItem("y"), 1);
+		TB_VERIFY(EqualsRebuiltList());
+		list->SetFilter("b");
+		TB_VERIFY(EqualsRebuiltList());
+		list->SetFilter(nullptr);
+		TB_VERIFY(EqualsRebuiltList());
+		source.DeleteItem(2);
+		source.DeleteItem(0);
+		TB_VERIFY(EqualsRebuiltList());
+
+		list->SetSource(list->GetDefaultSource());
+	}
+
+	TB_TEST(Shutdown)
+	{
+		delete list;
+	}
+}
+
+TB_TEST_GROUP(tb_widget_string)
+{
+	TBWidget *widget;
+	TBWidgetString str;
+	TBStr text;
+
+	TB_TEST(Init)
+	{
+		// Use the test dummy font, where each character is 16 / 3 + 1 = 6 pixels wide.
+		widget = new TBWidget;
+		TBFontDescription fd;
+		fd.SetSize(16);
+		widget->SetFontDescription(fd);
+	}
+
+	TB_TEST(fits)
+	{
+		str.SetText("Hello");
+		str.GetVisibleText(widget, 30, text);
+		TB_VERIFY_STR(text, "Hello");
+	}
+
+	TB_TEST(ellipsis_end)
+	{
+		str.SetText("Hello world");
+		str.GetVisibleText(widget, 50, text);
+		TB_VERIFY_STR(text, "Hello...");
+		str.GetVisibleText(widget, 65, text);
+		TB_VERIFY_STR(text, "Hello w...");
+		str.GetVisibleText(widget, 10, text);
+		TB_VERIFY_STR(text, "...");
+	}
+
+	TB_TEST(ellipsis_middle)
+	{
+		str.SetTextEllipsis(TB_TEXT_ELLIPSIS_MIDDLE);
+		str.SetText("/home/user/file.txt");
+		str.GetVisibleText(widget, 60, text);
+		TB_VERIFY_STR(text, "/ho....txt");
+		str.GetVisibleText(widget, 102, text);
+		TB_VERIFY_STR(text, "/home/u...ile.txt");
+		str.SetTextEllipsis(TB_TEXT_ELLIPSIS_END);
+		str.GetVisibleText(widget, 60, text);
+		TB_VERIFY_STR(text, "/home/u...");
+	}
+
+	TB_TEST(utf8)
+	{
+		// Each character is 2 bytes, and must not be cut in the middle.
+		str.SetText("\xC3\x85\xC3\x84\xC3\x96\xC3\xA5\xC3\xA4\xC3\xB6");
+		str.GetVisibleText(widget, 35, text);
+		TB_VERIFY_STR(text, "\xC3\x85\xC3\x84...");
+		str.SetTextEllipsis(TB_TEXT_ELLIPSIS_MIDDLE);
+		str.GetVisibleText(widget, 30, text);
+		TB_VERIFY_STR(text, "\xC3\x85...\xC3\xB6");
+		str.SetTextEllipsis(TB_TEXT_ELLIPSIS_END);
+	}
+
+	TB_TEST(Shutdown)
+	{
+		delete widget;
+	}
+}
+
+TB_TEST_GROUP(tb_widget_template)
+{
+	const char *resource =
+		"TBLayout: id: 'root'\n"
+		"	lp: width: 100\n"
+		"	TBButton: id: 'b1', text: 'One'\n"
+		"	NotAWidget: id: 'skipped'\n"
+		"		TBButton: id: 'skipped_child'\n"
+		"	TBLayout: id: 'inner'\n"
+		"		TBEditField: id: 'edit', text: 'Edit'\n"
+		"		TBCheckBox: id: 'check', value: 1\n"
+		"TBButton: id: 'b2', rect: 1 2 30 40, data: 1.5\n";
+
+	/** Get a string describing the widget tree, to compare different ways of creating it. */
+	void GetTree(TBWidget *widget, TBStr &tree)
+	{
+		TBStr str;
+		str.SetFormatted("%u:%s:%d:%d,%d,%d,%d:%s(", (uint32) widget->GetID(), widget->GetText().CStr(),
+						widget->GetValue(), widget->GetRect().x, widget->GetRect().y,
+						widget->GetRect().w, widget->GetRect().h, widget->data.GetString());
+		tree.Append(str);
+		for (TBWidget *child = widget->GetFirstChild(); child; child = child->GetNext())
+			GetTree(child, tree);
+		tree.Append(")");
+	}
+
+	/** Return true if inflating the template gives the same widgets as LoadData. */
+	bool EqualsLoadData(TBWidgetTemplate *widget_template)
+	{
+		TBWidget loaded, inflated;
+		g_widgets_reader->LoadData(&loaded, resource);
+		g_widgets_reader->LoadTemplate(&inflated, widget_template);
+		TBStr loaded_tree, inflated_tree;
+		GetTree(&loaded, loaded_tree);
+		GetTree(&inflated, inflated_tree);
+		return loaded_tree.Length() > 100 && loaded_tree.Equals(inflated_tree);
+	}
+
+	TB_TEST(compile)
+	{
+		TBWidgetTemplate widget_template;
+		TB_VERIFY(widget_template.ReadData(g_widgets_reader, resource, strlen(resource)));
+		TB_VERIFY(widget_template.GetNumWidgets() == 6);
+		TB_VERIFY(EqualsLoadData(&widget_template));
+		// Inflating it again should give the same result.
+		TB_VERIFY(EqualsLoadData(&widget_template));
+	}
+
+	TB_TEST(save_load)
+	{
+		TBWidgetTemplate widget_template, loaded;
+		TBTempBuffer buf;
+		TB_VERIFY(widget_template.ReadData(g_widgets_reader, resource, strlen(resource)));
+		TB_VERIFY(widget_template.SaveCompiled(buf, 1234));
+
+		TB_VERIFY(!loaded.LoadCompiled(g_widgets_reader, buf.GetData(), buf.GetAppendPos(), 4321));
+		TB_VERIFY(loaded.LoadCompiled(g_widgets_reader, buf.GetData(), buf.GetAppendPos(), 1234));
+		TB_VERIFY(loaded.GetNumWidgets() == 6);
+		TB_VERIFY(EqualsLoadData(&loaded));
+
+		// Truncated data should always fail.
+		for (int len = 0; len < buf.GetAppendPos(); len++)
+			TB_VERIFY(!loaded.LoadCompiled(g_widgets_reader, buf.GetData(), len, 1234));
+	}
+
+	TB_TEST(cache)
+	{
+		TB_VERIFY(!g_widgets_reader->GetTemplate("this_file_does_not_exist.tb.txt"));
+
+		TBWidgetTemplate *widget_template = new TBWidgetTemplate;
+		TB_VERIFY(widget_template->ReadData(g_widgets_reader, resource, strlen(resource)));
+		TB_VERIFY(g_widgets_reader->AddTemplate("cached.tb.txt", widget_template));
+		TB_VERIFY(g_widgets_reader->GetTemplate("cached.tb.txt") == widget_template);
+		// Adding the cached template again should keep it.
+		TB_VERIFY(g_widgets_reader->AddTemplate("cached.tb.txt", g_widgets_reader->GetTemplate("cached.tb.txt")));
+		TB_VERIFY(g_widgets_reader->GetTemplate("cached.tb.txt") == widget_template);
+
+		TBWidget root;
+		TB_VERIFY(g_widgets_reader->LoadTemplate(&root, "cached.tb.txt"));
+		TB_VERIFY(root.GetWidgetByID(TBIDC("check")));
+
+		g_widgets_reader->ClearTemplateCache();
+		TB_VERIFY(!g_widgets_reader->GetTemplate("cached.tb.txt"));
+	}
+}
+
+namespace tb { extern TBWidgetFactory *g_registered_factories; };
+
+TB_TEST_GROUP(tb_widget_factory)
+{
+	TB_TEST(lookup)
+	{
+		for (TBWidgetFactory *wf = g_registered_factories; wf; wf = wf->next_registered_wf)
+			TB_VERIFY(g_widgets_reader->GetFactory(wf->name) == wf);
+		TB_VERIFY(!g_widgets_reader->GetFactory("TBNotAWidget"));
+	}
+}
+
+#ifdef TB_UNIT_TESTING_BENCHMARKS
+
+/** Find a factory by comparing the name of each factory in order, like
+	TBWidgetsReader did before it hashed the names. Used as reference in the benchmark. */
+static TBWidgetFactory *GetFactoryLinear(const char *name)
+{
+	for (TBWidgetFactory *wf = g_registered_factories; wf; wf = wf->next_registered_wf)
+		if (strcmp(name, wf->name) == 0)
+			return wf;
+	return nullptr;
+}
+
+TB_TEST_GROUP(tb_widget_factory_benchmark)
+{
+	TB_TEST(lookup)
+	{
+		int num_factories = 0;
+		for (TBWidgetFactory *wf = g_registered_factories; wf; wf = wf->next_registered_wf)
+			num_factories++;
+
+		// Look up the name of each factory in turn, as inflating resources does.
+		const int num_lookups = 200000;
+		TBWidgetFactory *wf = g_registered_factories;
+		double start_time = TBSystem::GetTimeMS();
+		for (int i = 0; i < num_lookups; i++, wf = wf->next_registered_wf ? wf->next_registered_wf : g_registered_factories)
+			TB_VERIFY(g_widgets_reader->GetFactory(wf->name) == wf);
+		double hashed_ms = TBSystem::GetTimeMS() - start_time;
+
+		start_time = TBSystem::GetTimeMS();
+		for (int i = 0; i < num_lookups; i++, wf = wf->next_registered_wf ? wf->next_registered_wf : g_registered_factories)
+			TB_VERIFY(GetFactoryLinear(wf->name) == wf);
+		double linear_ms = TBSystem::GetTimeMS() - start_time;
+
+		if (test_settings & TB_TEST_VERBOSE)
+			TBDebugPrint("  %d lookups in %d factories: GetFactory %.1f ms, linear %.1f ms\n",
+						num_lookups, num_factories, hashed_ms, linear_ms);
+	}
+}
+
+#endif // TB_UNIT_TESTING_BENCHMARKS
+
+#endif // TB_UNIT_TESTING